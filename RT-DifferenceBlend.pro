@@ -11,15 +11,49 @@ CONFIG += c++20
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    backend/blendjob.cpp \
+    backend/blendkernels.cpp \
+    backend/blendsession.cpp \
+    backend/capturepacer.cpp \
     backend/dxwindowcapture.cpp \
+    backend/exposurestack.cpp \
+    backend/framededup.cpp \
+    backend/framememory.cpp \
+    backend/kernelregistry.cpp \
     backend/mediator.cpp \
+    backend/motionestimator.cpp \
+    backend/motionheatmap.cpp \
+    backend/pipelinetrace.cpp \
+    backend/resultpublisher.cpp \
+    backend/sessionstore.cpp \
+    backend/thresholdcache.cpp \
+    backend/yuvframe.cpp \
     features/droparea.cpp \
+    features/tiledimageviewer.cpp \
     main.cpp \
     ui/mainwindow.cpp
 HEADERS += \
+    backend/blendjob.h \
+    backend/blendkernels.h \
+    backend/blendmethod.h \
+    backend/blendsession.h \
+    backend/capturepacer.h \
     backend/dxwindowcapture.h \
+    backend/exposurestack.h \
+    backend/framededup.h \
+    backend/framememory.h \
+    backend/kernelregistry.h \
     backend/mediator.h \
+    backend/motionestimator.h \
+    backend/motionheatmap.h \
+    backend/parallelfor.h \
+    backend/pipelinetrace.h \
+    backend/resultpublisher.h \
+    backend/sessionstore.h \
+    backend/thresholdcache.h \
+    backend/yuvframe.h \
     features/droparea.h \
+    features/tiledimageviewer.h \
     ui/mainwindow.h
 
 FORMS += \
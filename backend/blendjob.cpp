@@ -0,0 +1,126 @@
+#include "backend/blendjob.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+
+BlendJobControl::BlendJobControl(BlendJobRunner *runner, quint64 generation, int partialIntervalMs)
+    : m_runner(runner)
+    , m_generation(generation)
+    , m_partialIntervalMs(partialIntervalMs)
+{
+    m_sincePartial.start();
+}
+
+void BlendJobControl::offerPartial(const std::function<QImage()> &snapshot)
+{
+    if (isCancelled() || m_sincePartial.elapsed() < m_partialIntervalMs) return;
+
+    const QImage image = snapshot();
+    m_sincePartial.restart();
+
+    if (image.isNull()) return;
+    m_runner->deliver(m_generation, [runner = m_runner, image]() {
+        emit runner->partialReady(image);
+    });
+}
+
+void BlendJobControl::setProgress(int done, int total)
+{
+    // В поток GUI уходит только смена процента
+    const int percent = total > 0 ? int(qint64(done) * 100 / total) : 100;
+    if (percent == m_lastPercent || isCancelled()) return;
+    m_lastPercent = percent;
+
+    m_runner->deliver(m_generation, [runner = m_runner, done, total]() {
+        emit runner->progressChanged(done, total);
+    });
+}
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+BlendJobRunner::BlendJobRunner(QObject *parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+BlendJobRunner::~BlendJobRunner()
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending = Work();
+    if (m_current) m_current->m_cancelled.store(true, std::memory_order_relaxed);
+    m_generation.fetch_add(1);
+
+    while (m_running) {
+        m_idle.wait(&m_mutex);
+    }
+}
+
+void BlendJobRunner::submit(Work work)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Текущая задача выйдет на ближайшей проверке; в очереди остается только новая
+    m_generation.fetch_add(1);
+    if (m_current) m_current->m_cancelled.store(true, std::memory_order_relaxed);
+    m_pending = std::move(work);
+
+    if (!m_running) {
+        m_running = true;
+        m_pool.start([this]() { run(); });
+    }
+}
+
+void BlendJobRunner::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_generation.fetch_add(1);
+    if (m_current) m_current->m_cancelled.store(true, std::memory_order_relaxed);
+    m_pending = Work();
+}
+
+bool BlendJobRunner::isBusy() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running;
+}
+
+void BlendJobRunner::run()
+{
+    for (;;) {
+        Work work;
+        std::shared_ptr<BlendJobControl> control;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_pending) {
+                m_current.reset();
+                m_running = false;
+                m_idle.wakeAll();
+                return;
+            }
+
+            work = std::move(m_pending);
+            m_pending = Work();
+            control.reset(new BlendJobControl(this, m_generation.load(), partialInterval()));
+            m_current = control;
+        }
+
+        const Completion completion = work(*control);
+
+        if (completion && !control->isCancelled()) {
+            deliver(control->m_generation, completion);
+        }
+    }
+}
+
+void BlendJobRunner::deliver(quint64 generation, std::function<void()> f)
+{
+    // Проверка в потоке объекта: задачу могли вытеснить, пока событие шло по очереди
+    QMetaObject::invokeMethod(this, [this, generation, f = std::move(f)]() {
+        if (generation == m_generation.load()) f();
+    }, Qt::QueuedConnection);
+}
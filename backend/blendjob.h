@@ -0,0 +1,98 @@
+#ifndef BLENDJOB_H
+#define BLENDJOB_H
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class BlendJobRunner;
+
+// Управление фоновой задачей смешивания изнутри: кооперативная отмена и промежуточные результаты.
+// Ядра проверяют isCancelled() между кадрами или полосами и выходят досрочно - результат
+// отмененной задачи никуда не попадает. Передается в ImageBlender по указателю, nullptr - без отмены
+class BlendJobControl
+{
+public:
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+    // Только из потока задачи (между кадрами или волнами полос, когда накопитель никто не пишет).
+    // snapshot вызывается, только если с прошлого промежуточного результата прошел интервал,
+    // поэтому копия накопителя делается не на каждом кадре
+    void offerPartial(const std::function<QImage()> &snapshot);
+    void setProgress(int done, int total);
+
+private:
+    friend class BlendJobRunner;
+    BlendJobControl(BlendJobRunner *runner, quint64 generation, int partialIntervalMs);
+
+private:
+    BlendJobRunner *m_runner;
+    const quint64 m_generation;
+    const int m_partialIntervalMs;
+    std::atomic<bool> m_cancelled{false};
+    QElapsedTimer m_sincePartial;
+    int m_lastPercent = -1;
+};
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+// Фоновое смешивание загруженных кадров. Одновременно считается не больше одной задачи;
+// новая задача вытесняет текущую (та получает отмену) и ждущую в очереди - довести до конца
+// успевают только последние параметры. Поток GUI только ставит флаги, поэтому не ждет расчета
+// при любой длине последовательности.
+// Задача возвращает завершение - оно выполняется в потоке объекта, только если задачу никто
+// не вытеснил. Промежуточные результаты и прогресс устаревших задач тоже отбрасываются
+class BlendJobRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Completion = std::function<void()>;
+    using Work = std::function<Completion(BlendJobControl &control)>;
+
+public:
+    explicit BlendJobRunner(QObject *parent = nullptr);
+    ~BlendJobRunner();      // Отменяет задачи и дожидается выхода текущей
+
+    void submit(Work work);
+    void cancel();
+    bool isBusy() const;
+
+    void setPartialInterval(int ms) { m_partialIntervalMs.store(ms, std::memory_order_relaxed); }
+    int partialInterval() const { return m_partialIntervalMs.load(std::memory_order_relaxed); }
+
+signals:
+    void partialReady(const QImage &image);
+    void progressChanged(int done, int total);
+
+private:
+    friend class BlendJobControl;
+
+    void run();
+    // Выполняет f в потоке объекта, если generation все еще последняя
+    void deliver(quint64 generation, std::function<void()> f);
+
+private:
+    QThreadPool m_pool;     // Один поток-координатор; полосы считаются на глобальном пуле (parallelFor)
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_idle;
+    std::atomic<quint64> m_generation{0};
+    std::atomic<int> m_partialIntervalMs{100};
+    Work m_pending;
+    std::shared_ptr<BlendJobControl> m_current;
+    bool m_running = false;
+};
+
+#endif // BLENDJOB_H
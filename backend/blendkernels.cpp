@@ -0,0 +1,2014 @@
+#include "backend/blendkernels.h"
+#include "backend/pipelinetrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLENDKERNELS_SSE2
+#endif
+
+FrameView FrameView::subView(const QRect &rect) const
+{
+    const QRect area = rect.intersected(QRect(0, 0, width, height));
+    if (!isValid() || area.isEmpty()) {
+        return FrameView();
+    }
+
+    FrameView view = *this;
+    view.data = data + qsizetype(area.y()) * stride + qsizetype(area.x()) * bytesPerPixel(format);
+    view.width = area.width();
+    view.height = area.height();
+    return view;
+}
+
+int FrameView::bytesPerPixel(FramePixelFormat format)
+{
+    switch (format) {
+        case FramePixelFormat::BGRA8:
+        case FramePixelFormat::RGBA8:   return 4;
+        case FramePixelFormat::Gray8:   return 1;
+        case FramePixelFormat::RGBA16:
+        case FramePixelFormat::RGBA16F: return 8;
+        default:                        return 0;
+    }
+}
+
+FrameView FrameView::fromImage(const QImage &image, const QRect &rect)
+{
+    FrameView view;
+
+    switch (image.format()) {
+        case QImage::Format_ARGB32:
+        case QImage::Format_RGB32:          view.format = FramePixelFormat::BGRA8; break;
+        case QImage::Format_RGBA8888:
+        case QImage::Format_RGBX8888:       view.format = FramePixelFormat::RGBA8; break;
+        case QImage::Format_Grayscale8:     view.format = FramePixelFormat::Gray8; break;
+        case QImage::Format_RGBA64:
+        case QImage::Format_RGBX64:         view.format = FramePixelFormat::RGBA16; break;
+        case QImage::Format_RGBA16FPx4:
+        case QImage::Format_RGBX16FPx4:     view.format = FramePixelFormat::RGBA16F; break;
+        default:                            return FrameView();
+    }
+
+    view.data = image.constBits();
+    view.width = image.width();
+    view.height = image.height();
+    view.stride = image.bytesPerLine();
+
+    return rect.isNull() ? view : view.subView(rect);
+}
+
+YuvFrameView YuvFrameView::subView(const QRect &rect) const
+{
+    const QRect area = rect.intersected(QRect(QPoint(0, 0), size()));
+    if (!isValid() || area.isEmpty()) {
+        return YuvFrameView();
+    }
+
+    YuvFrameView view = *this;
+    view.luma = luma.subView(area);
+    view.chromaOrigin = chromaOrigin + area.topLeft();
+    return view;
+}
+
+MutableFrameView MutableFrameView::subView(const QRect &rect) const
+{
+    const QRect area = rect.intersected(QRect(0, 0, width, height));
+    if (!isValid() || area.isEmpty()) {
+        return MutableFrameView();
+    }
+
+    MutableFrameView view = *this;
+    view.data = data + qsizetype(area.y()) * stride + qsizetype(area.x()) * 4;
+    view.width = area.width();
+    view.height = area.height();
+    return view;
+}
+
+MutableFrameView MutableFrameView::fromImage(QImage &image)
+{
+    MutableFrameView view;
+    if (image.format() != QImage::Format_ARGB32 && image.format() != QImage::Format_RGB32) {
+        return view;
+    }
+
+    view.data = image.bits();
+    view.width = image.width();
+    view.height = image.height();
+    view.stride = image.bytesPerLine();
+    return view;
+}
+
+MutableFloatFrameView MutableFloatFrameView::subView(const QRect &rect) const
+{
+    const QRect area = rect.intersected(QRect(0, 0, width, height));
+    if (!isValid() || area.isEmpty()) {
+        return MutableFloatFrameView();
+    }
+
+    MutableFloatFrameView view = *this;
+    view.data = data + qsizetype(area.y()) * stride + qsizetype(area.x()) * 4 * qsizetype(sizeof(float));
+    view.width = area.width();
+    view.height = area.height();
+    return view;
+}
+
+MutableFloatFrameView MutableFloatFrameView::fromImage(QImage &image)
+{
+    MutableFloatFrameView view;
+    if (image.format() != QImage::Format_RGBA32FPx4) {
+        return view;
+    }
+
+    view.data = image.bits();
+    view.width = image.width();
+    view.height = image.height();
+    view.stride = image.bytesPerLine();
+    return view;
+}
+
+
+StackView StackView::subView(const QRect &rect) const
+{
+    const QRect area = rect.intersected(QRect(0, 0, width, height));
+    if (!isValid() || area.isEmpty()) {
+        return StackView();
+    }
+
+    StackView view = *this;
+    const qsizetype offset = qsizetype(area.y()) * stride + area.x();
+    for (int c = 0; c < 3; ++c) {
+        view.sums[c] = sums[c] + offset;
+        view.squares[c] = squares[c] ? squares[c] + offset : nullptr;
+    }
+    view.counts = counts ? counts + qsizetype(area.y()) * countsStride + area.x() : nullptr;
+    view.width = area.width();
+    view.height = area.height();
+    return view;
+}
+
+void DiffHistogram::clear()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+void DiffHistogram::merge(const DiffHistogram &other)
+{
+    for (int lane = 0; lane < 4; ++lane) {
+        for (int value = 0; value < 256; ++value) {
+            m_counts[lane][value] += other.m_counts[lane][value];
+        }
+    }
+}
+
+quint64 DiffHistogram::bin(int value) const
+{
+    if (value < 0 || value > 255) return 0;
+    return m_counts[0][value] + m_counts[1][value] + m_counts[2][value] + m_counts[3][value];
+}
+
+quint64 DiffHistogram::total() const
+{
+    quint64 sum = 0;
+    for (int value = 0; value < 256; ++value) {
+        sum += bin(value);
+    }
+    return sum;
+}
+
+int DiffHistogram::percentile(double fraction, int maxValue) const
+{
+    maxValue = qBound(1, maxValue, 255);
+
+    quint64 count = 0;
+    for (int value = 1; value <= maxValue; ++value) {
+        count += bin(value);
+    }
+    if (count == 0) return 0;
+
+    const double target = qBound(0.0, fraction, 1.0) * double(count);
+    quint64 cumulative = 0;
+    for (int value = 1; value <= maxValue; ++value) {
+        cumulative += bin(value);
+        if (double(cumulative) >= target) {
+            return value;
+        }
+    }
+    return maxValue;
+}
+
+int DiffHistogram::otsuThreshold() const
+{
+    // Классы: шум [1, t] и движение (t, 255]; порог сравнивается как "разность > t"
+    double weightAll = 0.0;
+    double sumAll = 0.0;
+    for (int value = 1; value < 256; ++value) {
+        weightAll += double(bin(value));
+        sumAll += double(value) * double(bin(value));
+    }
+    if (weightAll == 0.0) return 0;
+
+    double weightLow = 0.0;
+    double sumLow = 0.0;
+    double bestVariance = -1.0;
+    int best = 0;
+
+    for (int t = 1; t < 255; ++t) {
+        weightLow += double(bin(t));
+        sumLow += double(t) * double(bin(t));
+
+        const double weightHigh = weightAll - weightLow;
+        if (weightLow == 0.0) continue;
+        if (weightHigh == 0.0) break;
+
+        const double meanLow = sumLow / weightLow;
+        const double meanHigh = (sumAll - sumLow) / weightHigh;
+        const double variance = weightLow * weightHigh * (meanLow - meanHigh) * (meanLow - meanHigh);
+
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            best = t;
+        }
+    }
+
+    return best;
+}
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+namespace {
+
+template <FramePixelFormat Format>
+using FormatTag = std::integral_constant<FramePixelFormat, Format>;
+
+// Выбор специализации ядра по формату входных кадров
+template <typename Kernel>
+bool dispatchFormat(FramePixelFormat format, Kernel &&kernel)
+{
+    switch (format) {
+        case FramePixelFormat::BGRA8:   kernel(FormatTag<FramePixelFormat::BGRA8>()); return true;
+        case FramePixelFormat::RGBA8:   kernel(FormatTag<FramePixelFormat::RGBA8>()); return true;
+        case FramePixelFormat::Gray8:   kernel(FormatTag<FramePixelFormat::Gray8>()); return true;
+        default:                        return false;
+    }
+}
+
+template <FramePixelFormat Format>
+inline QRgb loadPixel(const uchar *row, int x)
+{
+    if constexpr (Format == FramePixelFormat::BGRA8) {
+        return reinterpret_cast<const QRgb*>(row)[x];
+    } else if constexpr (Format == FramePixelFormat::RGBA8) {
+        const uchar *p = row + x * 4;
+        return qRgba(p[0], p[1], p[2], p[3]);
+    } else {
+        const int gray = row[x];
+        return qRgb(gray, gray, gray);
+    }
+}
+
+template <FramePixelFormat Format>
+inline int loadGray(const uchar *row, int x)
+{
+    if constexpr (Format == FramePixelFormat::Gray8) {
+        return row[x];
+    } else {
+        return qGray(loadPixel<Format>(row, x));
+    }
+}
+
+bool compatible(const MutableFrameView &result, const FrameView &prev, const FrameView &curr)
+{
+    return result.isValid() && prev.isValid() && curr.isValid()
+           && prev.format == curr.format
+           && prev.size() == curr.size()
+           && result.size() == curr.size();
+}
+
+bool compatiblePair(const uchar *map, const FrameView &prev, const FrameView &curr)
+{
+    return map && prev.isValid() && curr.isValid()
+           && prev.format == curr.format
+           && prev.size() == curr.size();
+}
+
+//---------Кадры 16 бит на канал---------//
+
+template <typename Kernel>
+bool dispatchWideFormat(FramePixelFormat format, Kernel &&kernel)
+{
+    switch (format) {
+        case FramePixelFormat::RGBA16:  kernel(FormatTag<FramePixelFormat::RGBA16>()); return true;
+        case FramePixelFormat::RGBA16F: kernel(FormatTag<FramePixelFormat::RGBA16F>()); return true;
+        default:                        return false;
+    }
+}
+
+// half -> float: экспонента сдвигается умножением на 2^112 (денормализованные числа нормализуются сами),
+// экспонента 31 (Inf/NaN) переносится отдельно
+inline float halfToFloat(quint16 half)
+{
+    const quint32 magnitude = quint32(half & 0x7FFF) << 13;
+    float value;
+    memcpy(&value, &magnitude, sizeof(value));
+    value *= 5.192296858534828e+33f;    // 2^112
+
+    quint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (magnitude >= 0x0F800000) {
+        bits |= 0x7F800000;
+    }
+    bits |= quint32(half & 0x8000) << 16;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Пиксель R,G,B,A в float. С SSE2 - один регистр, операции сразу над четырьмя каналами
+#ifdef BLENDKERNELS_SSE2
+struct Float4 { __m128 v; };
+
+inline __m128 halfToFloat4(__m128i halves)
+{
+    const __m128i magnitude = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x7FFF)), 13);
+    const __m128i sign = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x8000)), 16);
+    __m128 value = _mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+
+    const __m128i infNan = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x0F7FFFFF));
+    value = _mm_or_ps(value, _mm_castsi128_ps(_mm_and_si128(infNan, _mm_set1_epi32(0x7F800000))));
+    return _mm_or_ps(value, _mm_castsi128_ps(sign));
+}
+
+template <FramePixelFormat Format>
+inline Float4 loadWide(const uchar *row, int x)
+{
+    // 4 канала по 16 бит -> 4 lanes по 32 бита
+    const __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + x * 8));
+    const __m128i lanes = _mm_unpacklo_epi16(raw, _mm_setzero_si128());
+
+    if constexpr (Format == FramePixelFormat::RGBA16) {
+        return {_mm_mul_ps(_mm_cvtepi32_ps(lanes), _mm_set1_ps(1.0f / 65535.0f))};
+    } else {
+        return {halfToFloat4(lanes)};
+    }
+}
+
+inline Float4 splat4(float value) { return {_mm_set1_ps(value)}; }
+inline Float4 loadFloat4(const float *p) { return {_mm_loadu_ps(p)}; }
+inline void storeFloat4(float *p, Float4 a) { _mm_storeu_ps(p, a.v); }
+inline Float4 sub4(Float4 a, Float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Float4 abs4(Float4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+inline Float4 max4(Float4 a, Float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+
+inline Float4 withOpaqueAlpha(Float4 a)
+{
+    const __m128 rgbMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    return {_mm_or_ps(_mm_and_ps(a.v, rgbMask), _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f))};
+}
+
+inline float maxRgb(Float4 a)
+{
+    const __m128 g = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 b = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 2, 2));
+    return _mm_cvtss_f32(_mm_max_ss(_mm_max_ss(a.v, g), b));
+}
+
+inline float weightedRgb(Float4 a, float wr, float wg, float wb)
+{
+    const __m128 p = _mm_mul_ps(a.v, _mm_set_ps(0.0f, wb, wg, wr));
+    const __m128 g = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 b = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2));
+    return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(p, g), b));
+}
+#else
+struct Float4 { float v[4]; };
+
+template <FramePixelFormat Format>
+inline Float4 loadWide(const uchar *row, int x)
+{
+    quint16 channels[4];
+    memcpy(channels, row + x * 8, sizeof(channels));
+
+    Float4 r;
+    for (int i = 0; i < 4; ++i) {
+        if constexpr (Format == FramePixelFormat::RGBA16) {
+            r.v[i] = channels[i] * (1.0f / 65535.0f);
+        } else {
+            r.v[i] = halfToFloat(channels[i]);
+        }
+    }
+    return r;
+}
+
+inline Float4 splat4(float value) { return {{value, value, value, value}}; }
+inline Float4 loadFloat4(const float *p) { Float4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void storeFloat4(float *p, Float4 a) { memcpy(p, a.v, sizeof(a.v)); }
+inline Float4 sub4(Float4 a, Float4 b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+inline Float4 abs4(Float4 a) { return {{std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3])}}; }
+// Как _mm_max_ps: при NaN результат - второй аргумент
+inline Float4 max4(Float4 a, Float4 b)
+{
+    Float4 r;
+    for (int i = 0; i < 4; ++i) {
+        r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+    }
+    return r;
+}
+inline Float4 withOpaqueAlpha(Float4 a) { a.v[3] = 1.0f; return a; }
+inline float maxRgb(Float4 a) { return qMax(qMax(a.v[0], a.v[1]), a.v[2]); }
+inline float weightedRgb(Float4 a, float wr, float wg, float wb) { return a.v[0] * wr + a.v[1] * wg + a.v[2] * wb; }
+#endif
+
+// Обход пары 16-битных кадров: op(float *resultPixel, Float4 prev, Float4 curr)
+template <FramePixelFormat Format, typename Op>
+void forEachWidePixel(const MutableFloatFrameView &result, const FrameView &prev, const FrameView &curr, Op &&op)
+{
+    for (int y = 0; y < curr.height; ++y) {
+        const uchar *prevRow = prev.row(y);
+        const uchar *currRow = curr.row(y);
+        float *resultRow = result.row(y);
+
+        for (int x = 0; x < curr.width; ++x) {
+            op(resultRow + x * 4, loadWide<Format>(prevRow, x), loadWide<Format>(currRow, x));
+        }
+    }
+}
+
+//---------Выбор варианта парных ядер---------//
+
+#ifdef BLENDKERNELS_SSE2
+constexpr BlendKernels::KernelVariant kDefaultVariant = BlendKernels::KernelVariant::Simd;
+#else
+constexpr BlendKernels::KernelVariant kDefaultVariant = BlendKernels::KernelVariant::Scalar;
+#endif
+
+std::atomic<BlendKernels::KernelVariant> s_variants[BlendKernels::PairKernelCount] = {
+    kDefaultVariant, kDefaultVariant, kDefaultVariant, kDefaultVariant, kDefaultVariant, kDefaultVariant
+};
+
+bool useSimd(BlendKernels::PairKernel kernel, BlendKernels::KernelVariant variant)
+{
+#ifdef BLENDKERNELS_SSE2
+    if (variant == BlendKernels::KernelVariant::Selected) {
+        variant = s_variants[kernel].load(std::memory_order_relaxed);
+    }
+    return variant == BlendKernels::KernelVariant::Simd;
+#else
+    Q_UNUSED(kernel);
+    Q_UNUSED(variant);
+    return false;
+#endif
+}
+
+#ifdef BLENDKERNELS_SSE2
+// SIMD-варианты парных ядер для BGRA8 (4 пикселя за итерацию) и Gray8 (16 пикселей).
+// Хвост строки - той же формулой, что и скалярные ядра; результат совпадает побитно
+
+inline __m128i absDiffU8(__m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+void maxDiffBgraSse2(const MutableFrameView &result, const FrameView &prev, const FrameView &curr)
+{
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+
+    for (int y = 0; y < curr.height; ++y) {
+        const QRgb *prevRow = reinterpret_cast<const QRgb*>(prev.row(y));
+        const QRgb *currRow = reinterpret_cast<const QRgb*>(curr.row(y));
+        QRgb *resultRow = result.row(y);
+        int x = 0;
+
+        for (; x + 4 <= curr.width; x += 4) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x));
+            const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(resultRow + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(resultRow + x),
+                             _mm_or_si128(_mm_max_epu8(r, absDiffU8(a, b)), alpha));
+        }
+
+        for (; x < curr.width; ++x) {
+            const QRgb p = prevRow[x], c = currRow[x], r = resultRow[x];
+            resultRow[x] = qRgb(qMax(qRed(r),   qAbs(qRed(c) - qRed(p))),
+                                qMax(qGreen(r), qAbs(qGreen(c) - qGreen(p))),
+                                qMax(qBlue(r),  qAbs(qBlue(c) - qBlue(p))));
+        }
+    }
+}
+
+void thresholdChannelsBgraSse2(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                               int threshold)
+{
+    const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i limit = _mm_set1_epi32(threshold);
+
+    for (int y = 0; y < curr.height; ++y) {
+        const QRgb *prevRow = reinterpret_cast<const QRgb*>(prev.row(y));
+        const QRgb *currRow = reinterpret_cast<const QRgb*>(curr.row(y));
+        QRgb *resultRow = result.row(y);
+        int x = 0;
+
+        for (; x + 4 <= curr.width; x += 4) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x));
+
+            // Максимум трех байт разности - в младшем байте lane
+            const __m128i d = _mm_and_si128(absDiffU8(a, b), rgbMask);
+            const __m128i m1 = _mm_max_epu8(d, _mm_srli_epi32(d, 8));
+            const __m128i m2 = _mm_max_epu8(m1, _mm_srli_epi32(m1, 16));
+            const __m128i diff = _mm_and_si128(m2, _mm_set1_epi32(0xFF));
+
+            const __m128i hit = _mm_andnot_si128(_mm_cmpeq_epi32(a, b), _mm_cmpgt_epi32(diff, limit));
+            __m128i *dst = reinterpret_cast<__m128i*>(resultRow + x);
+            _mm_storeu_si128(dst, _mm_or_si128(_mm_loadu_si128(dst), hit));
+        }
+
+        for (; x < curr.width; ++x) {
+            const QRgb p = prevRow[x], c = currRow[x];
+            if (p == c) continue;
+            const int diff = qMax(qMax(qAbs(qRed(c) - qRed(p)), qAbs(qGreen(c) - qGreen(p))), qAbs(qBlue(c) - qBlue(p)));
+            if (diff > threshold) resultRow[x] = 0xFFFFFFFF;
+        }
+    }
+}
+
+void thresholdGrayGray8Sse2(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                            int threshold)
+{
+    // Совпадающие пиксели пропускаются, поэтому отрицательный порог работает как 0
+    threshold = qMax(0, threshold);
+    if (threshold >= 255) return;
+    const __m128i limit = _mm_set1_epi8(char(threshold + 1));
+
+    for (int y = 0; y < curr.height; ++y) {
+        const uchar *prevRow = prev.row(y);
+        const uchar *currRow = curr.row(y);
+        QRgb *resultRow = result.row(y);
+        int x = 0;
+
+        for (; x + 16 <= curr.width; x += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x));
+            const __m128i d = absDiffU8(a, b);
+            const __m128i hit8 = _mm_cmpeq_epi8(_mm_max_epu8(d, limit), d);
+            if (_mm_movemask_epi8(hit8) == 0) continue;
+
+            // Байт маски -> 32 бита на пиксель результата
+            const __m128i lo16 = _mm_unpacklo_epi8(hit8, hit8);
+            const __m128i hi16 = _mm_unpackhi_epi8(hit8, hit8);
+            const __m128i hits[4] = {_mm_unpacklo_epi16(lo16, lo16), _mm_unpackhi_epi16(lo16, lo16),
+                                     _mm_unpacklo_epi16(hi16, hi16), _mm_unpackhi_epi16(hi16, hi16)};
+            for (int i = 0; i < 4; ++i) {
+                __m128i *dst = reinterpret_cast<__m128i*>(resultRow + x + i * 4);
+                _mm_storeu_si128(dst, _mm_or_si128(_mm_loadu_si128(dst), hits[i]));
+            }
+        }
+
+        for (; x < curr.width; ++x) {
+            if (qAbs(int(currRow[x]) - int(prevRow[x])) > threshold) resultRow[x] = 0xFFFFFFFF;
+        }
+    }
+}
+
+void thresholdColorBgraSse2(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                            int threshold, uchar *writtenMask, qsizetype maskStride)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i third = _mm_set1_epi32(21846);    // x / 3 == (x * 21846) >> 16 для x <= 765
+    const __m128i limit = _mm_set1_epi32(threshold);
+
+    auto gray = [&](__m128i p) {
+        const __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(p, byteMask),
+                                                        _mm_and_si128(_mm_srli_epi32(p, 8), byteMask)),
+                                          _mm_and_si128(_mm_srli_epi32(p, 16), byteMask));
+        return _mm_mulhi_epu16(sum, third);     // Старшие 16 бит lane - нули
+    };
+
+    for (int y = 0; y < curr.height; ++y) {
+        const QRgb *prevRow = reinterpret_cast<const QRgb*>(prev.row(y));
+        const QRgb *currRow = reinterpret_cast<const QRgb*>(curr.row(y));
+        QRgb *resultRow = result.row(y);
+        uchar *maskRow = writtenMask ? writtenMask + qsizetype(y) * maskStride : nullptr;
+        int x = 0;
+
+        for (; x + 4 <= curr.width; x += 4) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x));
+            const __m128i ga = gray(a);
+            const __m128i gb = gray(b);
+            const __m128i diff = _mm_max_epi16(_mm_sub_epi16(ga, gb), _mm_sub_epi16(gb, ga));
+
+            const __m128i hit = _mm_andnot_si128(_mm_cmpeq_epi32(a, b), _mm_cmpgt_epi32(diff, limit));
+            const int bits = _mm_movemask_ps(_mm_castsi128_ps(hit));
+            if (bits == 0) continue;
+
+            __m128i *dst = reinterpret_cast<__m128i*>(resultRow + x);
+            _mm_storeu_si128(dst, _mm_or_si128(_mm_and_si128(hit, b), _mm_andnot_si128(hit, _mm_loadu_si128(dst))));
+            if (maskRow) {
+                for (int i = 0; i < 4; ++i) {
+                    if (bits & (1 << i)) maskRow[x + i] = 0xFF;
+                }
+            }
+        }
+
+        for (; x < curr.width; ++x) {
+            const QRgb p = prevRow[x], c = currRow[x];
+            if (p == c) continue;
+            const int prevGray = (qRed(p) + qGreen(p) + qBlue(p)) / 3;
+            const int currGray = (qRed(c) + qGreen(c) + qBlue(c)) / 3;
+            if (qAbs(currGray - prevGray) > threshold) {
+                resultRow[x] = c;
+                if (maskRow) maskRow[x] = 0xFF;
+            }
+        }
+    }
+}
+#endif
+
+//---------Градиент (MethodGradient)---------//
+// Окно из трех строк яркости на кадр; строка хранится с повтором крайних пикселей
+// (line[0] = line[1], line[width + 1] = line[width]), чтобы у оператора Собеля не было ветвлений на краях
+
+#ifdef BLENDKERNELS_SSE2
+// qGray = (11R + 16G + 5B) / 32 для 16 пикселей BGRA8; возвращает число посчитанных пикселей
+int lumaRowBgraSse2(const uchar *row, int width, uchar *out)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i weightR = _mm_set1_epi32(11);
+    const __m128i weightG = _mm_set1_epi32(16);
+    const __m128i weightB = _mm_set1_epi32(5);
+
+    auto luma4 = [&](const uchar *p) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i b = _mm_and_si128(px, byteMask);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), byteMask);
+        const __m128i r = _mm_and_si128(_mm_srli_epi32(px, 16), byteMask);
+        // Произведения и сумма меньше 2^16 - хватает младшей половины lane
+        const __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, weightR), _mm_mullo_epi16(g, weightG)),
+                                          _mm_mullo_epi16(b, weightB));
+        return _mm_srli_epi32(sum, 5);
+    };
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uchar *p = row + qsizetype(x) * 4;
+        const __m128i lo = _mm_packs_epi32(luma4(p), luma4(p + 16));
+        const __m128i hi = _mm_packs_epi32(luma4(p + 32), luma4(p + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+inline __m128i loadLuma8(const uchar *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+inline __m128i abs16(__m128i v)
+{
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// Модуль градиента 8 пикселей начиная с x; строки - с повтором краев (пиксель x лежит в line[x + 1])
+inline __m128i sobel8(const uchar *const lines[3], int x)
+{
+    const __m128i ul = loadLuma8(lines[0] + x), uc = loadLuma8(lines[0] + x + 1), ur = loadLuma8(lines[0] + x + 2);
+    const __m128i ml = loadLuma8(lines[1] + x),                                   mr = loadLuma8(lines[1] + x + 2);
+    const __m128i dl = loadLuma8(lines[2] + x), dc = loadLuma8(lines[2] + x + 1), dr = loadLuma8(lines[2] + x + 2);
+
+    const __m128i gx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(ur, dr), _mm_slli_epi16(mr, 1)),
+                                     _mm_add_epi16(_mm_add_epi16(ul, dl), _mm_slli_epi16(ml, 1)));
+    const __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(dl, dr), _mm_slli_epi16(dc, 1)),
+                                     _mm_add_epi16(_mm_add_epi16(ul, ur), _mm_slli_epi16(uc, 1)));
+    return _mm_srli_epi16(_mm_add_epi16(abs16(gx), abs16(gy)), 3);
+}
+#endif
+
+template <FramePixelFormat Format>
+void lumaRow(const uchar *row, int width, uchar *line, bool simd)
+{
+    Q_UNUSED(simd);
+    uchar *out = line + 1;
+    int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+    if constexpr (Format == FramePixelFormat::BGRA8) {
+        if (simd) x = lumaRowBgraSse2(row, width, out);
+    }
+#endif
+
+    if constexpr (Format == FramePixelFormat::Gray8) {
+        memcpy(out, row, size_t(width));
+    } else {
+        for (; x < width; ++x) {
+            out[x] = uchar(loadGray<Format>(row, x));
+        }
+    }
+
+    line[0] = out[0];
+    out[width] = out[width - 1];
+}
+
+inline int sobelMagnitude(const uchar *const lines[3], int x)
+{
+    const uchar *up = lines[0] + x + 1, *mid = lines[1] + x + 1, *down = lines[2] + x + 1;
+    const int gx = (up[1] + 2 * mid[1] + down[1]) - (up[-1] + 2 * mid[-1] + down[-1]);
+    const int gy = (down[-1] + 2 * down[0] + down[1]) - (up[-1] + 2 * up[0] + up[1]);
+    return (qAbs(gx) + qAbs(gy)) >> 3;      // |gx| + |gy| <= 2040
+}
+
+void gradientDiffRow(const uchar *const prevLines[3], const uchar *const currLines[3], int width, int threshold,
+                     QRgb *resultRow, bool simd)
+{
+    int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+    if (simd) {
+        const __m128i limit = _mm_set1_epi16(short(threshold));
+        for (; x + 8 <= width; x += 8) {
+            const __m128i a = sobel8(prevLines, x);
+            const __m128i b = sobel8(currLines, x);
+            const __m128i hit = _mm_cmpgt_epi16(abs16(_mm_sub_epi16(b, a)), limit);
+            if (_mm_movemask_epi8(hit) == 0) continue;
+
+            __m128i *dst = reinterpret_cast<__m128i*>(resultRow + x);
+            _mm_storeu_si128(dst, _mm_or_si128(_mm_loadu_si128(dst), _mm_unpacklo_epi16(hit, hit)));
+            _mm_storeu_si128(dst + 1, _mm_or_si128(_mm_loadu_si128(dst + 1), _mm_unpackhi_epi16(hit, hit)));
+        }
+    }
+#else
+    Q_UNUSED(simd);
+#endif
+
+    for (; x < width; ++x) {
+        if (qAbs(sobelMagnitude(currLines, x) - sobelMagnitude(prevLines, x)) > threshold) {
+            resultRow[x] = 0xFFFFFFFF;
+        }
+    }
+}
+
+// Тот же оператор по float-яркости 16-битных кадров (шкала 0..1)
+template <FramePixelFormat Format>
+void wideGradientDiff(const MutableFloatFrameView &result, const FrameView &prev, const FrameView &curr,
+                      float threshold)
+{
+    const int width = curr.width;
+    const qsizetype padded = width + 2;
+    std::vector<float> lines(size_t(6 * padded));
+
+    auto line = [&](int frame, int y) { return lines.data() + (frame * 3 + y % 3) * padded; };
+    auto load = [&](int y) {
+        for (int frame = 0; frame < 2; ++frame) {
+            const uchar *row = (frame == 0 ? prev : curr).row(y);
+            float *out = line(frame, y) + 1;
+            for (int x = 0; x < width; ++x) {
+                out[x] = weightedRgb(loadWide<Format>(row, x), 11.0f / 32, 16.0f / 32, 5.0f / 32);
+            }
+            out[-1] = out[0];
+            out[width] = out[width - 1];
+        }
+    };
+    auto magnitude = [](const float *up, const float *mid, const float *down) {
+        const float gx = (up[1] + 2 * mid[1] + down[1]) - (up[-1] + 2 * mid[-1] + down[-1]);
+        const float gy = (down[-1] + 2 * down[0] + down[1]) - (up[-1] + 2 * up[0] + up[1]);
+        return (std::fabs(gx) + std::fabs(gy)) * 0.125f;
+    };
+
+    const Float4 white = splat4(1.0f);
+    int loaded = -1;
+
+    for (int y = 0; y < curr.height; ++y) {
+        const int up = qMax(0, y - 1), down = qMin(curr.height - 1, y + 1);
+        while (loaded < down) load(++loaded);
+
+        float *resultRow = result.row(y);
+
+        for (int x = 0; x < width; ++x) {
+            const int i = x + 1;
+            const float a = magnitude(line(0, up) + i, line(0, y) + i, line(0, down) + i);
+            const float b = magnitude(line(1, up) + i, line(1, y) + i, line(1, down) + i);
+            if (std::fabs(b - a) > threshold) storeFloat4(resultRow + x * 4, white);
+        }
+    }
+}
+
+//---------Цветовое отличие (MethodPerceptual)---------//
+
+// sRGB (D65) -> Lab в целых числах. t = X/Xn и т.д. квантуется на labScale (белый - ровно labScale),
+// f(t) хранится в fixed point с шагом 1/labFScale. Вклады канала в X, Y, Z упакованы в одно 64-битное
+// слово по labFieldBits бит: три поиска и два сложения дают все три суммы (переноса между полями нет)
+constexpr int labScale = 16383;
+constexpr int labFScale = 8192;
+constexpr int labFieldBits = 21;
+constexpr quint64 labFieldMask = (quint64(1) << labFieldBits) - 1;
+
+struct LabTables {
+    quint64 xyz[3][256];                // [R, G, B][значение канала]: вклады в X | Y << 21 | Z << 42
+    quint16 f[labScale + 4];            // Сумма округленных вкладов может превысить labScale на 2
+};
+
+inline double srgbToLinear(double v)
+{
+    return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+}
+
+inline double labF(double t)
+{
+    return t > 216.0 / 24389.0 ? std::cbrt(t) : t * (24389.0 / 27.0) / 116.0 + 16.0 / 116.0;
+}
+
+// Матрица sRGB -> XYZ, строки нормированы на белую точку D65
+constexpr double labMatrix[3][3] = {
+    {0.4124564 / 0.95047, 0.3575761 / 0.95047, 0.1804375 / 0.95047},
+    {0.2126729,           0.7151522,           0.0721750},
+    {0.0193339 / 1.08883, 0.1191920 / 1.08883, 0.9503041 / 1.08883}
+};
+
+const LabTables &labTables()
+{
+    static const LabTables tables = []() {
+        LabTables t;
+        for (int v = 0; v < 256; ++v) {
+            const double linear = srgbToLinear(v / 255.0);
+            for (int channel = 0; channel < 3; ++channel) {
+                t.xyz[channel][v] = 0;
+                for (int row = 0; row < 3; ++row) {
+                    const quint64 part = quint64(qRound(linear * labMatrix[row][channel] * labScale));
+                    t.xyz[channel][v] |= part << (row * labFieldBits);
+                }
+            }
+        }
+        for (int i = 0; i < labScale + 4; ++i) {
+            t.f[i] = quint16(qRound(labF(double(i) / labScale) * labFScale));
+        }
+        return t;
+    }();
+    return tables;
+}
+
+struct LabFixed {
+    int l, a, b;    // L + 16, a, b в единицах 1/labFScale
+};
+
+inline LabFixed toLab(const LabTables &t, QRgb pixel)
+{
+    const quint64 sum = t.xyz[0][qRed(pixel)] + t.xyz[1][qGreen(pixel)] + t.xyz[2][qBlue(pixel)];
+    const int fx = t.f[sum & labFieldMask];
+    const int fy = t.f[(sum >> labFieldBits) & labFieldMask];
+    const int fz = t.f[sum >> (2 * labFieldBits)];
+    return {116 * fy, 500 * (fx - fy), 200 * (fy - fz)};
+}
+
+// limit - квадрат порога в единицах 1/labFScale
+inline bool perceptualChanged(const LabTables &t, QRgb prevPixel, QRgb currPixel, qint64 limit)
+{
+    const LabFixed a = toLab(t, prevPixel);
+    const LabFixed b = toLab(t, currPixel);
+    const qint64 dl = b.l - a.l, da = b.a - a.a, db = b.b - a.b;
+    return dl * dl + da * da + db * db > limit;
+}
+
+inline void markPerceptual(QRgb *resultRow, uchar *maskRow, int x, QRgb currPixel)
+{
+    resultRow[x] = currPixel;
+    if (maskRow) {
+        maskRow[x] = 0xFF;
+    }
+}
+
+#ifdef BLENDKERNELS_SSE2
+// Экран меняется малыми областями: группы по 8 совпадающих пикселей отсекаются сравнением,
+// Lab считается только для отличающихся
+void perceptualBgraSse2(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                        qint64 limit, uchar *writtenMask, qsizetype maskStride)
+{
+    const LabTables &tables = labTables();
+
+    for (int y = 0; y < curr.height; ++y) {
+        const QRgb *prevRow = reinterpret_cast<const QRgb*>(prev.row(y));
+        const QRgb *currRow = reinterpret_cast<const QRgb*>(curr.row(y));
+        QRgb *resultRow = result.row(y);
+        uchar *maskRow = writtenMask ? writtenMask + qsizetype(y) * maskStride : nullptr;
+        int x = 0;
+
+        for (; x + 8 <= curr.width; x += 8) {
+            const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x));
+            const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x + 4));
+            const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x));
+            const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x + 4));
+
+            const int same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a0, b0)))
+                             | (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a1, b1))) << 4);
+
+            for (unsigned changed = ~unsigned(same) & 0xFF; changed; changed &= changed - 1) {
+                const int i = x + std::countr_zero(changed);
+                if (perceptualChanged(tables, prevRow[i], currRow[i], limit)) {
+                    markPerceptual(resultRow, maskRow, i, currRow[i]);
+                }
+            }
+        }
+
+        for (; x < curr.width; ++x) {
+            if (prevRow[x] != currRow[x] && perceptualChanged(tables, prevRow[x], currRow[x], limit)) {
+                markPerceptual(resultRow, maskRow, x, currRow[x]);
+            }
+        }
+    }
+}
+#endif
+
+// Точный dE для 16-битных кадров (значения 0..1, выше 1 - HDR)
+inline float perceptualDistance(Float4 prev, Float4 curr)
+{
+    auto lab = [](Float4 p, double out[3]) {
+        const double linear[3] = {srgbToLinear(qMax(0.0f, weightedRgb(p, 1.0f, 0.0f, 0.0f))),
+                                  srgbToLinear(qMax(0.0f, weightedRgb(p, 0.0f, 1.0f, 0.0f))),
+                                  srgbToLinear(qMax(0.0f, weightedRgb(p, 0.0f, 0.0f, 1.0f)))};
+        double f[3];
+        for (int row = 0; row < 3; ++row) {
+            f[row] = labF(labMatrix[row][0] * linear[0] + labMatrix[row][1] * linear[1]
+                          + labMatrix[row][2] * linear[2]);
+        }
+        out[0] = 116.0 * f[1];
+        out[1] = 500.0 * (f[0] - f[1]);
+        out[2] = 200.0 * (f[1] - f[2]);
+    };
+
+    double a[3], b[3];
+    lab(prev, a);
+    lab(curr, b);
+    return float(std::sqrt((b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1])
+                           + (b[2] - a[2]) * (b[2] - a[2])));
+}
+
+//---------Длинная выдержка---------//
+
+// Сколько кадров пикселя принимается без отсечения: по меньшему числу сигма ненадежна
+constexpr quint32 stackClipMinFrames = 4;
+// Предел счетчика при отсечении: суммы квадратов меньше 2^31 и переводятся в float как int32
+constexpr quint32 stackClipMaxCount = 0x7FFF;
+
+struct StackRow {
+    quint32 *sums[3];
+    quint32 *squares[3];
+    quint16 *counts;
+};
+
+inline StackRow stackRow(const StackView &stack, int y)
+{
+    StackRow row;
+    const qsizetype offset = qsizetype(y) * stack.stride;
+    for (int c = 0; c < 3; ++c) {
+        row.sums[c] = stack.sums[c] + offset;
+        row.squares[c] = stack.squares[c] ? stack.squares[c] + offset : nullptr;
+    }
+    row.counts = stack.counts ? stack.counts + qsizetype(y) * stack.countsStride : nullptr;
+    return row;
+}
+
+} // namespace
+
+
+BlendKernels::PairKernel BlendKernels::pairKernel(int method)
+{
+    switch (method) {
+        case BlendMethods::MethodV3:            return KernelThresholdChannels;
+        case BlendMethods::MethodV4:            return KernelThresholdGray;
+        case BlendMethods::MethodV4Fast:        return KernelThresholdColor;
+        case BlendMethods::MethodGradient:      return KernelGradient;
+        case BlendMethods::MethodPerceptual:    return KernelPerceptual;
+        default:                                return KernelMaxDiff;
+    }
+}
+
+bool BlendKernels::simdAvailable()
+{
+#ifdef BLENDKERNELS_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+void BlendKernels::selectVariant(PairKernel kernel, KernelVariant variant)
+{
+    if (kernel < 0 || kernel >= PairKernelCount || variant == KernelVariant::Selected) return;
+    if (variant == KernelVariant::Simd && !simdAvailable()) variant = KernelVariant::Scalar;
+
+    s_variants[kernel].store(variant, std::memory_order_relaxed);
+}
+
+BlendKernels::KernelVariant BlendKernels::selectedVariant(PairKernel kernel)
+{
+    return s_variants[qBound(0, int(kernel), PairKernelCount - 1)].load(std::memory_order_relaxed);
+}
+
+bool BlendKernels::accumulateMaxDiff(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                                     KernelVariant variant)
+{
+    PIPELINE_TRACE_SCOPE("accumulateMaxDiff");
+    if (!compatible(result, prev, curr)) return false;
+
+#ifdef BLENDKERNELS_SSE2
+    if (curr.format == FramePixelFormat::BGRA8 && useSimd(KernelMaxDiff, variant)) {
+        maxDiffBgraSse2(result, prev, curr);
+        return true;
+    }
+#endif
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            QRgb *resultRow = result.row(y);
+
+            for (int x = 0; x < curr.width; ++x) {
+                const QRgb prevPixel = loadPixel<Format>(prevRow, x);
+                const QRgb currPixel = loadPixel<Format>(currRow, x);
+                const QRgb resultPixel = resultRow[x];
+
+                const int newR = qMax(qRed(resultPixel),   qAbs(qRed(currPixel) - qRed(prevPixel)));
+                const int newG = qMax(qGreen(resultPixel), qAbs(qGreen(currPixel) - qGreen(prevPixel)));
+                const int newB = qMax(qBlue(resultPixel),  qAbs(qBlue(currPixel) - qBlue(prevPixel)));
+
+                resultRow[x] = 0xFF000000 | (newR << 16) | (newG << 8) | newB;
+            }
+        }
+    });
+}
+
+bool BlendKernels::accumulateThresholdChannels(const MutableFrameView &result, const FrameView &prev,
+                                               const FrameView &curr, int threshold, KernelVariant variant)
+{
+    PIPELINE_TRACE_SCOPE("accumulateThresholdChannels");
+    if (!compatible(result, prev, curr)) return false;
+
+#ifdef BLENDKERNELS_SSE2
+    if (curr.format == FramePixelFormat::BGRA8 && useSimd(KernelThresholdChannels, variant)) {
+        thresholdChannelsBgraSse2(result, prev, curr, threshold);
+        return true;
+    }
+#endif
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            QRgb *resultRow = result.row(y);
+
+            for (int x = 0; x < curr.width; ++x) {
+                const QRgb prevPixel = loadPixel<Format>(prevRow, x);
+                const QRgb currPixel = loadPixel<Format>(currRow, x);
+
+                // Быстрая проверка на различие
+                if (prevPixel == currPixel) {
+                    continue;
+                }
+
+                const int totalDiff = qMax(qMax(qAbs(qRed(currPixel) - qRed(prevPixel)),
+                                                qAbs(qGreen(currPixel) - qGreen(prevPixel))),
+                                           qAbs(qBlue(currPixel) - qBlue(prevPixel)));
+
+                if (totalDiff > threshold) {
+                    resultRow[x] = 0xFFFFFFFF;
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::accumulateThresholdGray(const MutableFrameView &result, const FrameView &prev,
+                                           const FrameView &curr, int threshold, KernelVariant variant)
+{
+    PIPELINE_TRACE_SCOPE("accumulateThresholdGray");
+    if (!compatible(result, prev, curr)) return false;
+
+#ifdef BLENDKERNELS_SSE2
+    if (curr.format == FramePixelFormat::Gray8 && useSimd(KernelThresholdGray, variant)) {
+        thresholdGrayGray8Sse2(result, prev, curr, threshold);
+        return true;
+    }
+#endif
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            QRgb *resultRow = result.row(y);
+
+            for (int x = 0; x < curr.width; ++x) {
+                const int prevGray = loadGray<Format>(prevRow, x);
+                const int currGray = loadGray<Format>(currRow, x);
+
+                if (prevGray == currGray) {
+                    continue;
+                }
+
+                if (qAbs(currGray - prevGray) > threshold) {
+                    resultRow[x] = 0xFFFFFFFF;
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::accumulateThresholdColor(const MutableFrameView &result, const FrameView &prev,
+                                            const FrameView &curr, int threshold,
+                                            uchar *writtenMask, qsizetype maskStride, KernelVariant variant)
+{
+    PIPELINE_TRACE_SCOPE("accumulateThresholdColor");
+    if (!compatible(result, prev, curr)) return false;
+
+#ifdef BLENDKERNELS_SSE2
+    if (curr.format == FramePixelFormat::BGRA8 && useSimd(KernelThresholdColor, variant)) {
+        thresholdColorBgraSse2(result, prev, curr, threshold, writtenMask, maskStride);
+        return true;
+    }
+#endif
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            QRgb *resultRow = result.row(y);
+            uchar *maskRow = writtenMask ? writtenMask + qsizetype(y) * maskStride : nullptr;
+
+            for (int x = 0; x < curr.width; ++x) {
+                const QRgb prevPixel = loadPixel<Format>(prevRow, x);
+                const QRgb currPixel = loadPixel<Format>(currRow, x);
+
+                if (prevPixel == currPixel) {
+                    continue;
+                }
+
+                // Приближенная яркость: Gray = (R + G + B) / 3
+                const int prevGray = (qRed(prevPixel) + qGreen(prevPixel) + qBlue(prevPixel)) / 3;
+                const int currGray = (qRed(currPixel) + qGreen(currPixel) + qBlue(currPixel)) / 3;
+
+                if (qAbs(currGray - prevGray) > threshold) {
+                    resultRow[x] = currPixel;     // Заполнение цветным
+                    if (maskRow) {
+                        maskRow[x] = 0xFF;
+                    }
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::accumulatePerceptualDiff(const MutableFrameView &result, const FrameView &prev,
+                                            const FrameView &curr, int threshold,
+                                            uchar *writtenMask, qsizetype maskStride, KernelVariant variant)
+{
+    PIPELINE_TRACE_SCOPE("accumulatePerceptualDiff");
+    if (!compatible(result, prev, curr)) return false;
+
+    // Сравнение квадратов: dE > threshold  <=>  dE^2 * labFScale^2 > (threshold * labFScale)^2
+    const qint64 scaledThreshold = qint64(qMax(0, threshold)) * labFScale;
+    const qint64 limit = scaledThreshold * scaledThreshold;
+
+#ifdef BLENDKERNELS_SSE2
+    if (curr.format == FramePixelFormat::BGRA8 && useSimd(KernelPerceptual, variant)) {
+        perceptualBgraSse2(result, prev, curr, limit, writtenMask, maskStride);
+        return true;
+    }
+#endif
+
+    const LabTables &tables = labTables();
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            QRgb *resultRow = result.row(y);
+            uchar *maskRow = writtenMask ? writtenMask + qsizetype(y) * maskStride : nullptr;
+
+            for (int x = 0; x < curr.width; ++x) {
+                const QRgb prevPixel = loadPixel<Format>(prevRow, x);
+                const QRgb currPixel = loadPixel<Format>(currRow, x);
+
+                if (prevPixel != currPixel && perceptualChanged(tables, prevPixel, currPixel, limit)) {
+                    markPerceptual(resultRow, maskRow, x, currPixel);
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::accumulateGradientDiff(const MutableFrameView &result, const FrameView &prev,
+                                          const FrameView &curr, int threshold, int contextTop,
+                                          KernelVariant variant)
+{
+    PIPELINE_TRACE_SCOPE("accumulateGradientDiff");
+    if (!result.isValid() || !compatiblePair(result.data, prev, curr) || result.width != curr.width
+        || contextTop < 0 || contextTop + result.height > curr.height) {
+        return false;
+    }
+
+    // Модуль градиента в 0..255: отрицательный порог работает как 0, от 255 - изменений нет
+    threshold = qBound(0, threshold, 255);
+    const bool simd = useSimd(KernelGradient, variant);
+
+    const int width = curr.width;
+    const qsizetype padded = width + 2;
+    std::vector<uchar> lines(size_t(6 * padded + 16));     // Запас: SSE2 читает по 8 байт
+
+    auto line = [&](int frame, int y) { return lines.data() + (frame * 3 + y % 3) * padded; };
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        auto load = [&](int y) {
+            lumaRow<Format>(prev.row(y), width, line(0, y), simd);
+            lumaRow<Format>(curr.row(y), width, line(1, y), simd);
+        };
+
+        // Строка y+1 загружается на место y-2: каждая строка кадра переводится в яркость один раз
+        int loaded = qMax(0, contextTop - 1) - 1;
+
+        for (int y = contextTop; y < contextTop + result.height; ++y) {
+            const int up = qMax(0, y - 1), down = qMin(curr.height - 1, y + 1);
+            while (loaded < down) load(++loaded);
+
+            const uchar *const prevLines[3] = {line(0, up), line(0, y), line(0, down)};
+            const uchar *const currLines[3] = {line(1, up), line(1, y), line(1, down)};
+            gradientDiffRow(prevLines, currLines, width, threshold, result.row(y - contextTop), simd);
+        }
+    });
+}
+
+bool BlendKernels::accumulateThresholdColorYuv(const MutableFrameView &result, const YuvFrameView &prev,
+                                               const YuvFrameView &curr, int threshold)
+{
+    PIPELINE_TRACE_SCOPE("accumulateThresholdColorYuv");
+    if (!result.isValid() || !prev.isValid() || !curr.isValid() || prev.size() != curr.size()
+        || result.size() != curr.size()) {
+        return false;
+    }
+
+    threshold = qMax(0, threshold);
+    if (threshold >= 255) return true;
+
+    for (int y = 0; y < curr.luma.height; ++y) {
+        const uchar *prevRow = prev.luma.row(y);
+        const uchar *currRow = curr.luma.row(y);
+        QRgb *resultRow = result.row(y);
+        int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+        // 16 пикселей за итерацию: d > t  <=>  max(d, t + 1) == d; цвет - только по битам маски
+        const __m128i limit = _mm_set1_epi8(char(threshold + 1));
+
+        for (; x + 16 <= curr.luma.width; x += 16) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x));
+            const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+
+            unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(d, limit), d)));
+            while (mask) {
+                const int bit = std::countr_zero(mask);
+                resultRow[x + bit] = curr.rgbAt(x + bit, y);
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        for (; x < curr.luma.width; ++x) {
+            if (qAbs(int(currRow[x]) - int(prevRow[x])) > threshold) {
+                resultRow[x] = curr.rgbAt(x, y);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool BlendKernels::accumulate(int method, const MutableFrameView &result, const FrameView &prev,
+                              const FrameView &curr, int threshold, KernelVariant variant)
+{
+    switch (method) {
+        case BlendMethods::MethodTrail:
+        case BlendMethods::MethodV2:
+            return accumulateMaxDiff(result, prev, curr, variant);
+        case BlendMethods::MethodV3:
+            return accumulateThresholdChannels(result, prev, curr, threshold, variant);
+        case BlendMethods::MethodV4:
+            return accumulateThresholdGray(result, prev, curr, threshold, variant);
+        case BlendMethods::MethodV4Fast:
+            return accumulateThresholdColor(result, prev, curr, threshold, nullptr, 0, variant);
+        case BlendMethods::MethodGradient:
+            return accumulateGradientDiff(result, prev, curr, threshold, 0, variant);
+        case BlendMethods::MethodPerceptual:
+            return accumulatePerceptualDiff(result, prev, curr, threshold, nullptr, 0, variant);
+        default:
+            return false;   // Тепловая карта и выдержка - не накопитель пар
+    }
+}
+
+bool BlendKernels::accumulateChannelDiffMap(uchar *diffMap, qsizetype mapStride,
+                                            const FrameView &prev, const FrameView &curr,
+                                            DiffHistogram *histogram)
+{
+    PIPELINE_TRACE_SCOPE("accumulateChannelDiffMap");
+    if (!compatiblePair(diffMap, prev, curr)) return false;
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            uchar *mapRow = diffMap + qsizetype(y) * mapStride;
+            int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+            // BGRA8 и RGBA8: альфа в старшем байте пикселя, цветовые каналы - в трех младших
+            if constexpr (Format != FramePixelFormat::Gray8) {
+                const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+                const __m128i lowByte = _mm_set1_epi32(0xFF);
+
+                for (; x + 4 <= curr.width; x += 4) {
+                    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x * 4));
+                    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x * 4));
+
+                    // |a - b| по байтам, альфа не учитывается
+                    __m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+                    diff = _mm_and_si128(diff, colorMask);
+
+                    // Максимум трех младших байт пикселя - в младший байт
+                    diff = _mm_max_epu8(diff, _mm_srli_epi32(diff, 8));
+                    diff = _mm_max_epu8(diff, _mm_srli_epi32(diff, 16));
+                    diff = _mm_and_si128(diff, lowByte);
+
+                    // 4 значения по 32 бита -> 4 байта
+                    diff = _mm_packs_epi32(diff, diff);
+                    diff = _mm_packus_epi16(diff, diff);
+
+                    if (histogram) {
+                        histogram->add4(quint32(_mm_cvtsi128_si32(diff)));
+                    }
+
+                    qint32 packed;
+                    memcpy(&packed, mapRow + x, sizeof(packed));
+                    packed = _mm_cvtsi128_si32(_mm_max_epu8(diff, _mm_cvtsi32_si128(packed)));
+                    memcpy(mapRow + x, &packed, sizeof(packed));
+                }
+            }
+#endif
+
+            for (; x < curr.width; ++x) {
+                const QRgb prevPixel = loadPixel<Format>(prevRow, x);
+                const QRgb currPixel = loadPixel<Format>(currRow, x);
+
+                const int totalDiff = qMax(qMax(qAbs(qRed(currPixel) - qRed(prevPixel)),
+                                                qAbs(qGreen(currPixel) - qGreen(prevPixel))),
+                                           qAbs(qBlue(currPixel) - qBlue(prevPixel)));
+
+                if (histogram) {
+                    histogram->add(x, totalDiff);
+                }
+                if (totalDiff > mapRow[x]) {
+                    mapRow[x] = uchar(totalDiff);
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::accumulateGrayDiffMap(uchar *diffMap, qsizetype mapStride,
+                                         const FrameView &prev, const FrameView &curr,
+                                         DiffHistogram *histogram)
+{
+    PIPELINE_TRACE_SCOPE("accumulateGrayDiffMap");
+    if (!compatiblePair(diffMap, prev, curr)) return false;
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            uchar *mapRow = diffMap + qsizetype(y) * mapStride;
+            int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+            if constexpr (Format == FramePixelFormat::Gray8) {
+                for (; x + 16 <= curr.width; x += 16) {
+                    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x));
+                    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x));
+                    const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mapRow + x));
+                    const __m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(mapRow + x), _mm_max_epu8(m, diff));
+
+                    if (histogram) {
+                        alignas(16) quint32 packed[4];
+                        _mm_store_si128(reinterpret_cast<__m128i*>(packed), diff);
+                        for (quint32 value : packed) {
+                            histogram->add4(value);
+                        }
+                    }
+                }
+            }
+#endif
+
+            for (; x < curr.width; ++x) {
+                const int diff = qAbs(loadGray<Format>(currRow, x) - loadGray<Format>(prevRow, x));
+                if (histogram) {
+                    histogram->add(x, diff);
+                }
+                if (diff > mapRow[x]) {
+                    mapRow[x] = uchar(diff);
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::averageDiffLevels(uchar *levels, qsizetype levelsStride,
+                                     const FrameView &prev, const FrameView &curr,
+                                     DiffHistogram *histogram)
+{
+    PIPELINE_TRACE_SCOPE("averageDiffLevels");
+    if (!compatiblePair(levels, prev, curr)) return false;
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            uchar *levelsRow = levels + qsizetype(y) * levelsStride;
+
+            for (int x = 0; x < curr.width; ++x) {
+                const QRgb prevPixel = loadPixel<Format>(prevRow, x);
+                const QRgb currPixel = loadPixel<Format>(currRow, x);
+
+                if (prevPixel == currPixel) {
+                    levelsRow[x] = 0;
+                } else {
+                    // Та же приближенная яркость, что и в accumulateThresholdColor
+                    const int prevGray = (qRed(prevPixel) + qGreen(prevPixel) + qBlue(prevPixel)) / 3;
+                    const int currGray = (qRed(currPixel) + qGreen(currPixel) + qBlue(currPixel)) / 3;
+                    levelsRow[x] = uchar(qAbs(currGray - prevGray));
+                }
+            }
+
+            // Отдельным проходом по готовой строке, по 4 разности за раз
+            if (histogram) {
+                int x = 0;
+                for (; x + 4 <= curr.width; x += 4) {
+                    quint32 packed;
+                    memcpy(&packed, levelsRow + x, sizeof(packed));
+                    histogram->add4(packed);
+                }
+                for (; x < curr.width; ++x) {
+                    histogram->add(x, levelsRow[x]);
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::applyThreshold(const MutableFrameView &result, const uchar *diffMap, qsizetype mapStride,
+                                  int threshold)
+{
+    PIPELINE_TRACE_SCOPE("applyThreshold");
+    if (!result.isValid() || !diffMap) return false;
+
+    // Разность не бывает отрицательной: порог ниже 0 ведет себя как 0
+    threshold = qBound(0, threshold, 255);
+    if (threshold == 255) {
+        fill(result, 0xFF000000);
+        return true;
+    }
+
+    for (int y = 0; y < result.height; ++y) {
+        const uchar *mapRow = diffMap + qsizetype(y) * mapStride;
+        QRgb *resultRow = result.row(y);
+        int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+        // 16 пикселей за итерацию: d > t  <=>  max(d, t + 1) == d
+        const __m128i limit = _mm_set1_epi8(char(threshold + 1));
+        const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+
+        for (; x + 16 <= result.width; x += 16) {
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mapRow + x));
+            const __m128i m = _mm_cmpeq_epi8(_mm_max_epu8(d, limit), d);
+
+            // Байт маски -> 32-битный пиксель (черный или белый)
+            const __m128i lo = _mm_unpacklo_epi8(m, m);
+            const __m128i hi = _mm_unpackhi_epi8(m, m);
+            __m128i *out = reinterpret_cast<__m128i*>(resultRow + x);
+            _mm_storeu_si128(out + 0, _mm_or_si128(_mm_unpacklo_epi16(lo, lo), alpha));
+            _mm_storeu_si128(out + 1, _mm_or_si128(_mm_unpackhi_epi16(lo, lo), alpha));
+            _mm_storeu_si128(out + 2, _mm_or_si128(_mm_unpacklo_epi16(hi, hi), alpha));
+            _mm_storeu_si128(out + 3, _mm_or_si128(_mm_unpackhi_epi16(hi, hi), alpha));
+        }
+#endif
+
+        for (; x < result.width; ++x) {
+            resultRow[x] = mapRow[x] > threshold ? 0xFFFFFFFF : 0xFF000000;
+        }
+    }
+
+    return true;
+}
+
+bool BlendKernels::countThresholdCrossings(quint16 *counts, qsizetype countsStride,
+                                           const FrameView &prev, const FrameView &curr, int threshold)
+{
+    PIPELINE_TRACE_SCOPE("countThresholdCrossings");
+    if (!counts || !prev.isValid() || !curr.isValid() || prev.format != curr.format || prev.size() != curr.size()) {
+        return false;
+    }
+
+    // Разность не бывает больше 255: такой порог не пересекается
+    threshold = qMax(0, threshold);
+    if (threshold >= 255) return true;
+
+    return dispatchFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < curr.height; ++y) {
+            const uchar *prevRow = prev.row(y);
+            const uchar *currRow = curr.row(y);
+            quint16 *countRow = counts + qsizetype(y) * countsStride;
+            int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+            const __m128i one = _mm_set1_epi16(1);
+
+            if constexpr (Format == FramePixelFormat::Gray8) {
+                // 16 пикселей за итерацию: d > t  <=>  max(d, t + 1) == d
+                const __m128i limit = _mm_set1_epi8(char(threshold + 1));
+
+                for (; x + 16 <= curr.width; x += 16) {
+                    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevRow + x));
+                    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currRow + x));
+                    const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+                    const __m128i m = _mm_cmpeq_epi8(_mm_max_epu8(d, limit), d);
+
+                    // Байт маски -> 16-битная единица, насыщающее сложение
+                    __m128i *out = reinterpret_cast<__m128i*>(countRow + x);
+                    const __m128i lo = _mm_and_si128(_mm_unpacklo_epi8(m, m), one);
+                    const __m128i hi = _mm_and_si128(_mm_unpackhi_epi8(m, m), one);
+                    _mm_storeu_si128(out + 0, _mm_adds_epu16(_mm_loadu_si128(out + 0), lo));
+                    _mm_storeu_si128(out + 1, _mm_adds_epu16(_mm_loadu_si128(out + 1), hi));
+                }
+            } else {
+                // 8 пикселей за итерацию, альфа не учитывается
+                const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+                const __m128i lowByte = _mm_set1_epi32(0xFF);
+                const __m128i limit = _mm_set1_epi32(threshold);
+
+                auto crossed = [&](const uchar *prevPixels, const uchar *currPixels) {
+                    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prevPixels));
+                    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(currPixels));
+
+                    __m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+                    diff = _mm_and_si128(diff, colorMask);
+                    diff = _mm_max_epu8(diff, _mm_srli_epi32(diff, 8));
+                    diff = _mm_max_epu8(diff, _mm_srli_epi32(diff, 16));
+                    diff = _mm_and_si128(diff, lowByte);
+
+                    return _mm_cmpgt_epi32(diff, limit);
+                };
+
+                for (; x + 8 <= curr.width; x += 8) {
+                    const __m128i m0 = crossed(prevRow + x * 4, currRow + x * 4);
+                    const __m128i m1 = crossed(prevRow + x * 4 + 16, currRow + x * 4 + 16);
+
+                    // Маски 8 пикселей -> 8 единиц по 16 бит
+                    const __m128i inc = _mm_and_si128(_mm_packs_epi32(m0, m1), one);
+                    __m128i *out = reinterpret_cast<__m128i*>(countRow + x);
+                    _mm_storeu_si128(out, _mm_adds_epu16(_mm_loadu_si128(out), inc));
+                }
+            }
+#endif
+
+            for (; x < curr.width; ++x) {
+                const QRgb prevPixel = loadPixel<Format>(prevRow, x);
+                const QRgb currPixel = loadPixel<Format>(currRow, x);
+
+                const int totalDiff = qMax(qMax(qAbs(qRed(currPixel) - qRed(prevPixel)),
+                                                qAbs(qGreen(currPixel) - qGreen(prevPixel))),
+                                           qAbs(qBlue(currPixel) - qBlue(prevPixel)));
+
+                if (totalDiff > threshold && countRow[x] != 0xFFFF) {
+                    ++countRow[x];
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::addToStack(const StackView &stack, const FrameView &frame, const uchar *mask,
+                              qsizetype maskStride)
+{
+    PIPELINE_TRACE_SCOPE("addToStack");
+    if (!stack.isValid() || !frame.isValid() || stack.size() != frame.size() || (mask && !stack.counts)) {
+        return false;
+    }
+
+    return dispatchFormat(frame.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < frame.height; ++y) {
+            const uchar *frameRow = frame.row(y);
+            const uchar *maskRow = mask ? mask + qsizetype(y) * maskStride : nullptr;
+            const StackRow row = stackRow(stack, y);
+            quint32 *red = row.sums[0];
+            quint32 *green = row.sums[1];
+            quint32 *blue = row.sums[2];
+            int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+            if constexpr (Format == FramePixelFormat::BGRA8) {
+                const __m128i lowByte = _mm_set1_epi32(0xFF);
+                const __m128i allOnes = _mm_set1_epi32(-1);
+                const __m128i one = _mm_set1_epi16(1);
+
+                auto addLanes = [](quint32 *sum, __m128i value) {
+                    __m128i *p = reinterpret_cast<__m128i*>(sum);
+                    _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), value));
+                };
+                // 4 пикселя: канал -> 32 бит сдвигом и маской, keep обнуляет пропущенные пиксели
+                auto add4 = [&](int at, __m128i keep) {
+                    const __m128i p = _mm_and_si128(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(frameRow + at * 4)), keep);
+                    addLanes(blue + at, _mm_and_si128(p, lowByte));
+                    addLanes(green + at, _mm_and_si128(_mm_srli_epi32(p, 8), lowByte));
+                    addLanes(red + at, _mm_and_si128(_mm_srli_epi32(p, 16), lowByte));
+                };
+
+                // 8 пикселей за итерацию: 8 байт маски -> 8 счетчиков по 16 бит и две маски по 4 пикселя
+                for (; x + 8 <= frame.width; x += 8) {
+                    __m128i keep16 = allOnes;
+                    if (maskRow) {
+                        const __m128i m = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(maskRow + x));
+                        const __m128i keep8 = _mm_xor_si128(_mm_cmpeq_epi8(m, _mm_setzero_si128()), allOnes);
+                        keep16 = _mm_unpacklo_epi8(keep8, keep8);
+                    }
+
+                    add4(x, _mm_unpacklo_epi16(keep16, keep16));
+                    add4(x + 4, _mm_unpackhi_epi16(keep16, keep16));
+
+                    if (row.counts) {
+                        __m128i *out = reinterpret_cast<__m128i*>(row.counts + x);
+                        _mm_storeu_si128(out, _mm_adds_epu16(_mm_loadu_si128(out), _mm_and_si128(keep16, one)));
+                    }
+                }
+            }
+#endif
+
+            for (; x < frame.width; ++x) {
+                if (maskRow && !maskRow[x]) continue;
+
+                const QRgb pixel = loadPixel<Format>(frameRow, x);
+                red[x] += quint32(qRed(pixel));
+                green[x] += quint32(qGreen(pixel));
+                blue[x] += quint32(qBlue(pixel));
+
+                if (row.counts && row.counts[x] != 0xFFFF) {
+                    ++row.counts[x];
+                }
+            }
+        }
+    });
+}
+
+bool BlendKernels::addToStackClipped(const StackView &stack, const FrameView &frame, float kappa, float minSigma,
+                                     const uchar *mask, qsizetype maskStride)
+{
+    PIPELINE_TRACE_SCOPE("addToStackClipped");
+    if (!stack.isValid() || !stack.hasSquares() || !stack.counts || !frame.isValid()
+        || stack.size() != frame.size()) {
+        return false;
+    }
+
+    // Сравниваются квадраты: (v - mean)^2 > kappa^2 * max(var, minSigma^2), без корня
+    const float kappaSquared = kappa * kappa;
+    const float minVariance = minSigma * minSigma;
+
+    return dispatchFormat(frame.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        for (int y = 0; y < frame.height; ++y) {
+            const uchar *frameRow = frame.row(y);
+            const uchar *maskRow = mask ? mask + qsizetype(y) * maskStride : nullptr;
+            const StackRow row = stackRow(stack, y);
+            int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+            if constexpr (Format == FramePixelFormat::BGRA8) {
+                const __m128i lowByte = _mm_set1_epi32(0xFF);
+                const __m128i minFrames = _mm_set1_epi32(int(stackClipMinFrames));
+                const __m128i maxCount = _mm_set1_epi32(int(stackClipMaxCount) - 1);
+                const __m128i one = _mm_set1_epi16(1);
+                const __m128 oneF = _mm_set1_ps(1.0f);
+                const __m128 kappa2 = _mm_set1_ps(kappaSquared);
+                const __m128 minVar = _mm_set1_ps(minVariance);
+
+                // 4 пикселя за итерацию; решение по каналам - те же операции float, что в скалярном хвосте
+                for (; x + 4 <= frame.width; x += 4) {
+                    const __m128i counts = _mm_unpacklo_epi16(
+                        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row.counts + x)), _mm_setzero_si128());
+                    const __m128 rcp = _mm_div_ps(oneF, _mm_max_ps(_mm_cvtepi32_ps(counts), oneF));
+                    const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frameRow + x * 4));
+
+                    __m128i value[3];
+                    value[0] = _mm_and_si128(_mm_srli_epi32(p, 16), lowByte);
+                    value[1] = _mm_and_si128(_mm_srli_epi32(p, 8), lowByte);
+                    value[2] = _mm_and_si128(p, lowByte);
+
+                    __m128 outlier = _mm_setzero_ps();
+                    for (int c = 0; c < 3; ++c) {
+                        const __m128 sum = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.sums[c] + x)));
+                        const __m128 square = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row.squares[c] + x)));
+                        const __m128 mean = _mm_mul_ps(sum, rcp);
+                        const __m128 variance = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(square, rcp), _mm_mul_ps(mean, mean)), minVar);
+                        const __m128 d = _mm_sub_ps(_mm_cvtepi32_ps(value[c]), mean);
+                        outlier = _mm_or_ps(outlier, _mm_cmpgt_ps(_mm_mul_ps(d, d), _mm_mul_ps(kappa2, variance)));
+                    }
+
+                    // Принимается: есть место в счетчике и (мало кадров или не выброс)
+                    __m128i accept = _mm_andnot_si128(_mm_castps_si128(outlier), _mm_set1_epi32(-1));
+                    accept = _mm_or_si128(accept, _mm_cmpgt_epi32(minFrames, counts));
+                    accept = _mm_andnot_si128(_mm_cmpgt_epi32(counts, maxCount), accept);
+                    if (maskRow) {
+                        const __m128i m = _mm_cvtsi32_si128(int(maskRow[x] | maskRow[x + 1] << 8
+                                                                | maskRow[x + 2] << 16 | quint32(maskRow[x + 3]) << 24));
+                        const __m128i m16 = _mm_unpacklo_epi8(m, m);
+                        accept = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_unpacklo_epi16(m16, m16), _mm_setzero_si128()),
+                                                  accept);
+                    }
+
+                    for (int c = 0; c < 3; ++c) {
+                        const __m128i v = _mm_and_si128(value[c], accept);
+                        __m128i *sum = reinterpret_cast<__m128i*>(row.sums[c] + x);
+                        __m128i *square = reinterpret_cast<__m128i*>(row.squares[c] + x);
+                        _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), v));
+                        // v <= 255: квадрат помещается в младшие 16 бит 32-битной полосы
+                        _mm_storeu_si128(square, _mm_add_epi32(_mm_loadu_si128(square), _mm_mullo_epi16(v, v)));
+                    }
+
+                    const __m128i inc = _mm_and_si128(_mm_packs_epi32(accept, accept), one);
+                    __m128i *out = reinterpret_cast<__m128i*>(row.counts + x);
+                    _mm_storel_epi64(out, _mm_add_epi16(_mm_loadl_epi64(out), inc));
+                }
+            }
+#endif
+
+            for (; x < frame.width; ++x) {
+                // Заполненный счетчик: сумма квадратов дальше вышла бы за 2^31
+                const quint32 count = row.counts[x];
+                if ((maskRow && !maskRow[x]) || count >= stackClipMaxCount) continue;
+
+                const QRgb pixel = loadPixel<Format>(frameRow, x);
+                const quint32 value[3] = {quint32(qRed(pixel)), quint32(qGreen(pixel)), quint32(qBlue(pixel))};
+
+                if (count >= stackClipMinFrames) {
+                    const float rcp = 1.0f / float(count);
+                    bool outlier = false;
+                    for (int c = 0; c < 3 && !outlier; ++c) {
+                        const float mean = float(row.sums[c][x]) * rcp;
+                        const float variance = qMax(float(row.squares[c][x]) * rcp - mean * mean, minVariance);
+                        const float d = float(value[c]) - mean;
+                        outlier = d * d > kappaSquared * variance;
+                    }
+                    if (outlier) continue;
+                }
+
+                for (int c = 0; c < 3; ++c) {
+                    row.sums[c][x] += value[c];
+                    row.squares[c][x] += value[c] * value[c];
+                }
+                ++row.counts[x];
+            }
+        }
+    });
+}
+
+bool BlendKernels::resolveStack(const MutableFrameView &result, const StackView &stack, quint32 frameCount)
+{
+    PIPELINE_TRACE_SCOPE("resolveStack");
+    if (!result.isValid() || !stack.isValid() || result.size() != stack.size()) return false;
+
+    if (!stack.counts && frameCount == 0) {
+        fill(result, 0xFF000000);
+        return true;
+    }
+
+    // Деление - умножением на обратное (float точен: сумма меньше 2^24)
+    const float uniform = stack.counts ? 0.0f : 1.0f / float(frameCount);
+
+    for (int y = 0; y < result.height; ++y) {
+        const StackRow row = stackRow(stack, y);
+        QRgb *resultRow = result.row(y);
+        int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+        const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+        const __m128i maxChannel = _mm_set1_epi32(255);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 oneF = _mm_set1_ps(1.0f);
+
+        for (; x + 4 <= result.width; x += 4) {
+            __m128 rcp = _mm_set1_ps(uniform);
+            if (row.counts) {
+                // Пиксель без кадров делится на 1: сумма у него 0
+                const __m128i counts = _mm_unpacklo_epi16(
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row.counts + x)), _mm_setzero_si128());
+                rcp = _mm_div_ps(oneF, _mm_max_ps(_mm_cvtepi32_ps(counts), oneF));
+            }
+
+            auto channel = [&](const quint32 *sum) {
+                const __m128 value = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + x)));
+                return _mm_min_epi16(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, rcp), half)), maxChannel);
+            };
+
+            const __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(channel(row.sums[0]), 16),
+                                                             _mm_slli_epi32(channel(row.sums[1]), 8)),
+                                                _mm_or_si128(channel(row.sums[2]), alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(resultRow + x), pixels);
+        }
+#endif
+
+        for (; x < result.width; ++x) {
+            const float rcp = row.counts ? 1.0f / float(qMax<quint32>(1, row.counts[x])) : uniform;
+            auto channel = [&](quint32 sum) { return qMin(255, int(float(sum) * rcp + 0.5f)); };
+            resultRow[x] = qRgb(channel(row.sums[0][x]), channel(row.sums[1][x]), channel(row.sums[2][x]));
+        }
+    }
+
+    return true;
+}
+
+bool BlendKernels::accumulateWide(int method, const MutableFloatFrameView &result, const FrameView &prev,
+                                  const FrameView &curr, float threshold)
+{
+    PIPELINE_TRACE_SCOPE("accumulateWide");
+    if (!result.isValid() || !prev.isValid() || !curr.isValid() || prev.format != curr.format
+        || prev.size() != curr.size() || result.size() != curr.size()) {
+        return false;
+    }
+    switch (method) {
+        case BlendMethods::MethodTrail:
+        case BlendMethods::MethodV2:
+        case BlendMethods::MethodV3:
+        case BlendMethods::MethodV4:
+        case BlendMethods::MethodV4Fast:
+        case BlendMethods::MethodGradient:
+        case BlendMethods::MethodPerceptual:
+            break;
+        default:
+            return false;
+    }
+
+    const Float4 white = splat4(1.0f);
+
+    return dispatchWideFormat(curr.format, [&](auto tag) {
+        constexpr FramePixelFormat Format = decltype(tag)::value;
+
+        switch (method) {
+            case BlendMethods::MethodTrail:
+            case BlendMethods::MethodV2:
+                forEachWidePixel<Format>(result, prev, curr, [&](float *out, Float4 a, Float4 b) {
+                    storeFloat4(out, withOpaqueAlpha(max4(loadFloat4(out), abs4(sub4(b, a)))));
+                });
+                break;
+            case BlendMethods::MethodV3:
+                forEachWidePixel<Format>(result, prev, curr, [&](float *out, Float4 a, Float4 b) {
+                    if (maxRgb(abs4(sub4(b, a))) > threshold) storeFloat4(out, white);
+                });
+                break;
+            case BlendMethods::MethodV4:
+                // Веса qGray: (11R + 16G + 5B) / 32
+                forEachWidePixel<Format>(result, prev, curr, [&](float *out, Float4 a, Float4 b) {
+                    if (std::fabs(weightedRgb(sub4(b, a), 11.0f / 32, 16.0f / 32, 5.0f / 32)) > threshold) {
+                        storeFloat4(out, white);
+                    }
+                });
+                break;
+            case BlendMethods::MethodV4Fast:
+                forEachWidePixel<Format>(result, prev, curr, [&](float *out, Float4 a, Float4 b) {
+                    if (std::fabs(weightedRgb(sub4(b, a), 1.0f / 3, 1.0f / 3, 1.0f / 3)) > threshold) {
+                        storeFloat4(out, b);
+                    }
+                });
+                break;
+            case BlendMethods::MethodGradient:
+                wideGradientDiff<Format>(result, prev, curr, threshold);
+                break;
+            case BlendMethods::MethodPerceptual:
+                // Порог в долях шкалы (t / 255), dE - в своих единицах
+                forEachWidePixel<Format>(result, prev, curr, [&](float *out, Float4 a, Float4 b) {
+                    if (perceptualDistance(a, b) > threshold * 255.0f) {
+                        storeFloat4(out, b);
+                    }
+                });
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+void BlendKernels::fill(const MutableFrameView &result, QRgb value)
+{
+    for (int y = 0; y < result.height; ++y) {
+        std::fill_n(result.row(y), result.width, value);
+    }
+}
+
+bool BlendKernels::mergeMax(const MutableFrameView &dst, const MutableFrameView &src)
+{
+    PIPELINE_TRACE_SCOPE("mergeMax");
+    if (!dst.isValid() || !src.isValid() || dst.size() != src.size()) return false;
+
+    for (int y = 0; y < dst.height; ++y) {
+        QRgb *dstRow = dst.row(y);
+        const QRgb *srcRow = src.row(y);
+        int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+        // 4 пикселя за итерацию: беззнаковый максимум по каждому байту
+        for (; x + 4 <= dst.width; x += 4) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dstRow + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcRow + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dstRow + x), _mm_max_epu8(a, b));
+        }
+#endif
+
+        for (; x < dst.width; ++x) {
+            const QRgb a = dstRow[x];
+            const QRgb b = srcRow[x];
+            dstRow[x] = qRgba(qMax(qRed(a), qRed(b)), qMax(qGreen(a), qGreen(b)),
+                              qMax(qBlue(a), qBlue(b)), qMax(qAlpha(a), qAlpha(b)));
+        }
+    }
+
+    return true;
+}
+
+bool BlendKernels::mergeMasked(const MutableFrameView &dst, const MutableFrameView &src,
+                               const uchar *mask, qsizetype maskStride)
+{
+    PIPELINE_TRACE_SCOPE("mergeMasked");
+    if (!dst.isValid() || !src.isValid() || !mask || dst.size() != src.size()) return false;
+
+    for (int y = 0; y < dst.height; ++y) {
+        QRgb *dstRow = dst.row(y);
+        const QRgb *srcRow = src.row(y);
+        const uchar *maskRow = mask + qsizetype(y) * maskStride;
+        int x = 0;
+
+#ifdef BLENDKERNELS_SSE2
+        for (; x + 4 <= dst.width; x += 4) {
+            qint32 maskBytes;
+            memcpy(&maskBytes, maskRow + x, sizeof(maskBytes));
+            if (maskBytes == 0) {
+                continue;
+            }
+
+            // Байт маски -> 32-битная маска пикселя (0x00000000 или 0xFFFFFFFF)
+            __m128i m = _mm_cvtsi32_si128(maskBytes);
+            m = _mm_unpacklo_epi8(m, m);
+            m = _mm_unpacklo_epi16(m, m);
+
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dstRow + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcRow + x));
+            const __m128i blended = _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dstRow + x), blended);
+        }
+#endif
+
+        for (; x < dst.width; ++x) {
+            if (maskRow[x]) {
+                dstRow[x] = srcRow[x];
+            }
+        }
+    }
+
+    return true;
+}
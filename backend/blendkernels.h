@@ -0,0 +1,334 @@
+#ifndef BLENDKERNELS_H
+#define BLENDKERNELS_H
+
+#include "backend/blendmethod.h"
+
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+
+// Формат пикселей во внешнем буфере
+enum class FramePixelFormat {
+    Invalid,
+    BGRA8,      // B,G,R,A в памяти: QImage::Format_ARGB32/RGB32, DXGI_FORMAT_B8G8R8A8_UNORM
+    RGBA8,      // R,G,B,A в памяти: QImage::Format_RGBA8888/RGBX8888
+    Gray8,      // QImage::Format_Grayscale8
+    RGBA16,     // R,G,B,A по 16 бит (unorm): QImage::Format_RGBA64/RGBX64, DXGI_FORMAT_R16G16B16A16_UNORM
+    RGBA16F     // R,G,B,A half-float: QImage::Format_RGBA16FPx4/RGBX16FPx4, DXGI_FORMAT_R16G16B16A16_FLOAT (HDR)
+};
+
+// Представление кадра в чужой памяти (mapped-текстура, mmap, shared memory, QImage).
+// Данные не копируются и не принадлежат представлению.
+struct FrameView
+{
+    const uchar *data = nullptr;
+    int width = 0;
+    int height = 0;
+    qsizetype stride = 0;       // Байт на строку, может быть больше width * bytesPerPixel
+    FramePixelFormat format = FramePixelFormat::Invalid;
+
+    bool isValid() const { return data && width > 0 && height > 0 && format != FramePixelFormat::Invalid; }
+    QSize size() const { return QSize(width, height); }
+    const uchar* row(int y) const { return data + qsizetype(y) * stride; }
+
+    FrameView subView(const QRect &rect) const;
+
+    static int bytesPerPixel(FramePixelFormat format);
+    // 16 бит на канал: такие кадры обрабатывают только ядра accumulateWide
+    static bool isWide(FramePixelFormat format) { return format == FramePixelFormat::RGBA16 || format == FramePixelFormat::RGBA16F; }
+    // Представление без копирования; для неподдерживаемого формата возвращает невалидное
+    static FrameView fromImage(const QImage &image, const QRect &rect = QRect());
+};
+
+// Планарный YUV 4:2:0 в чужой памяти (декодер видео, захват). Яркость - обычный FrameView Gray8,
+// поэтому ядра по яркости работают с ней без преобразований; цвет восстанавливается по запросу (rgbAt).
+// Цветность - полные плоскости, chromaOrigin - положение luma внутри кадра (для представлений области)
+struct YuvFrameView
+{
+    enum Layout {
+        NV12,       // Плоскость Y, затем плоскость UV (U и V чередуются)
+        I420        // Плоскости Y, U, V
+    };
+    enum Matrix {
+        Bt601,      // Ограниченный диапазон Y 16..235, UV 16..240
+        Bt709
+    };
+
+    FrameView luma;
+    const uchar *chroma0 = nullptr;     // NV12 - UV, I420 - U
+    const uchar *chroma1 = nullptr;     // I420 - V
+    qsizetype chromaStride = 0;
+    QPoint chromaOrigin;
+    Layout layout = NV12;
+    Matrix matrix = Bt601;
+
+    bool isValid() const { return luma.isValid() && luma.format == FramePixelFormat::Gray8 && chroma0
+                                  && (layout == NV12 || chroma1); }
+    QSize size() const { return luma.size(); }
+
+    YuvFrameView subView(const QRect &rect) const;
+
+    // Цвет пикселя (x, y) представления, BT.601/BT.709 в целых числах
+    QRgb rgbAt(int x, int y) const
+    {
+        const int cx = (chromaOrigin.x() + x) >> 1;
+        const int cy = (chromaOrigin.y() + y) >> 1;
+        const uchar *row = chroma0 + qsizetype(cy) * chromaStride;
+
+        int u, v;
+        if (layout == NV12) {
+            u = row[cx * 2];
+            v = row[cx * 2 + 1];
+        } else {
+            u = row[cx];
+            v = chroma1[qsizetype(cy) * chromaStride + cx];
+        }
+
+        const int c = (luma.row(y)[x] - 16) * 298 + 128;
+        const int d = u - 128;
+        const int e = v - 128;
+
+        if (matrix == Bt709) {
+            return qRgb(qBound(0, (c + 459 * e) >> 8, 255),
+                        qBound(0, (c - 55 * d - 136 * e) >> 8, 255),
+                        qBound(0, (c + 541 * d) >> 8, 255));
+        }
+        return qRgb(qBound(0, (c + 409 * e) >> 8, 255),
+                    qBound(0, (c - 100 * d - 208 * e) >> 8, 255),
+                    qBound(0, (c + 516 * d) >> 8, 255));
+    }
+
+    // Порог в единицах 8-битной яркости -> единицы Y ограниченного диапазона (219 ступеней вместо 255)
+    static int lumaThreshold(int threshold) { return (threshold * 219 + 127) / 255; }
+};
+
+// Буфер результата: всегда 32 бита на пиксель в формате QRgb (0xAARRGGBB)
+struct MutableFrameView
+{
+    uchar *data = nullptr;
+    int width = 0;
+    int height = 0;
+    qsizetype stride = 0;
+
+    bool isValid() const { return data && width > 0 && height > 0; }
+    QSize size() const { return QSize(width, height); }
+    QRgb* row(int y) const { return reinterpret_cast<QRgb*>(data + qsizetype(y) * stride); }
+
+    MutableFrameView subView(const QRect &rect) const;
+
+    // image должен быть в Format_ARGB32/RGB32; вызывает detach
+    static MutableFrameView fromImage(QImage &image);
+};
+
+// Буфер результата высокой точности: R,G,B,A float (QImage::Format_RGBA32FPx4).
+// Значения в долях полной шкалы, для HDR могут быть больше 1; в 8 бит переводится только при отображении
+struct MutableFloatFrameView
+{
+    uchar *data = nullptr;
+    int width = 0;
+    int height = 0;
+    qsizetype stride = 0;
+
+    bool isValid() const { return data && width > 0 && height > 0; }
+    QSize size() const { return QSize(width, height); }
+    float* row(int y) const { return reinterpret_cast<float*>(data + qsizetype(y) * stride); }
+
+    MutableFloatFrameView subView(const QRect &rect) const;
+
+    // image должен быть в Format_RGBA32FPx4; вызывает detach
+    static MutableFloatFrameView fromImage(QImage &image);
+};
+
+// Суммы длинной выдержки: три плоскости по 32 бит на канал (R, G, B) с общим шагом строки.
+// squares - суммы квадратов для сигма-отсечения, counts - число кадров в сумме пикселя (16 бит);
+// без счетчиков у всех пикселей одно число кадров. Данные не принадлежат представлению
+struct StackView
+{
+    quint32 *sums[3] = {};
+    quint32 *squares[3] = {};
+    quint16 *counts = nullptr;
+    int width = 0;
+    int height = 0;
+    qsizetype stride = 0;           // В элементах, общий для sums и squares
+    qsizetype countsStride = 0;     // В элементах
+
+    bool isValid() const { return sums[0] && sums[1] && sums[2] && width > 0 && height > 0; }
+    bool hasSquares() const { return squares[0] && squares[1] && squares[2]; }
+    QSize size() const { return QSize(width, height); }
+
+    StackView subView(const QRect &rect) const;
+};
+
+// Гистограмма разностей пикселей (256 корзин) - побочный продукт ядер карт разности.
+// Четыре копии счетчиков: соседние пиксели с одинаковой разностью не ждут друг друга
+// на одной ячейке памяти. Каждый поток ведет свою гистограмму, затем они сливаются через merge
+class DiffHistogram
+{
+public:
+    void clear();
+    void merge(const DiffHistogram &other);
+
+    void add(int lane, int value) { m_counts[lane & 3][value]++; }
+    // Четыре разности, упакованные по байтам
+    void add4(quint32 packed)
+    {
+        m_counts[0][packed & 0xFF]++;
+        m_counts[1][(packed >> 8) & 0xFF]++;
+        m_counts[2][(packed >> 16) & 0xFF]++;
+        m_counts[3][packed >> 24]++;
+    }
+
+    quint64 bin(int value) const;
+    quint64 total() const;
+
+    // Наименьшая разность, не превышаемая долей fraction измененных пикселей с разностью до maxValue
+    // (уровень шума). Корзина 0 не учитывается, как и в otsuThreshold: иначе на почти статичной
+    // сцене любая доля набирается неизменными пикселями и результат - 0
+    int percentile(double fraction, int maxValue = 255) const;
+    // Порог Оцу по измененным пикселям (корзина 0 - неизменные пиксели - не учитывается)
+    int otsuThreshold() const;
+
+private:
+    quint64 m_counts[4][256] = {};
+};
+
+// Ядра смешивания над сырыми буферами. Один вызов - одна пара кадров,
+// разность накапливается в result. Размеры prev, curr и result должны совпадать,
+// форматы prev и curr - тоже. Возвращают false при несовместимых аргументах.
+namespace BlendKernels
+{
+    //---------Варианты парных ядер---------//
+    // У ядер шага есть скалярный и SIMD-вариант (SSE2: BGRA8, для V4 - Gray8; остальные форматы
+    // всегда скалярно). Какой быстрее на этой машине, решает KernelRegistry; Selected - его выбор
+
+    enum class KernelVariant {
+        Selected,
+        Scalar,
+        Simd
+    };
+
+    enum PairKernel {
+        KernelMaxDiff = 0,          // MethodTrail, MethodV2
+        KernelThresholdChannels,    // MethodV3
+        KernelThresholdGray,        // MethodV4
+        KernelThresholdColor,       // MethodV4Fast
+        KernelGradient,             // MethodGradient
+        KernelPerceptual,           // MethodPerceptual
+        PairKernelCount
+    };
+
+    PairKernel pairKernel(int method);
+    bool simdAvailable();
+    // Выбор для всех последующих вызовов с KernelVariant::Selected (из любого потока)
+    void selectVariant(PairKernel kernel, KernelVariant variant);
+    KernelVariant selectedVariant(PairKernel kernel);
+
+    // Максимум разности по каждому каналу (V2)
+    bool accumulateMaxDiff(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                           KernelVariant variant = KernelVariant::Selected);
+
+    // Белый пиксель, если максимальная разность каналов больше порога (V3)
+    bool accumulateThresholdChannels(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                                     int threshold, KernelVariant variant = KernelVariant::Selected);
+
+    // Белый пиксель, если разность яркости больше порога (V4).
+    // Для цветных буферов яркость считается как qGray
+    bool accumulateThresholdGray(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                                 int threshold, KernelVariant variant = KernelVariant::Selected);
+
+    // Цвет текущего кадра, если разность (R+G+B)/3 больше порога (V4Fast).
+    // writtenMask (необязательно) - отметки 0xFF для записанных пикселей, нужны для упорядоченного слияния
+    bool accumulateThresholdColor(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                                  int threshold, uchar *writtenMask = nullptr, qsizetype maskStride = 0,
+                                  KernelVariant variant = KernelVariant::Selected);
+
+    // V4Fast по планарному YUV: разность берется прямо по плоскости Y (SSE2), цвет текущего кадра
+    // восстанавливается только для изменившихся пикселей. Порог - в единицах Y (YuvFrameView::lumaThreshold)
+    bool accumulateThresholdColorYuv(const MutableFrameView &result, const YuvFrameView &prev, const YuvFrameView &curr,
+                                     int threshold);
+
+    // Белый пиксель, если модуль градиента яркости (Собель, |gx| + |gy|, шкала 0..255) изменился больше
+    // порога (MethodGradient). Общий сдвиг яркости градиент не меняет - смена темы, затемнение и
+    // автоэкспозиция не засвечивают кадр. Яркость, градиент и разность считаются за один проход по строкам
+    // (SSE2: BGRA8, Gray8); соседи на краях представления - повтор крайнего пикселя.
+    // Для обхода полосами prev/curr могут быть выше result: contextTop строк над полосой и строки под ней
+    // только дают соседей, тогда шов полос не отличается от покадрового обхода
+    bool accumulateGradientDiff(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                                int threshold, int contextTop = 0, KernelVariant variant = KernelVariant::Selected);
+
+    // Цвет текущего кадра, если цветовое отличие CIE76 (dE в Lab, D65) больше порога (MethodPerceptual).
+    // В отличие от (R+G+B)/3 видит смену только оттенка и не завышает вклад синего. Перевод в Lab - по таблицам:
+    // канал -> вклад в X/Y/Z (линеаризация sRGB и матрица вместе), X/Y/Z -> кубический корень.
+    // Lab считается только для изменившихся пикселей (SSE2 пропускает совпадающие группы);
+    // writtenMask - как у accumulateThresholdColor
+    bool accumulatePerceptualDiff(const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                                  int threshold, uchar *writtenMask = nullptr, qsizetype maskStride = 0,
+                                  KernelVariant variant = KernelVariant::Selected);
+
+    // Шаг по индексу метода (BlendMethods::BlendMethod); MethodTrail выполняется как V2
+    bool accumulate(int method, const MutableFrameView &result, const FrameView &prev, const FrameView &curr,
+                    int threshold, KernelVariant variant = KernelVariant::Selected);
+
+    //---------Карты разности, не зависящие от порога---------//
+    // diffMap - байт на пиксель, размер совпадает с кадрами. Порог применяется позже одним проходом
+
+    // histogram (необязательно) получает разность каждого пикселя пары
+
+    // diffMap = max(diffMap, максимальная разность каналов) (V3)
+    bool accumulateChannelDiffMap(uchar *diffMap, qsizetype mapStride, const FrameView &prev, const FrameView &curr,
+                                  DiffHistogram *histogram = nullptr);
+
+    // diffMap = max(diffMap, разность яркости) (V4); для цветных буферов яркость - qGray
+    bool accumulateGrayDiffMap(uchar *diffMap, qsizetype mapStride, const FrameView &prev, const FrameView &curr,
+                               DiffHistogram *histogram = nullptr);
+
+    // levels = разность (R+G+B)/3 одной пары (V4Fast), 0 для совпадающих пикселей
+    bool averageDiffLevels(uchar *levels, qsizetype levelsStride, const FrameView &prev, const FrameView &curr,
+                           DiffHistogram *histogram = nullptr);
+
+    // Белый пиксель, где diffMap > threshold, иначе черный (SSE2). Порог приводится к 0..255
+    bool applyThreshold(const MutableFrameView &result, const uchar *diffMap, qsizetype mapStride, int threshold);
+
+    //---------Счетчики изменений (тепловая карта)---------//
+    // counts - 16 бит на пиксель, countsStride - в элементах. Счетчик пикселя увеличивается на 1,
+    // если максимальная разность каналов (метрика V3) больше порога; насыщение на 65535 (SSE2)
+    bool countThresholdCrossings(quint16 *counts, qsizetype countsStride, const FrameView &prev, const FrameView &curr,
+                                 int threshold);
+
+    //---------Длинная выдержка (суммы по каналам)---------//
+    // Кадр добавляется к суммам stack (размеры совпадают); в 8 бит суммы переводятся только при отображении.
+    // SSE2 для BGRA8: каналы 4 пикселей расширяются до 32 бит сдвигом и маской и складываются с плоскостями.
+    // mask (необязательно, байт на пиксель, 0 - пиксель кадра не добавляется) требует stack.counts
+    bool addToStack(const StackView &stack, const FrameView &frame, const uchar *mask = nullptr,
+                    qsizetype maskStride = 0);
+
+    // С сигма-отсечением: пиксель кадра, у которого хоть один канал дальше kappa * sigma от текущего среднего
+    // пикселя (sigma не меньше minSigma), не добавляется - пролетевший объект, вспышка, курсор.
+    // Первые кадры пикселя (пока статистики мало) принимаются всегда. Нужны stack.counts и stack.squares
+    bool addToStackClipped(const StackView &stack, const FrameView &frame, float kappa, float minSigma,
+                           const uchar *mask = nullptr, qsizetype maskStride = 0);
+
+    // result = суммы / число кадров (SSE2), альфа непрозрачная. Без stack.counts делитель - frameCount;
+    // пиксель без кадров - черный
+    bool resolveStack(const MutableFrameView &result, const StackView &stack, quint32 frameCount);
+
+    //---------Кадры 16 бит на канал (RGBA16, RGBA16F)---------//
+    // Шаг метода (BlendMethods::BlendMethod) без перевода в 8 бит (SSE2: half-float -> float без F16C).
+    // threshold - в долях полной шкалы: 8-битный порог t соответствует t / 255.
+    // Метрики как у 8-битных ядер: V3 - максимум разности каналов, V4 - разность яркости qGray,
+    // V4Fast - разность (R+G+B)/3 с записью цвета текущего кадра, MethodGradient - разность модуля
+    // градиента qGray, MethodPerceptual - dE CIE76 (без таблиц, точные формулы); MethodTrail выполняется как V2
+    bool accumulateWide(int method, const MutableFloatFrameView &result, const FrameView &prev, const FrameView &curr,
+                        float threshold);
+
+    //---------Слияние частичных результатов---------//
+    void fill(const MutableFrameView &result, QRgb value);
+
+    // dst = max(dst, src) по байтам (SSE2). Точно для V2 (максимум по каналам) и V3/V4 (белое/черное)
+    bool mergeMax(const MutableFrameView &dst, const MutableFrameView &src);
+
+    // dst = src там, где mask != 0 (SSE2). Упорядоченное слияние для V4Fast: последний записавший побеждает
+    bool mergeMasked(const MutableFrameView &dst, const MutableFrameView &src, const uchar *mask, qsizetype maskStride);
+}
+
+#endif // BLENDKERNELS_H
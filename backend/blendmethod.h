@@ -0,0 +1,25 @@
+#ifndef BLENDMETHOD_H
+#define BLENDMETHOD_H
+
+// Методы смешивания. Значения - индексы списка методов в окне, поле method файла сессии
+// и таблиц ядер; ImageBlender видит их как ImageBlender::MethodX.
+// Отдельный заголовок: ядрам (BlendKernels, ThresholdCache, реестр) не нужен mediator.h
+namespace BlendMethods
+{
+
+enum BlendMethod {
+    MethodTrail = 0,
+    MethodV2,
+    MethodV3,
+    MethodV4,
+    MethodV4Fast,
+    MethodHeatmap,      // Частота изменений пикселя (MotionHeatmap), не накопитель QImage
+    MethodGradient,     // Разность модуля градиента (Собель): общее изменение яркости не засвечивает кадр
+    MethodPerceptual,   // Цветовое отличие dE (CIE76, Lab по таблицам): как V4Fast, но видит смену оттенка
+    MethodExposure,     // Длинная выдержка: среднее кадров (ExposureStack), не разность, порог не используется
+    MethodExposureClipped   // Длинная выдержка с сигма-отсечением: пролетающие объекты не попадают в среднее
+};
+
+} // namespace BlendMethods
+
+#endif // BLENDMETHOD_H
@@ -0,0 +1,584 @@
+#include "backend/blendsession.h"
+#include "backend/mediator.h"
+
+#include <algorithm>
+
+BlendWorkerPool::BlendWorkerPool(int maxThreads, QObject *parent)
+    : QObject(parent)
+    , m_maxThreads(qMax(1, maxThreads))
+{
+    m_pool.setMaxThreadCount(m_maxThreads);
+}
+
+BlendWorkerPool::~BlendWorkerPool()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_shuttingDown = true;
+        m_readyQueue.clear();
+        m_rerun.clear();
+    }
+
+    m_pool.waitForDone();
+}
+
+int BlendWorkerPool::activeJobs() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running.size();
+}
+
+int BlendWorkerPool::queuedSessions() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_readyQueue.size();
+}
+
+void BlendWorkerPool::schedule(BlendSession *session)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_shuttingDown || m_readyQueue.contains(session)) {
+            return;
+        }
+        // Задача сессии еще не вернулась - поставим в очередь по ее завершении
+        if (m_running.contains(session)) {
+            m_rerun.insert(session);
+            return;
+        }
+        m_readyQueue.enqueue(session);
+    }
+
+    dispatch();
+}
+
+void BlendWorkerPool::unregister(BlendSession *session)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Задача могла вернуть сессию в очередь, пока мы ждали - удаляем повторно
+    forever {
+        m_readyQueue.removeAll(session);
+        m_rerun.remove(session);
+        if (!m_running.contains(session)) {
+            break;
+        }
+        m_jobDone.wait(&m_mutex);
+    }
+}
+
+void BlendWorkerPool::dispatch()
+{
+    QMutexLocker locker(&m_mutex);
+
+    // В QThreadPool отдаем не больше задач, чем потоков: очередь и порядок остаются у нас
+    while (!m_shuttingDown && m_running.size() < m_maxThreads && !m_readyQueue.isEmpty()) {
+        BlendSession *session = m_readyQueue.dequeue();
+        m_running.append(session);
+
+        m_pool.start([this, session]() {
+            const bool hasMore = session->processPending();
+            jobFinished(session, hasMore);
+        });
+    }
+}
+
+void BlendWorkerPool::jobFinished(BlendSession *session, bool hasMore)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running.removeOne(session);
+        const bool rerun = m_rerun.remove(session);
+
+        // Новый кадр пришел во время обработки - сессия встает в конец очереди
+        if ((hasMore || rerun) && !m_shuttingDown) {
+            m_readyQueue.enqueue(session);
+        }
+
+        m_jobDone.wakeAll();
+    }
+
+    dispatch();
+}
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+BlendSession::BlendSession(BlendWorkerPool *pool, QObject *parent)
+    : QObject(parent)
+    , m_pool(pool)
+    , m_capture(new DXWindowCapture(this))
+    , m_pacer(new CapturePacer(this))
+    , m_method(ImageBlender::MethodV4Fast)
+    , m_threshold(30)
+{
+    qRegisterMetaType<BlendSession::Stats>();
+
+    m_clock.start();
+
+    connect(m_capture, &DXWindowCapture::screenshotCaptured, this, [this](const QImage &frame){
+        emit frameCaptured(frame);
+        submitFrame(frame);
+    });
+    // Повтор до обработки не доходит, но для темпа это кадр без движения: иначе в простое
+    // интервал остался бы тем, что задал последний изменившийся кадр
+    connect(m_capture, &DXWindowCapture::duplicateDropped, this, [this](){
+        {
+            QMutexLocker locker(&m_mutex);
+            ++m_stats.duplicateFrames;
+        }
+        m_pacer->reportChange(0.0);
+    });
+
+    // Темп захвата подстраивается под движение в кадре и загрузку пула
+    connect(m_pacer, &CapturePacer::intervalChanged, m_capture, &DXWindowCapture::setCaptureInterval);
+}
+
+BlendSession::~BlendSession()
+{
+    m_capture->stopCapture();
+    m_pool->unregister(this);
+
+    // Задач больше нет: последний снимок дописывается до выхода
+    if (m_store) {
+        m_store->save(stateSnapshot());
+        delete m_store;
+    }
+}
+
+bool BlendSession::start(HWND targetWindow, int intervalMs)
+{
+    if (!m_capture->initCapture(targetWindow)) {
+        return false;
+    }
+
+    // Заданный интервал - максимальная частота для адаптивного темпа
+    CapturePacer::Config pacing = m_pacer->config();
+    pacing.minIntervalMs = intervalMs;
+    pacing.latencyBudgetMs = intervalMs;
+    m_pacer->setConfig(pacing);
+    m_pacer->reset();
+
+    m_capture->startCapture(intervalMs);
+    return true;
+}
+
+void BlendSession::stop()
+{
+    m_capture->stopCapture();
+}
+
+void BlendSession::resume()
+{
+    m_capture->startCapture(m_pacer->intervalMs());
+}
+
+void BlendSession::setRegion(const QRect &roi)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_roi = roi;
+    }
+
+    if (roi.isNull()) {
+        m_capture->resetCaptureArea();
+    } else {
+        m_capture->setCaptureArea(roi);
+    }
+}
+
+void BlendSession::setMethod(int method)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_method = method;
+    }
+
+    // Выдержке нужен каждый кадр: без повторов неподвижные участки записи весили бы меньше движущихся.
+    // Повторы проходят обработку как обычные кадры, темп захвата снижает CapturePacer (изменений нет)
+    const bool exposure = method == ImageBlender::MethodExposure || method == ImageBlender::MethodExposureClipped;
+    m_capture->setDeduplicationEnabled(!exposure);
+}
+
+void BlendSession::setThreshold(int threshold)
+{
+    QMutexLocker locker(&m_mutex);
+    m_threshold = threshold;
+}
+
+void BlendSession::setMotionCompensation(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+    m_motionCompensation = enabled;
+}
+
+void BlendSession::setSceneCutFraction(double fraction)
+{
+    QMutexLocker locker(&m_mutex);
+    m_sceneCutFraction = qBound(0.0, fraction, 1.0);
+}
+
+void BlendSession::setPersistence(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    m_storePath = path;
+}
+
+void BlendSession::resetAccumulator()
+{
+    QMutexLocker locker(&m_mutex);
+    m_resetRequested = true;
+}
+
+QRect BlendSession::region() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_roi;
+}
+
+int BlendSession::method() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_method;
+}
+
+int BlendSession::threshold() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_threshold;
+}
+
+bool BlendSession::motionCompensation() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_motionCompensation;
+}
+
+double BlendSession::sceneCutFraction() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_sceneCutFraction;
+}
+
+QString BlendSession::persistencePath() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_storePath;
+}
+
+BlendSession::Stats BlendSession::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stats;
+}
+
+void BlendSession::submitFrame(const QImage &frame)
+{
+    if (frame.isNull()) {
+        return;
+    }
+
+    bool needSchedule = false;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        // Замена ожидающего кадра память не увеличивает; новый кадр сверх бюджета не принимаем
+        const qint64 frameBytes = FrameMemory::imageBytes(frame);
+        if (!m_hasPending && !FrameMemory::instance()->fits(frameBytes)) {
+            ++m_stats.refusedFrames;
+            return;
+        }
+
+        // Храним только самый свежий кадр: устаревший вытесняется
+        if (m_hasPending) {
+            ++m_stats.droppedFrames;
+        }
+
+        m_pending = frame;
+        m_pendingMemory.set(frameBytes);
+        m_pendingStampNs = m_clock.nsecsElapsed();
+        m_hasPending = true;
+
+        needSchedule = !m_scheduled;
+        m_scheduled = true;
+    }
+
+    if (needSchedule) {
+        m_pool->schedule(this);
+    }
+}
+
+void BlendSession::openStore(const QString &path)
+{
+    // Старое хранилище дописывает текущее состояние и закрывается
+    if (m_store) {
+        m_store->save(stateSnapshot());
+        delete m_store;
+        m_store = nullptr;
+    }
+    if (path.isEmpty()) return;
+
+    m_store = new SessionStore(path);
+    m_checkpointNs = m_clock.nsecsElapsed();
+
+    SessionStore::Snapshot restored;
+    if (!m_store->restore(restored)) return;
+
+    m_result = restored.result;
+    m_resultArea = restored.area;
+    m_resultMethod = restored.method;
+    m_prevFrame = restored.prevFrame;
+    m_motion.reset();
+
+    m_heatmap.clear();
+    if (restored.method == ImageBlender::MethodHeatmap && !restored.heatmapCounts.empty()) {
+        m_heatmap.reset(restored.area.size());
+        for (int y = 0; y < restored.area.height(); ++y) {
+            std::copy_n(restored.heatmapCounts.data() + qsizetype(y) * restored.area.width(),
+                        restored.area.width(), m_heatmap.row(y));
+        }
+        m_heatmap.addPairs(restored.heatmapPairs);
+    }
+    m_exposure.clear();
+    if (restored.method == ImageBlender::MethodExposure || restored.method == ImageBlender::MethodExposureClipped) {
+        const ExposureStack::Mode mode = (restored.method == ImageBlender::MethodExposureClipped)
+                                             ? ExposureStack::SigmaClip : ExposureStack::Mean;
+        if (!m_exposure.restore(restored.area.size(), mode, restored.exposureSums, restored.exposureSquares,
+                                restored.exposureCounts, restored.exposureFrames)) {
+            qDebug() << "Session state: exposure sums missing or damaged, exposure starts over";
+        }
+    }
+    m_stateMemory.set(FrameMemory::imageBytes(m_prevFrame) + FrameMemory::imageBytes(m_result));
+
+    QMutexLocker locker(&m_mutex);
+    m_stats.processedFrames = restored.processedFrames;
+    m_stats.droppedFrames = restored.droppedFrames;
+    m_stats.refusedFrames = restored.refusedFrames;
+}
+
+SessionStore::Snapshot BlendSession::stateSnapshot() const
+{
+    SessionStore::Snapshot snapshot;
+    snapshot.result = m_result;
+    snapshot.prevFrame = m_prevFrame;
+    snapshot.area = m_resultArea;
+    snapshot.method = m_resultMethod;
+
+    if (m_resultMethod == ImageBlender::MethodHeatmap && m_heatmap.isValid()) {
+        const QSize size = m_heatmap.size();
+        snapshot.heatmapCounts.resize(size_t(size.width()) * size_t(size.height()));
+        for (int y = 0; y < size.height(); ++y) {
+            std::copy_n(m_heatmap.row(y), size.width(), snapshot.heatmapCounts.data() + qsizetype(y) * size.width());
+        }
+        snapshot.heatmapPairs = m_heatmap.pairs();
+    }
+    if (m_exposure.isValid()) {
+        snapshot.exposureSums = m_exposure.sums();
+        snapshot.exposureSquares = m_exposure.squares();
+        snapshot.exposureCounts = m_exposure.counts();
+        snapshot.exposureFrames = m_exposure.frames();
+    }
+
+    QMutexLocker locker(&m_mutex);
+    snapshot.processedFrames = m_stats.processedFrames;
+    snapshot.droppedFrames = m_stats.droppedFrames;
+    snapshot.refusedFrames = m_stats.refusedFrames;
+    return snapshot;
+}
+
+bool BlendSession::processPending()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_hasPending) {
+        m_scheduled = false;
+        return false;
+    }
+
+    const QImage frame = m_pending;
+    const qint64 stampNs = m_pendingStampNs;
+    const QRect roi = m_roi;
+    const int method = m_method;
+    const int threshold = m_threshold;
+    const bool compensate = m_motionCompensation;
+    const bool reset = m_resetRequested;
+    const double cutFraction = m_sceneCutFraction;
+    const QString storePath = m_storePath;
+    const quint64 frameIndex = m_stats.processedFrames;
+
+    m_pending = QImage();
+    m_pendingMemory.set(0);
+    m_hasPending = false;
+    m_resetRequested = false;
+
+    locker.unlock();
+
+    // Сохраненное состояние подхватывается до проверки параметров: другая область или метод
+    // сбросят его так же, как сбросили бы текущее
+    if (storePath != (m_store ? m_store->path() : QString())) {
+        openStore(storePath);
+    }
+
+    // Накопление выполняется без блокировки: состояние принадлежит только задаче пула
+    const QRect frameRoi = DXWindowCapture::frameRegion(frame, roi);
+    const QRect area = frameRoi.isNull() ? frame.rect() : frameRoi.intersected(frame.rect());
+    double changed = 1.0;
+    bool cut = false;
+    QPoint motionShift;
+    if (!area.isEmpty()) {
+        // 16-битные кадры (HDR) накапливаются в float; у тепловой карты и выдержки m_result - всегда отрисовка ARGB32
+        const bool exposureMode = method == ImageBlender::MethodExposure
+                                  || method == ImageBlender::MethodExposureClipped;
+        const ExposureStack::Mode exposureStackMode = (method == ImageBlender::MethodExposureClipped)
+                                                          ? ExposureStack::SigmaClip : ExposureStack::Mean;
+        const QImage::Format resultFormat = (method == ImageBlender::MethodHeatmap || exposureMode)
+                                                ? QImage::Format_ARGB32 : ImageBlender::accumulatorFormat(frame);
+        // Суммы выдержки восстанавливаются из файла состояния; без них выдержка начинается заново
+        if (reset || m_result.isNull() || area != m_resultArea || method != m_resultMethod
+            || m_prevFrame.size() != frame.size() || m_result.format() != resultFormat
+            || (exposureMode && !m_exposure.isValid())) {
+            m_result = ImageBlender::createAccumulator(area.size(), resultFormat);
+            m_resultArea = area;
+            m_resultMethod = method;
+            m_prevFrame = QImage();
+            m_motion.reset();
+
+            if (method == ImageBlender::MethodHeatmap) {
+                m_heatmap.reset(area.size());
+            } else {
+                m_heatmap.clear();
+            }
+            if (exposureMode) {
+                m_exposure.reset(area.size(), exposureStackMode);
+            } else {
+                m_exposure.clear();
+            }
+        }
+
+        if (!m_prevFrame.isNull()) {
+            // Прокрутка окна не должна засвечивать весь кадр: сравниваем со сдвинутым предыдущим
+            QPoint shift;
+            if (compensate) {
+                const MotionEstimator::Motion motion = m_motion.update(FrameView::fromImage(m_prevFrame, area),
+                                                                       FrameView::fromImage(frame, area),
+                                                                       m_prevFrame.cacheKey(), frame.cacheKey());
+                if (motion.valid) {
+                    shift = motion.shift;
+                }
+            } else {
+                // Сохраненная яркость не переживает паузу компенсации
+                m_motion.reset();
+            }
+            motionShift = shift;
+
+            // Темп захвата и смена сцены - по одной выборке: любая разность и разность выше шума сжатия
+            const CapturePacer::ChangeFractions fractions = CapturePacer::changeFractions(m_prevFrame, frame, area, 8,
+                                                                                          sceneCutNoiseThreshold);
+            changed = fractions.any;
+
+            // Смена сцены проверяется по выборке до ядра: после нее весь кадр - "изменение",
+            // накопление такой пары засветило бы результат, а следующие пары ничего бы не добавили
+            const double cutChanged = (cutFraction > 0.0 && shift.isNull()) ? fractions.aboveNoise : 0.0;
+            if (cutChanged > 0.0 && cutChanged >= cutFraction) {
+                cut = true;
+                emit sceneCut(frameIndex, cutChanged, m_result);
+
+                m_result = ImageBlender::createAccumulator(area.size(), resultFormat);
+                m_motion.reset();
+                if (method == ImageBlender::MethodHeatmap) {
+                    m_heatmap.reset(area.size());
+                    m_result = m_heatmap.render();
+                }
+                if (exposureMode) {
+                    m_exposure.reset(area.size(), exposureStackMode);
+                }
+            } else if (method == ImageBlender::MethodHeatmap) {
+                // Счетчики растут каждый кадр, палитра применяется только к отправляемому результату
+                QRect prevRect, currRect;
+                MotionEstimator::overlap(area, shift, prevRect, currRect);
+                if (!currRect.isEmpty()) {
+                    // Счет порогов - только по 8-битным форматам: HDR-кадры сводятся к ARGB32, как у выдержки
+                    QImage prevStorage, currStorage;
+                    FrameView prevView = FrameView::fromImage(m_prevFrame, prevRect);
+                    FrameView currView = FrameView::fromImage(frame, currRect);
+                    if (!prevView.isValid() || FrameView::isWide(prevView.format)) {
+                        prevStorage = m_prevFrame.copy(prevRect).convertToFormat(QImage::Format_ARGB32);
+                        prevView = FrameView::fromImage(prevStorage);
+                    }
+                    if (!currView.isValid() || FrameView::isWide(currView.format)) {
+                        currStorage = frame.copy(currRect).convertToFormat(QImage::Format_ARGB32);
+                        currView = FrameView::fromImage(currStorage);
+                    }
+                    m_heatmap.accumulate(prevView, currView, threshold, currRect.topLeft() - area.topLeft());
+                }
+                m_result = m_heatmap.render();
+            } else if (!exposureMode) {
+                ImageBlender::accumulatePair(method, m_result, m_prevFrame, frame, threshold, area, shift);
+            }
+        }
+
+        // Выдержка - не разность пары: каждый кадр, включая первый и первый после смены сцены,
+        // добавляется к суммам; среднее в 8 бит считается только для отправляемого результата
+        if (exposureMode) {
+            QImage storage;
+            FrameView view = FrameView::fromImage(frame, area);
+            if (!view.isValid() || FrameView::isWide(view.format)) {
+                storage = frame.copy(area).convertToFormat(QImage::Format_ARGB32);
+                view = FrameView::fromImage(storage);
+            }
+            m_exposure.add(view);
+            m_result = m_exposure.render();
+        }
+        m_prevFrame = frame;
+        m_stateMemory.set(FrameMemory::imageBytes(m_prevFrame) + FrameMemory::imageBytes(m_result));
+
+        emit resultUpdated(m_result);
+    }
+
+    locker.relock();
+
+    const qint64 nowNs = m_clock.nsecsElapsed();
+    const double latencyMs = (nowNs - stampNs) / 1e6;
+
+    ++m_stats.processedFrames;
+    m_stats.sceneCuts += cut ? 1 : 0;
+    m_stats.motion = motionShift;
+    m_stats.lastLatencyMs = latencyMs;
+    m_stats.avgLatencyMs = (m_stats.processedFrames == 1) ? latencyMs
+                                                          : m_stats.avgLatencyMs * 0.9 + latencyMs * 0.1;
+
+    // Частота кадров по окну не короче секунды
+    ++m_fpsWindowFrames;
+    const qint64 windowNs = nowNs - m_fpsWindowStartNs;
+    if (windowNs >= 1000000000LL) {
+        m_stats.fps = m_fpsWindowFrames * 1e9 / windowNs;
+        m_fpsWindowFrames = 0;
+        m_fpsWindowStartNs = nowNs;
+    }
+
+    const Stats snapshot = m_stats;
+    const bool hasMore = m_hasPending;
+    if (!hasMore) {
+        m_scheduled = false;
+    }
+
+    locker.unlock();
+
+    // Снимок неглубокий: следующее накопление один раз скопирует m_result (detach), запись - в потоке хранилища
+    if (m_store && nowNs - m_checkpointNs >= qint64(checkpointIntervalMs) * 1000000) {
+        m_checkpointNs = nowNs;
+        m_store->save(stateSnapshot());
+    }
+
+    // Пейсер живет в GUI-потоке: передаем наблюдения очередью
+    const int queueDepth = m_pool->queuedSessions() + (hasMore ? 1 : 0);
+    QMetaObject::invokeMethod(m_pacer, [pacer = m_pacer, changed, queueDepth, latencyMs]() {
+        pacer->reportFrame(changed, queueDepth, latencyMs);
+    }, Qt::QueuedConnection);
+
+    emit statsUpdated(snapshot);
+    return hasMore;
+}
@@ -0,0 +1,186 @@
+#ifndef BLENDSESSION_H
+#define BLENDSESSION_H
+
+#include "backend/dxwindowcapture.h"
+#include "backend/capturepacer.h"
+#include "backend/exposurestack.h"
+#include "backend/framememory.h"
+#include "backend/motionestimator.h"
+#include "backend/motionheatmap.h"
+#include "backend/sessionstore.h"
+
+#include <QObject>
+#include <QImage>
+#include <QRect>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QThreadPool>
+#include <QThread>
+#include <QSet>
+#include <QElapsedTimer>
+
+class BlendSession;
+
+// Общий пул обработки для всех сессий. Число потоков ограничено числом ядер,
+// а не числом сессий. Планирование честное (round-robin): у каждой сессии
+// не больше одной задачи в работе и одного места в очереди.
+class BlendWorkerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BlendWorkerPool(int maxThreads = QThread::idealThreadCount(), QObject *parent = nullptr);
+    ~BlendWorkerPool();
+
+    int maxThreads() const { return m_maxThreads; }
+    int activeJobs() const;
+    int queuedSessions() const;
+
+    // Сессия сообщает, что у нее появился новый кадр
+    void schedule(BlendSession *session);
+    // Убирает сессию из очереди и дожидается завершения ее текущей задачи
+    void unregister(BlendSession *session);
+
+private:
+    void dispatch();
+    void jobFinished(BlendSession *session, bool hasMore);
+
+private:
+    QThreadPool m_pool;
+    int m_maxThreads;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_jobDone;
+    QQueue<BlendSession*> m_readyQueue;
+    QList<BlendSession*> m_running;
+    QSet<BlendSession*> m_rerun;    // Запрошены повторно, пока задача еще выполнялась
+    bool m_shuttingDown = false;
+};
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+// Независимая сессия захвата/смешивания: свой источник, область, метод и порог
+class BlendSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats {
+        double fps = 0.0;               // Обработанных кадров в секунду
+        double lastLatencyMs = 0.0;     // От поступления кадра до готового результата
+        double avgLatencyMs = 0.0;      // Скользящее среднее (EMA)
+        quint64 processedFrames = 0;
+        quint64 droppedFrames = 0;      // Кадры, вытесненные более новыми до обработки
+        quint64 refusedFrames = 0;      // Кадры, не принятые из-за бюджета памяти (FrameMemory)
+        quint64 duplicateFrames = 0;    // Повторы предыдущего кадра, отброшенные при захвате (FrameDeduplicator)
+        quint64 sceneCuts = 0;          // Сбросы накопителя по смене сцены
+        QPoint motion;                  // Последний компенсированный сдвиг (MotionEstimator)
+    };
+
+public:
+    explicit BlendSession(BlendWorkerPool *pool, QObject *parent = nullptr);
+    ~BlendSession();
+
+    bool start(HWND targetWindow, int intervalMs = 16);
+    void stop();
+    void resume();      // Захват после stop() с текущим темпом CapturePacer, окно прежнее
+
+    DXWindowCapture* capture() const { return m_capture; }
+    CapturePacer* pacer() const { return m_pacer; }
+    FrameDeduplicator::Counters dedupCounters() const { return m_capture->dedupCounters(); }
+
+    void setRegion(const QRect &roi);
+    void setMethod(int method);
+    void setThreshold(int threshold);
+    void setMotionCompensation(bool enabled);
+    void resetAccumulator();
+    // Смена сцены: доля изменившихся пикселей по разреженной выборке (CapturePacer::changedFraction)
+    // от fraction - накопитель сбрасывается до полного ядра, пара на границе сцен не накапливается.
+    // Найденный компенсацией сдвиг (прокрутка) сменой сцены не считается. 0 - не отслеживать
+    void setSceneCutFraction(double fraction);
+    // Файл состояния накопления (SessionStore): с первого кадра сессия продолжает сохраненное
+    // состояние, дальше снимок пишется в фоне раз в checkpointIntervalMs. Пустой путь - без сохранения
+    void setPersistence(const QString &path);
+
+    QRect region() const;
+    int method() const;
+    int threshold() const;
+    bool motionCompensation() const;
+    double sceneCutFraction() const;
+    QString persistencePath() const;
+    Stats stats() const;
+
+signals:
+    void frameCaptured(const QImage &frame);     // Кадр источника, область - DXWindowCapture::frameRegion(frame, region())
+    void resultUpdated(const QImage &result);    // Вызывается из потока пула
+    void statsUpdated(const BlendSession::Stats &stats);
+    // Из потока пула, до сброса. frameIndex - номер кадра сессии (Stats::processedFrames),
+    // lastResult - накопление предыдущей сцены (неглубокая копия, снимок до сброса)
+    void sceneCut(quint64 frameIndex, double changedFraction, const QImage &lastResult);
+
+public slots:
+    void submitFrame(const QImage &frame);
+
+private:
+    friend class BlendWorkerPool;
+
+    // Выполняется в потоке пула. Возвращает true, если за время работы пришел новый кадр
+    bool processPending();
+
+    // Только в задаче пула или после ее завершения (состояние накопления принадлежит ей)
+    void openStore(const QString &path);
+    SessionStore::Snapshot stateSnapshot() const;
+
+private:
+    BlendWorkerPool *m_pool;
+    DXWindowCapture *m_capture;
+    CapturePacer *m_pacer;
+
+    mutable QMutex m_mutex;
+
+    // Параметры
+    QRect m_roi;
+    int m_method;
+    int m_threshold;
+    bool m_motionCompensation = false;
+    double m_sceneCutFraction = defaultSceneCutFraction;
+    QString m_storePath;
+
+    // Входной кадр, ожидающий обработки (хранится только самый свежий)
+    QImage m_pending;
+    qint64 m_pendingStampNs = 0;
+    bool m_hasPending = false;
+    bool m_scheduled = false;       // Сессия в очереди пула или обрабатывается
+    bool m_resetRequested = false;
+    FrameMemory::Tracker m_pendingMemory{FrameMemory::Sessions};
+
+    // Состояние накопления (меняется только в задаче пула)
+    QImage m_prevFrame;
+    QImage m_result;
+    QRect m_resultArea;
+    int m_resultMethod = -1;
+    FrameMemory::Tracker m_stateMemory{FrameMemory::Sessions};
+    MotionEstimator m_motion;
+    MotionHeatmap m_heatmap;        // Только для MethodHeatmap; m_result - ее отрисовка
+    ExposureStack m_exposure;       // Только для длинной выдержки; m_result - отрисовка среднего
+    SessionStore *m_store = nullptr;
+    qint64 m_checkpointNs = 0;
+    static constexpr int checkpointIntervalMs = 1000;
+    static constexpr double defaultSceneCutFraction = 0.6;
+    static constexpr int sceneCutNoiseThreshold = 24;   // Разность канала ниже - шум сжатия, не смена сцены
+
+    // Статистика
+    QElapsedTimer m_clock;
+    qint64 m_fpsWindowStartNs = 0;
+    int m_fpsWindowFrames = 0;
+    Stats m_stats;
+};
+
+Q_DECLARE_METATYPE(BlendSession::Stats)
+
+#endif // BLENDSESSION_H
@@ -0,0 +1,165 @@
+#include "backend/capturepacer.h"
+
+CapturePacer::CapturePacer(QObject *parent)
+    : QObject(parent)
+    , m_intervalMs(m_config.minIntervalMs)
+{
+
+}
+
+void CapturePacer::setConfig(const Config &config)
+{
+    m_config = config;
+    m_config.minIntervalMs = qMax(1, m_config.minIntervalMs);
+    m_config.maxIntervalMs = qMax(m_config.minIntervalMs, m_config.maxIntervalMs);
+
+    update();
+}
+
+void CapturePacer::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+
+    // Без адаптации работаем на максимальной частоте
+    if (!enabled) {
+        reset();
+    }
+}
+
+void CapturePacer::reset()
+{
+    m_motion = 1.0;
+    m_overloaded = false;
+    m_lastLatencyMs = 0.0;
+
+    const int previous = intervalMs();
+    m_intervalMs = m_config.minIntervalMs;
+    if (intervalMs() != previous) {
+        emit intervalChanged(intervalMs());
+    }
+}
+
+void CapturePacer::reportFrame(double changedFraction, int queueDepth, double stageLatencyMs)
+{
+    if (!m_enabled) return;
+
+    updateMotion(changedFraction);
+    updateLoad(queueDepth, stageLatencyMs);
+    update();
+}
+
+void CapturePacer::reportChange(double changedFraction)
+{
+    if (!m_enabled) return;
+
+    updateMotion(changedFraction);
+    update();
+}
+
+void CapturePacer::reportLoad(int queueDepth, double stageLatencyMs)
+{
+    if (!m_enabled) return;
+
+    updateLoad(queueDepth, stageLatencyMs);
+    update();
+}
+
+void CapturePacer::updateMotion(double changedFraction)
+{
+    changedFraction = qBound(0.0, changedFraction, 1.0);
+
+    // Рост реагирует сразу, спад сглаживается: первый же кадр с движением
+    // возвращает максимальную частоту, а в простой уходим постепенно
+    if (changedFraction >= m_motion) {
+        m_motion = changedFraction;
+    } else {
+        m_motion = m_motion * 0.7 + changedFraction * 0.3;
+    }
+}
+
+void CapturePacer::updateLoad(int queueDepth, double stageLatencyMs)
+{
+    m_lastLatencyMs = stageLatencyMs;
+    m_overloaded = queueDepth > m_config.maxQueueDepth
+                   || stageLatencyMs > m_config.latencyBudgetMs;
+}
+
+void CapturePacer::update()
+{
+    const int previous = intervalMs();
+    double next = m_intervalMs;
+
+    if (m_overloaded) {
+        // Конвейер не успевает: снижаем частоту не ниже фактической задержки обработки
+        next = qMax(next * m_config.backoffGrowth, m_lastLatencyMs);
+    } else if (m_motion >= m_config.motionChangeFraction) {
+        next = m_config.minIntervalMs;
+    } else if (m_motion <= m_config.idleChangeFraction) {
+        next = next * m_config.idleGrowth;
+    } else {
+        // Слабое движение: половина пути к максимальной частоте
+        next = next - (next - m_config.minIntervalMs) * 0.5;
+    }
+
+    m_intervalMs = qBound<double>(m_config.minIntervalMs, next, m_config.maxIntervalMs);
+
+    if (intervalMs() != previous) {
+        emit intervalChanged(intervalMs());
+    }
+}
+
+double CapturePacer::changedFraction(const QImage &prev, const QImage &curr, const QRect &roi,
+                                     int sampleStep, int noiseThreshold)
+{
+    return changeFractions(prev, curr, roi, sampleStep, noiseThreshold).aboveNoise;
+}
+
+CapturePacer::ChangeFractions CapturePacer::changeFractions(const QImage &prev, const QImage &curr, const QRect &roi,
+                                                            int sampleStep, int noiseThreshold)
+{
+    if (prev.isNull() || curr.isNull() || prev.size() != curr.size()) {
+        return ChangeFractions();
+    }
+
+    const QRect area = roi.isNull() ? curr.rect() : roi.intersected(curr.rect());
+    if (area.isEmpty()) {
+        return ChangeFractions{0.0, 0.0};
+    }
+
+    // 32-битные форматы читаем напрямую; остальные (8 и 16 бит на канал, FP16) - только
+    // выбранные пиксели через QImage::pixel, без конвертации кадра целиком
+    const bool direct = prev.depth() == 32 && curr.depth() == 32 && prev.format() == curr.format();
+
+    const int step = qMax(1, sampleStep);
+    qint64 samples = 0;
+    qint64 changed = 0;
+    qint64 aboveNoise = 0;
+
+    for (int y = step / 2; y < area.height(); y += step) {
+        const QRgb *prevRow = direct ? reinterpret_cast<const QRgb*>(prev.constScanLine(area.y() + y)) + area.x() : nullptr;
+        const QRgb *currRow = direct ? reinterpret_cast<const QRgb*>(curr.constScanLine(area.y() + y)) + area.x() : nullptr;
+
+        // Сдвиг выборки через строку, чтобы сетка не совпадала с вертикальными границами
+        const int xStart = ((y / step) & 1) ? step / 2 : 0;
+        for (int x = xStart; x < area.width(); x += step) {
+            ++samples;
+
+            const QRgb prevPixel = direct ? prevRow[x] : prev.pixel(area.x() + x, area.y() + y);
+            const QRgb currPixel = direct ? currRow[x] : curr.pixel(area.x() + x, area.y() + y);
+            if (prevPixel == currPixel) {
+                continue;
+            }
+
+            const int diff = qMax(qMax(qAbs(qRed(currPixel) - qRed(prevPixel)),
+                                       qAbs(qGreen(currPixel) - qGreen(prevPixel))),
+                                  qAbs(qBlue(currPixel) - qBlue(prevPixel)));
+            changed += diff > 0 ? 1 : 0;
+            aboveNoise += diff > noiseThreshold ? 1 : 0;
+        }
+    }
+
+    if (samples == 0) {
+        return ChangeFractions{0.0, 0.0};
+    }
+    return ChangeFractions{double(changed) / samples, double(aboveNoise) / samples};
+}
@@ -0,0 +1,82 @@
+#ifndef CAPTUREPACER_H
+#define CAPTUREPACER_H
+
+#include <QObject>
+#include <QImage>
+#include <QRect>
+
+// Адаптивный темп захвата. Не зависит от источника кадров и WinAPI: получает только
+// наблюдения о движении и нагрузке (reportFrame) и сообщает новый интервал через intervalChanged.
+//  - движения нет (доля изменившихся пикселей около нуля) - интервал плавно растет;
+//  - появилось движение - сразу возвращаемся к минимальному интервалу;
+//  - очередь или задержка обработки превышают бюджет - интервал увеличивается (back-off).
+class CapturePacer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Config {
+        int minIntervalMs = 16;             // Максимальная частота захвата
+        int maxIntervalMs = 250;            // Минимальная частота в простое
+        double idleChangeFraction = 0.001;  // Ниже - считаем, что движения нет
+        double motionChangeFraction = 0.01; // Выше - движение, максимальная частота
+        double idleGrowth = 1.25;           // Рост интервала за кадр без движения
+        int maxQueueDepth = 1;              // Бюджет очереди после захвата
+        double latencyBudgetMs = 16.0;      // Бюджет задержки стадии обработки
+        double backoffGrowth = 1.5;         // Рост интервала при перегрузке
+    };
+
+    // Один проход выборки для двух потребителей: темп захвата и поиск смены сцены
+    struct ChangeFractions {
+        double any = 1.0;           // Доля изменившихся пикселей (любая разность канала)
+        double aboveNoise = 1.0;    // Доля пикселей с разностью канала больше noiseThreshold
+    };
+
+public:
+    explicit CapturePacer(QObject *parent = nullptr);
+
+    void setConfig(const Config &config);
+    Config config() const { return m_config; }
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled; }
+
+    int intervalMs() const { return qRound(m_intervalMs); }
+    double motionLevel() const { return m_motion; }
+    bool isOverloaded() const { return m_overloaded; }
+
+    //---------STATIC---------//
+    // Доля изменившихся пикселей по разреженной выборке (каждый sampleStep-й пиксель и строка).
+    // noiseThreshold - минимальная разность канала, которая считается изменением
+    static double changedFraction(const QImage &prev, const QImage &curr, const QRect &roi = QRect(),
+                                  int sampleStep = 8, int noiseThreshold = 0);
+    // Обе доли по одной выборке: каждый пиксель области читается один раз
+    static ChangeFractions changeFractions(const QImage &prev, const QImage &curr, const QRect &roi,
+                                           int sampleStep, int noiseThreshold);
+
+signals:
+    void intervalChanged(int intervalMs);
+
+public slots:
+    // Наблюдения за один кадр: движение и нагрузка конвейера, пересчет интервала один раз
+    void reportFrame(double changedFraction, int queueDepth, double stageLatencyMs);
+    void reportChange(double changedFraction);
+    void reportLoad(int queueDepth, double stageLatencyMs);
+    void reset();
+
+private:
+    void updateMotion(double changedFraction);
+    void updateLoad(int queueDepth, double stageLatencyMs);
+    void update();
+
+private:
+    Config m_config;
+    bool m_enabled = true;
+
+    double m_intervalMs;
+    double m_motion = 1.0;          // Сглаженная доля изменений (в начале считаем, что движение есть)
+    bool m_overloaded = false;
+    double m_lastLatencyMs = 0.0;
+};
+
+#endif // CAPTUREPACER_H
@@ -124,16 +124,23 @@ void DXWindowCapture::stopCapture()
     m_timer->stop();
 }
 
+void DXWindowCapture::setCaptureInterval(int intervalMs)
+{
+    m_timer->setInterval(intervalMs);
+}
+
 void DXWindowCapture::setCaptureArea(const QRect& area)
 {
     m_captureArea = area;
     m_useCustomArea = true;
+    m_dedup.reset();
 }
 
 void DXWindowCapture::resetCaptureArea()
 {
     m_useCustomArea = false;
     m_captureArea = QRect();
+    m_dedup.reset();
 }
 
 QRect DXWindowCapture::getWindowRect() const
@@ -154,6 +161,8 @@ QRect DXWindowCapture::getWindowRect() const
 
 void DXWindowCapture::captureScreenshot()
 {
+    PIPELINE_TRACE_SCOPE("captureScreenshot");
+
     if (!isWindowValid()) {
         emit captureError("Окно недоступно");
         return;
@@ -162,7 +171,14 @@ void DXWindowCapture::captureScreenshot()
     QImage screenshot = captureWindow();
 
     if (!screenshot.isNull()) {
+        // Кадр не изменился - дальше по конвейеру его не передаем
+        if (m_dedup.isDuplicate(screenshot, frameRegion(screenshot, getCaptureArea()))) {
+            emit duplicateDropped();
+            return;
+        }
+
         m_lastScreenshot = screenshot;
+        m_lastScreenshotMemory.set(FrameMemory::imageBytes(m_lastScreenshot));
         emit screenshotCaptured(screenshot);
     } else {
         emit captureError("Не удалось захватить скриншот");
@@ -171,6 +187,8 @@ void DXWindowCapture::captureScreenshot()
 
 QImage DXWindowCapture::captureWindow()
 {
+    PIPELINE_TRACE_SCOPE("captureWindow");
+
     // Пробуем методы в порядке приоритета
     QImage result;
 
@@ -242,15 +260,41 @@ QImage DXWindowCapture::captureWithDXGI()
     D3D11_MAPPED_SUBRESOURCE mappedResource;
     hr = m_d3dContext->Map(m_stagingTexture, 0, D3D11_MAP_READ, 0, &mappedResource);
 
+    // Формат поверхности: 8 бит BGRA (SDR) или half-float RGBA (рабочий стол в HDR).
+    // Остальные форматы не разбираем - кадр возьмут следующие методы захвата
+    FramePixelFormat pixelFormat = FramePixelFormat::Invalid;
+    QImage::Format imageFormat = QImage::Format_Invalid;
+    switch (textureDesc.Format) {
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+            pixelFormat = FramePixelFormat::BGRA8;
+            imageFormat = QImage::Format_ARGB32;
+            break;
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            pixelFormat = FramePixelFormat::RGBA16F;
+            imageFormat = QImage::Format_RGBA16FPx4;
+            break;
+        default:
+            break;
+    }
+
     QImage result;
-    if (SUCCEEDED(hr)) {
-        // Преобразуем в QPixmap
+    if (SUCCEEDED(hr) && pixelFormat != FramePixelFormat::Invalid) {
+        // Формат поверхности сохраняется: FP16 не переводится в 8 бит до отображения
         QImage image((uchar*)mappedResource.pData,
                      textureDesc.Width, textureDesc.Height,
-                     mappedResource.RowPitch, QImage::Format_ARGB32);
-
-        result = image;
-
+                     mappedResource.RowPitch, imageFormat);
+
+        // После Unmap память текстуры недоступна, поэтому кадр нужно скопировать - но только
+        // область захвата, а не весь рабочий стол. Положение области сохраняется в offset кадра
+        const QRect area = m_useCustomArea ? m_captureArea.intersected(image.rect()) : QRect();
+        if (area.isEmpty()) {
+            result = image.copy();
+        } else {
+            result = image.copy(area);
+            result.setOffset(area.topLeft());
+        }
+    }
+    if (SUCCEEDED(hr)) {
         m_d3dContext->Unmap(m_stagingTexture, 0);
     }
 
@@ -368,14 +412,15 @@ QImage DXWindowCapture::convertToQImage(HBITMAP hBitmap, int width, int height)
         return QImage();
     }
 
-    // Применяем область захвата если установлена
-    if (m_useCustomArea && !m_captureArea.isNull()) {
-        image = image.copy(m_captureArea);
-    }
-
+    // Область захвата не вырезается здесь: она передается в ядра смешивания (getCaptureArea)
     return image;
 }
 
+QRect DXWindowCapture::frameRegion(const QImage &frame, const QRect &area)
+{
+    return area.isNull() ? QRect() : area.translated(-frame.offset());
+}
+
 bool DXWindowCapture::isWindowValid() const
 {
     return m_targetWindow && IsWindow(m_targetWindow);
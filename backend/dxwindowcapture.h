@@ -7,6 +7,10 @@
 #include <QPixmap>
 #include <QRect>
 #include <QDebug>
+#include "backend/framededup.h"
+#include "backend/blendkernels.h"
+#include "backend/framememory.h"
+#include "backend/pipelinetrace.h"
 #include <Windows.h>
 #include <dwmapi.h>
 #include <d3d11.h>
@@ -36,14 +40,28 @@ public:
     QRect getWindowRect() const;
     bool isCapturing() const { return m_timer->isActive(); }
     QImage getLastScreenshot() const { return m_lastScreenshot; }
+    // Кадры DWM и BitBlt не обрезаются: область передается дальше в обработку. Кадр DXGI все равно
+    // копируется из отображенной текстуры - копируется только область, ее положение - QImage::offset()
+    QRect getCaptureArea() const { return m_useCustomArea ? m_captureArea : QRect(); }
+
+    // Отбрасывание кадров, совпадающих с предыдущим (в пределах области захвата)
+    void setDeduplicationEnabled(bool enabled) { m_dedup.setEnabled(enabled); }
+    FrameDeduplicator::Counters dedupCounters() const { return m_dedup.counters(); }
 
 signals:
     void screenshotCaptured(const QImage& screenshot);
+    void duplicateDropped();    // Кадр совпал с предыдущим и дальше не передан
     void imageReady(const QImage& image);
     void captureError(const QString& error);
 
+public:
+    //---------STATIC---------//
+    // Область захвата в координатах кадра (с учетом обрезки кадра DXGI); пустая - весь кадр
+    static QRect frameRegion(const QImage &frame, const QRect &area);
+
 public slots:
     void setCaptureArea(const QRect& area);
+    void setCaptureInterval(int intervalMs);    // Без перезапуска захвата (для CapturePacer)
 
 private slots:
     void captureScreenshot();
@@ -71,6 +89,8 @@ private:
     QRect m_captureArea;
     bool m_useCustomArea;
     QImage m_lastScreenshot;
+    FrameMemory::Tracker m_lastScreenshotMemory{FrameMemory::Capture};
+    FrameDeduplicator m_dedup;
 
     // DirectX объекты
     ID3D11Device* m_d3dDevice;
@@ -0,0 +1,131 @@
+#include "backend/exposurestack.h"
+
+ExposureStack::ExposureStack(FrameMemory::Subsystem subsystem)
+    : m_memory(subsystem)
+{
+}
+
+void ExposureStack::reset(const QSize &size, Mode mode, bool perPixelCounts)
+{
+    m_size = size.isValid() ? size : QSize();
+    m_mode = mode;
+    m_frames = 0;
+
+    const size_t pixels = size_t(qMax(0, m_size.width())) * size_t(qMax(0, m_size.height()));
+    m_sums.assign(pixels * 3, 0);
+    if (mode == SigmaClip) {
+        m_squares.assign(pixels * 3, 0);
+    } else {
+        std::vector<quint32>().swap(m_squares);
+    }
+    if (mode == SigmaClip || perPixelCounts) {
+        m_counts.assign(pixels, 0);
+    } else {
+        std::vector<quint16>().swap(m_counts);
+    }
+
+    m_memory.set(memoryBytes());
+}
+
+void ExposureStack::clear()
+{
+    std::vector<quint32>().swap(m_sums);
+    std::vector<quint32>().swap(m_squares);
+    std::vector<quint16>().swap(m_counts);
+    m_size = QSize();
+    m_frames = 0;
+
+    m_memory.set(0);
+}
+
+qsizetype ExposureStack::memoryBytes() const
+{
+    return qsizetype((m_sums.size() + m_squares.size()) * sizeof(quint32) + m_counts.size() * sizeof(quint16));
+}
+
+StackView ExposureStack::view()
+{
+    StackView view;
+    if (!isValid()) return view;
+
+    const qsizetype plane = qsizetype(m_size.width()) * m_size.height();
+    for (int c = 0; c < 3; ++c) {
+        view.sums[c] = m_sums.data() + c * plane;
+        view.squares[c] = m_squares.empty() ? nullptr : m_squares.data() + c * plane;
+    }
+    view.counts = m_counts.empty() ? nullptr : m_counts.data();
+    view.width = m_size.width();
+    view.height = m_size.height();
+    view.stride = m_size.width();
+    view.countsStride = m_size.width();
+    return view;
+}
+
+StackView ExposureStack::view() const
+{
+    // Представление не владеет данными; render() только читает
+    return const_cast<ExposureStack*>(this)->view();
+}
+
+bool ExposureStack::add(const FrameView &frame, const QPoint &offset, const uchar *mask, qsizetype maskStride)
+{
+    const QRect rect(offset, frame.size());
+    if (!isValid() || !QRect(QPoint(0, 0), m_size).contains(rect)) return false;
+    // Часть стопки без счетчиков испортила бы среднее остальных пикселей
+    if (rect.size() != m_size && m_counts.empty()) return false;
+
+    if (m_frames >= maxFrames) {
+        halve();
+    }
+
+    const StackView target = view().subView(rect);
+    const bool added = (m_mode == SigmaClip)
+                           ? BlendKernels::addToStackClipped(target, frame, m_clipSigma, minClipSigma, mask, maskStride)
+                           : BlendKernels::addToStack(target, frame, mask, maskStride);
+    if (!added) return false;
+
+    ++m_frames;
+    return true;
+}
+
+QImage ExposureStack::render() const
+{
+    if (!isValid()) return QImage();
+
+    QImage image(m_size, QImage::Format_ARGB32);
+    BlendKernels::resolveStack(MutableFrameView::fromImage(image), view(), m_frames);
+    return image;
+}
+
+bool ExposureStack::restore(const QSize &size, Mode mode, const std::vector<quint32> &sums,
+                            const std::vector<quint32> &squares, const std::vector<quint16> &counts, quint32 frames)
+{
+    clear();
+
+    const size_t pixels = size.isValid() ? size_t(size.width()) * size_t(size.height()) : 0;
+    const bool clipped = mode == SigmaClip;
+    if (pixels == 0 || sums.size() != pixels * 3 || frames > maxFrames
+        || squares.size() != (clipped ? pixels * 3 : 0)
+        || (!counts.empty() && counts.size() != pixels) || (clipped && counts.empty())) {
+        return false;
+    }
+
+    m_size = size;
+    m_mode = mode;
+    m_frames = frames;
+    m_sums = sums;
+    m_squares = squares;
+    m_counts = counts;
+
+    m_memory.set(memoryBytes());
+    return true;
+}
+
+void ExposureStack::halve()
+{
+    // Среднее (сумма / число кадров) сохраняется, место под следующие кадры освобождается
+    for (quint32 &sum : m_sums) sum >>= 1;
+    for (quint32 &square : m_squares) square >>= 1;
+    for (quint16 &count : m_counts) count >>= 1;
+    m_frames >>= 1;
+}
@@ -0,0 +1,83 @@
+#ifndef EXPOSURESTACK_H
+#define EXPOSURESTACK_H
+
+#include "backend/blendkernels.h"
+#include "backend/framememory.h"
+
+#include <QImage>
+#include <QPoint>
+#include <QSize>
+
+#include <vector>
+
+// Длинная выдержка: среднее (или среднее с сигма-отсечением) по сотням кадров.
+// Кадры суммируются в плоскости 32 бит на канал (BlendKernels::addToStack), в 8 бит суммы переводятся
+// только в render(). Память зависит только от размера области: 12 байт на пиксель, с отсечением - 26.
+// После maxFrames кадров суммы и счетчики делятся пополам - дальше старые кадры весят меньше новых
+class ExposureStack
+{
+public:
+    enum Mode {
+        Mean,
+        SigmaClip       // Пиксели дальше clipSigma() сигм от среднего не добавляются
+    };
+
+    // Суммы квадратов остаются меньше 2^31: 32767 * 255^2 (ядра переводят их в float как int32)
+    static constexpr quint32 maxFrames = 0x7FFF;
+    static constexpr float defaultClipSigma = 2.5f;
+    static constexpr float minClipSigma = 4.0f;     // Ниже - шум сжатия, не выброс
+
+public:
+    explicit ExposureStack(FrameMemory::Subsystem subsystem = FrameMemory::Sessions);
+
+    // Обнуляет суммы под новый размер. perPixelCounts - число кадров по пикселям (маски, части кадра);
+    // у SigmaClip счетчики есть всегда
+    void reset(const QSize &size, Mode mode = Mean, bool perPixelCounts = false);
+    void clear();
+
+    bool isValid() const { return !m_sums.empty(); }
+    QSize size() const { return m_size; }
+    Mode mode() const { return m_mode; }
+    quint32 frames() const { return m_frames; }
+    qsizetype memoryBytes() const;
+
+    void setClipSigma(float kappa) { m_clipSigma = kappa; }
+    float clipSigma() const { return m_clipSigma; }
+
+    // Представление сумм для обхода снаружи (например, параллельно по полосам)
+    StackView view();
+    StackView view() const;
+
+    // Один кадр. offset - положение frame внутри стопки (часть кадра: нужны счетчики по пикселям),
+    // mask - как у BlendKernels::addToStack
+    bool add(const FrameView &frame, const QPoint &offset = QPoint(), const uchar *mask = nullptr,
+             qsizetype maskStride = 0);
+    // Кадры, добавленные снаружи напрямую через view()
+    void addFrames(quint32 count) { m_frames += count; }
+
+    QImage render() const;
+
+    // Состояние для файла сессии (SessionStore): плоскости как у view(); пустые - их нет в этом режиме
+    const std::vector<quint32>& sums() const { return m_sums; }
+    const std::vector<quint32>& squares() const { return m_squares; }
+    const std::vector<quint16>& counts() const { return m_counts; }
+    // false - плоскости не подходят к size и mode, стопка остается пустой
+    bool restore(const QSize &size, Mode mode, const std::vector<quint32> &sums,
+                 const std::vector<quint32> &squares, const std::vector<quint16> &counts, quint32 frames);
+
+private:
+    void halve();
+
+private:
+    std::vector<quint32> m_sums;        // Плоскости R, G, B подряд
+    std::vector<quint32> m_squares;     // То же для сумм квадратов (SigmaClip)
+    std::vector<quint16> m_counts;
+    QSize m_size;
+    Mode m_mode = Mean;
+    quint32 m_frames = 0;
+    float m_clipSigma = defaultClipSigma;
+
+    FrameMemory::Tracker m_memory;
+};
+
+#endif // EXPOSURESTACK_H
@@ -0,0 +1,244 @@
+#include "backend/framededup.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAMEDEDUP_SSE2
+#endif
+
+namespace {
+
+constexpr quint64 kPrime32_1 = 0x9E3779B1ULL;
+constexpr quint64 kPrime64_1 = 0x9E3779B185EBCA87ULL;
+constexpr quint64 kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr quint64 kPrime64_3 = 0x165667B19E3779F9ULL;
+
+// Ключи для четырех 64-битных дорожек
+alignas(16) constexpr quint64 kKeys[4] = {
+    0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL,
+    0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL
+};
+
+// Шаг ключа от блока к блоку: без него перестановка блоков внутри строки не меняла бы хеш
+alignas(16) constexpr quint64 kKeySteps[4] = {
+    kPrime64_1, kPrime64_2, kPrime64_3, kPrime64_1 ^ kPrime64_2
+};
+
+constexpr int kBlockBytes = 32;
+
+inline quint64 rotl64(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Состояние хеша: 4 дорожки по 64 бита. SSE2 и скалярный варианты дают одинаковый результат
+struct HashState {
+    alignas(16) quint64 acc[4] = {
+        kPrime64_1, kPrime64_2, kPrime64_3, kPrime32_1
+    };
+};
+
+#ifdef FRAMEDEDUP_SSE2
+
+inline __m128i accumulateLanes(__m128i acc, __m128i data, __m128i key)
+{
+    const __m128i dataKey = _mm_xor_si128(data, key);
+    const __m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+    const __m128i product = _mm_mul_epu32(dataKey, dataKeyHi);             // lo32 * hi32
+    const __m128i dataSwap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)); // соседняя дорожка
+    return _mm_add_epi64(_mm_add_epi64(acc, dataSwap), product);
+}
+
+inline __m128i scrambleLanes(__m128i acc, __m128i key)
+{
+    const __m128i prime = _mm_set1_epi32(static_cast<int>(kPrime32_1));
+    acc = _mm_xor_si128(acc, _mm_srli_epi64(acc, 47));
+    acc = _mm_xor_si128(acc, key);
+    const __m128i productLo = _mm_mul_epu32(acc, prime);
+    const __m128i productHi = _mm_mul_epu32(_mm_srli_epi64(acc, 32), prime);
+    return _mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32));
+}
+
+void updateRow(HashState &state, const uchar *data, qsizetype size)
+{
+    const __m128i step0 = _mm_load_si128(reinterpret_cast<const __m128i*>(kKeySteps));
+    const __m128i step1 = _mm_load_si128(reinterpret_cast<const __m128i*>(kKeySteps + 2));
+    const __m128i baseKey0 = _mm_load_si128(reinterpret_cast<const __m128i*>(kKeys));
+    const __m128i baseKey1 = _mm_load_si128(reinterpret_cast<const __m128i*>(kKeys + 2));
+    __m128i key0 = baseKey0;
+    __m128i key1 = baseKey1;
+
+    __m128i acc0 = _mm_load_si128(reinterpret_cast<const __m128i*>(state.acc));
+    __m128i acc1 = _mm_load_si128(reinterpret_cast<const __m128i*>(state.acc + 2));
+
+    qsizetype offset = 0;
+    for (; offset + kBlockBytes <= size; offset += kBlockBytes) {
+        const __m128i data0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+        const __m128i data1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + 16));
+        acc0 = accumulateLanes(acc0, data0, key0);
+        acc1 = accumulateLanes(acc1, data1, key1);
+        key0 = _mm_add_epi64(key0, step0);
+        key1 = _mm_add_epi64(key1, step1);
+    }
+
+    // Хвост строки дополняется нулями до целого блока
+    if (offset < size) {
+        alignas(16) uchar tail[kBlockBytes] = {};
+        memcpy(tail, data + offset, size_t(size - offset));
+        acc0 = accumulateLanes(acc0, _mm_load_si128(reinterpret_cast<const __m128i*>(tail)), key0);
+        acc1 = accumulateLanes(acc1, _mm_load_si128(reinterpret_cast<const __m128i*>(tail + 16)), key1);
+    }
+
+    // Перемешивание в конце каждой строки
+    acc0 = scrambleLanes(acc0, baseKey0);
+    acc1 = scrambleLanes(acc1, baseKey1);
+
+    _mm_store_si128(reinterpret_cast<__m128i*>(state.acc), acc0);
+    _mm_store_si128(reinterpret_cast<__m128i*>(state.acc + 2), acc1);
+}
+
+#else
+
+inline void accumulateBlock(HashState &state, const uchar *block, const quint64 *keys)
+{
+    quint64 data[4];
+    memcpy(data, block, sizeof(data));
+
+    for (int lane = 0; lane < 4; ++lane) {
+        const quint64 dataKey = data[lane] ^ keys[lane];
+        state.acc[lane ^ 1] += data[lane];
+        state.acc[lane] += (dataKey & 0xFFFFFFFFULL) * (dataKey >> 32);
+    }
+}
+
+void updateRow(HashState &state, const uchar *data, qsizetype size)
+{
+    quint64 keys[4] = { kKeys[0], kKeys[1], kKeys[2], kKeys[3] };
+
+    qsizetype offset = 0;
+    for (; offset + kBlockBytes <= size; offset += kBlockBytes) {
+        accumulateBlock(state, data + offset, keys);
+        for (int lane = 0; lane < 4; ++lane) {
+            keys[lane] += kKeySteps[lane];
+        }
+    }
+
+    if (offset < size) {
+        uchar tail[kBlockBytes] = {};
+        memcpy(tail, data + offset, size_t(size - offset));
+        accumulateBlock(state, tail, keys);
+    }
+
+    for (int lane = 0; lane < 4; ++lane) {
+        quint64 acc = state.acc[lane];
+        acc ^= acc >> 47;
+        acc ^= kKeys[lane];
+        state.acc[lane] = acc * kPrime32_1;
+    }
+}
+
+#endif
+
+quint64 finalizeHash(const HashState &state, quint64 seed)
+{
+    quint64 hash = seed * kPrime64_1;
+
+    for (int lane = 0; lane < 4; ++lane) {
+        hash ^= rotl64(state.acc[lane] * kPrime64_2, 31) * kPrime64_1;
+        hash = rotl64(hash, 27) * kPrime64_1 + kPrime64_3;
+    }
+
+    // Финальное лавинное перемешивание (как в XXH64)
+    hash ^= hash >> 33;
+    hash *= kPrime64_2;
+    hash ^= hash >> 29;
+    hash *= kPrime64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+} // namespace
+
+
+FrameDeduplicator::FrameDeduplicator(int rowStep)
+    : m_rowStep(qMax(1, rowStep))
+{
+
+}
+
+bool FrameDeduplicator::isDuplicate(const QImage &frame, const QRect &roi)
+{
+    if (!m_enabled || frame.isNull()) {
+        return false;
+    }
+
+    ++m_counters.framesSeen;
+
+    const QRect area = roi.isNull() ? frame.rect() : roi.intersected(frame.rect());
+    const quint64 hash = fingerprint(frame, area, m_rowStep);
+
+    const qsizetype rowBytes = (qsizetype(area.width()) * frame.depth() + 7) / 8;
+    m_counters.bytesHashed += quint64(rowBytes) * quint64((area.height() + m_rowStep - 1) / m_rowStep);
+
+    const bool duplicate = m_hasLast
+                           && hash == m_lastHash
+                           && area.size() == m_lastSize
+                           && frame.format() == m_lastFormat;
+
+    if (duplicate) {
+        ++m_counters.duplicatesDropped;
+        return true;
+    }
+
+    m_hasLast = true;
+    m_lastHash = hash;
+    m_lastSize = area.size();
+    m_lastFormat = frame.format();
+
+    return false;
+}
+
+void FrameDeduplicator::reset()
+{
+    m_hasLast = false;
+    m_lastHash = 0;
+    m_lastSize = QSize();
+    m_lastFormat = QImage::Format_Invalid;
+}
+
+quint64 FrameDeduplicator::fingerprint(const QImage &frame, const QRect &roi, int rowStep)
+{
+    if (frame.isNull()) {
+        return 0;
+    }
+
+    const QRect area = roi.isNull() ? frame.rect() : roi.intersected(frame.rect());
+    if (area.isEmpty()) {
+        return 0;
+    }
+
+    // Для форматов меньше байта на пиксель хешируем строку целиком
+    const int depth = frame.depth();
+    const qsizetype xOffset = depth >= 8 ? qsizetype(area.x()) * (depth / 8) : 0;
+    const qsizetype rowBytes = depth >= 8 ? qsizetype(area.width()) * (depth / 8) : frame.bytesPerLine();
+
+    HashState state;
+    const int step = qMax(1, rowStep);
+    for (int y = area.top(); y <= area.bottom(); y += step) {
+        updateRow(state, frame.constScanLine(y) + xOffset, rowBytes);
+    }
+
+    const quint64 seed = (quint64(area.width()) << 40) ^ (quint64(area.height()) << 16) ^ quint64(frame.format());
+    return finalizeHash(state, seed);
+}
+
+quint64 FrameDeduplicator::hashBytes(const uchar *data, qsizetype size, quint64 seed)
+{
+    HashState state;
+    if (data && size > 0) {
+        updateRow(state, data, size);
+    }
+    return finalizeHash(state, seed ^ quint64(size));
+}
@@ -0,0 +1,52 @@
+#ifndef FRAMEDEDUP_H
+#define FRAMEDEDUP_H
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+
+// Отбрасывание повторяющихся кадров на входе конвейера.
+// Отпечаток кадра - 64-битный хеш строк (SSE2, шаг накопления как в XXH3),
+// дубликат определяется совпадением отпечатка, размера и формата с предыдущим кадром.
+class FrameDeduplicator
+{
+public:
+    struct Counters {
+        quint64 framesSeen = 0;
+        quint64 duplicatesDropped = 0;
+        quint64 bytesHashed = 0;
+    };
+
+public:
+    // rowStep = 1 - хешируются все строки; N > 1 - каждая N-я (дешевле, но мелкие изменения могут пропускаться)
+    explicit FrameDeduplicator(int rowStep = 1);
+
+    // true - кадр совпадает с предыдущим принятым и должен быть отброшен
+    bool isDuplicate(const QImage &frame, const QRect &roi = QRect());
+    void reset();
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+    void setRowStep(int rowStep) { m_rowStep = qMax(1, rowStep); }
+    int rowStep() const { return m_rowStep; }
+
+    Counters counters() const { return m_counters; }
+    void resetCounters() { m_counters = Counters(); }
+
+    //---------STATIC---------//
+    static quint64 fingerprint(const QImage &frame, const QRect &roi = QRect(), int rowStep = 1);
+    static quint64 hashBytes(const uchar *data, qsizetype size, quint64 seed = 0);
+
+private:
+    bool m_enabled = true;
+    int m_rowStep;
+
+    bool m_hasLast = false;
+    quint64 m_lastHash = 0;
+    QSize m_lastSize;
+    QImage::Format m_lastFormat = QImage::Format_Invalid;
+
+    Counters m_counters;
+};
+
+#endif // FRAMEDEDUP_H
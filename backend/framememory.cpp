@@ -0,0 +1,107 @@
+#include "backend/framememory.h"
+
+#include <QStringList>
+
+FrameMemory::FrameMemory(QObject *parent)
+    : QObject(parent)
+{
+    for (std::atomic<qint64> &usage : m_usage) {
+        usage.store(0);
+    }
+}
+
+FrameMemory* FrameMemory::instance()
+{
+    static FrameMemory memory;
+    return &memory;
+}
+
+void FrameMemory::setBudget(qint64 bytes)
+{
+    m_budget.store(qMax<qint64>(0, bytes));
+
+    if (isOverBudget()) {
+        emit overBudget(total(), budget());
+    }
+}
+
+qint64 FrameMemory::usage(Subsystem subsystem) const
+{
+    if (subsystem < 0 || subsystem >= SubsystemCount) return 0;
+    return m_usage[subsystem].load();
+}
+
+bool FrameMemory::fits(qint64 extraBytes) const
+{
+    const qint64 limit = budget();
+    return limit <= 0 || total() + extraBytes <= limit;
+}
+
+void FrameMemory::add(Subsystem subsystem, qint64 deltaBytes)
+{
+    if (deltaBytes == 0 || subsystem < 0 || subsystem >= SubsystemCount) return;
+
+    m_usage[subsystem].fetch_add(deltaBytes);
+    const qint64 newTotal = m_total.fetch_add(deltaBytes) + deltaBytes;
+
+    qint64 peak = m_peak.load();
+    while (newTotal > peak && !m_peak.compare_exchange_weak(peak, newTotal)) {
+    }
+
+    // Сообщаем только о переходе через границу, а не о каждом кадре сверх бюджета
+    const qint64 limit = budget();
+    if (deltaBytes > 0 && limit > 0 && newTotal > limit && newTotal - deltaBytes <= limit) {
+        emit overBudget(newTotal, limit);
+    }
+}
+
+QString FrameMemory::report() const
+{
+    const double mb = 1024.0 * 1024.0;
+
+    QString text = QString("Кадры: %1 МБ").arg(total() / mb, 0, 'f', 1);
+    if (budget() > 0) {
+        text += QString(" / %1 МБ").arg(budget() / mb, 0, 'f', 0);
+    }
+
+    QStringList parts;
+    for (int i = 0; i < SubsystemCount; ++i) {
+        const qint64 bytes = usage(Subsystem(i));
+        if (bytes > 0) {
+            parts << QString("%1 %2").arg(subsystemName(Subsystem(i))).arg(bytes / mb, 0, 'f', 1);
+        }
+    }
+    if (!parts.isEmpty()) {
+        text += " (" + parts.join(", ") + ")";
+    }
+
+    return text;
+}
+
+QString FrameMemory::subsystemName(Subsystem subsystem)
+{
+    switch (subsystem) {
+        case ImageBuffer:       return "буфер";
+        case Capture:           return "захват";
+        case Sessions:          return "сессии";
+        case KernelScratch:     return "ядра";
+        case Precompute:        return "порог";
+        case Output:            return "вывод";
+        default:                return QString();
+    }
+}
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+void FrameMemory::Tracker::set(qint64 bytes)
+{
+    bytes = qMax<qint64>(0, bytes);
+    if (bytes == m_bytes) return;
+
+    FrameMemory::instance()->add(m_subsystem, bytes - m_bytes);
+    m_bytes = bytes;
+}
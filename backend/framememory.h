@@ -0,0 +1,85 @@
+#ifndef FRAMEMEMORY_H
+#define FRAMEMEMORY_H
+
+#include <QObject>
+#include <QImage>
+#include <QString>
+
+#include <atomic>
+
+// Учет памяти кадров по подсистемам и общий бюджет.
+// Каждая подсистема сообщает, сколько байт кадров она удерживает; при превышении бюджета
+// подсистемы сами решают, что делать (вытеснить кэш, хранить только яркость, не принимать кадры).
+// Кадры QImage разделяются неявно, поэтому общий кадр учитывается каждым держателем:
+// сумма - оценка сверху. Потокобезопасно.
+class FrameMemory : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Subsystem {
+        ImageBuffer = 0,    // Загруженные кадры (Mediator::imageBuffer)
+        Capture,            // Последний кадр захвата
+        Sessions,           // Ожидающий кадр, предыдущий кадр и накопитель сессий
+        KernelScratch,      // Временные копии ядер (конвертация, частичные результаты)
+        Precompute,         // Предрасчет порога (ThresholdCache)
+        Output,             // Изображения в окнах вывода
+        SubsystemCount
+    };
+
+    // Удерживаемый объем одной подсистемы; при удалении снимает свой вклад
+    class Tracker
+    {
+    public:
+        explicit Tracker(Subsystem subsystem) : m_subsystem(subsystem) {}
+        ~Tracker() { set(0); }
+
+        Tracker(const Tracker&) = delete;
+        Tracker& operator=(const Tracker&) = delete;
+
+        void set(qint64 bytes);
+        qint64 bytes() const { return m_bytes; }
+
+    private:
+        Subsystem m_subsystem;
+        qint64 m_bytes = 0;
+    };
+
+public:
+    static FrameMemory* instance();
+
+    // 0 - без ограничения
+    void setBudget(qint64 bytes);
+    qint64 budget() const { return m_budget.load(); }
+
+    qint64 usage(Subsystem subsystem) const;
+    qint64 total() const { return m_total.load(); }
+    qint64 peak() const { return m_peak.load(); }
+
+    // Поместится ли еще extraBytes в бюджет
+    bool fits(qint64 extraBytes) const;
+    bool isOverBudget() const { return !fits(0); }
+
+    void add(Subsystem subsystem, qint64 deltaBytes);
+
+    QString report() const;     // Краткая сводка по подсистемам (МБ)
+
+    //---------STATIC---------//
+    static qint64 imageBytes(const QImage &image) { return image.isNull() ? 0 : qint64(image.sizeInBytes()); }
+    static QString subsystemName(Subsystem subsystem);
+
+signals:
+    // Общий объем впервые превысил бюджет (может прийти из любого потока)
+    void overBudget(qint64 total, qint64 budget);
+
+private:
+    explicit FrameMemory(QObject *parent = nullptr);
+
+private:
+    std::atomic<qint64> m_usage[SubsystemCount];
+    std::atomic<qint64> m_total{0};
+    std::atomic<qint64> m_peak{0};
+    std::atomic<qint64> m_budget{0};
+};
+
+#endif // FRAMEMEMORY_H
@@ -0,0 +1,402 @@
+#include "backend/kernelregistry.h"
+
+#include "backend/blendjob.h"
+#include "backend/framememory.h"
+#include "backend/mediator.h"
+#include "backend/pipelinetrace.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QSysInfo>
+#include <QThread>
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+
+const char *const variantNames[] = {"selected", "scalar", "simd"};
+const char *const pairKernelNames[] = {"maxDiff", "thresholdChannels", "thresholdGray", "thresholdColor", "gradient",
+                                       "perceptual"};
+const char *const methodNames[] = {"Trail", "V2", "V3", "V4", "V4Fast", "Gradient", "Perceptual"};
+
+// Методы реестра по порядку таблиц
+const int registryMethods[] = {ImageBlender::MethodTrail, ImageBlender::MethodV2, ImageBlender::MethodV3,
+                               ImageBlender::MethodV4, ImageBlender::MethodV4Fast, ImageBlender::MethodGradient,
+                               ImageBlender::MethodPerceptual};
+
+// Метод, на котором замеряется парное ядро (по порядку BlendKernels::PairKernel)
+const int pairKernelMethods[] = {ImageBlender::MethodV2, ImageBlender::MethodV3, ImageBlender::MethodV4,
+                                 ImageBlender::MethodV4Fast, ImageBlender::MethodGradient,
+                                 ImageBlender::MethodPerceptual};
+
+bool cancelled(const BlendJobControl *control)
+{
+    return control && control->isCancelled();
+}
+
+bool sameResult(const QImage &a, const QImage &b)
+{
+    if (a.isNull() || b.isNull() || a.size() != b.size()) return false;
+    if (a.format() == b.format()) return a == b;
+
+    return PipelineTrace::convertToFormat(a, QImage::Format_ARGB32)
+           == PipelineTrace::convertToFormat(b, QImage::Format_ARGB32);
+}
+
+// Лучшее время из runs запусков, мс; медленный первый запуск не повторяется
+template <typename Run>
+double measure(Run &&run, int runs = 2)
+{
+    double best = -1.0;
+    for (int i = 0; i < runs; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        run();
+        const double ms = timer.nsecsElapsed() / 1e6;
+        best = best < 0.0 ? ms : qMin(best, ms);
+        if (ms > 1000.0) break;
+    }
+    return best;
+}
+
+} // namespace
+
+
+KernelRegistry* KernelRegistry::instance()
+{
+    static KernelRegistry registry;
+    return &registry;
+}
+
+bool KernelRegistry::load(const QSize &resolution)
+{
+    if (resolution.isEmpty()) return false;
+
+    QSettings settings(settingsPath(), QSettings::IniFormat);
+    settings.beginGroup(settingsGroup(resolution));
+    if (settings.value("version").toInt() != formatVersion) return false;
+
+    Strategy strategies[methodCount];
+    for (int slot = 0; slot < methodCount; ++slot) {
+        const QString name = settings.value(QString("strategy/%1").arg(methodNames[slot])).toString();
+        int index = 0;
+        while (index < StrategyCount && strategyName(Strategy(index)) != name) ++index;
+        if (index == StrategyCount) return false;
+        strategies[slot] = Strategy(index);
+    }
+
+    BlendKernels::KernelVariant variants[BlendKernels::PairKernelCount];
+    for (int kernel = 0; kernel < BlendKernels::PairKernelCount; ++kernel) {
+        const QString name = settings.value(QString("kernel/%1").arg(pairKernelNames[kernel])).toString();
+        if (name == variantNames[int(BlendKernels::KernelVariant::Simd)]) {
+            variants[kernel] = BlendKernels::KernelVariant::Simd;
+        } else if (name == variantNames[int(BlendKernels::KernelVariant::Scalar)]) {
+            variants[kernel] = BlendKernels::KernelVariant::Scalar;
+        } else {
+            return false;
+        }
+    }
+
+    // SIMD мог быть выбран сборкой с другими флагами - selectVariant откатывает его к скалярному
+    QMutexLocker locker(&m_mutex);
+    std::copy(std::begin(strategies), std::end(strategies), m_strategies);
+    for (int kernel = 0; kernel < BlendKernels::PairKernelCount; ++kernel) {
+        BlendKernels::selectVariant(BlendKernels::PairKernel(kernel), variants[kernel]);
+        m_variants[kernel] = BlendKernels::selectedVariant(BlendKernels::PairKernel(kernel));
+    }
+    m_resolution = resolution;
+    m_calibrated = true;
+    m_report = settings.value("report").toString();
+
+    qDebug() << "Kernel registry: loaded" << resolution << "-" << m_report;
+    return true;
+}
+
+bool KernelRegistry::calibrate(const QSize &resolution, const BlendJobControl *control, int frameCount)
+{
+    if (resolution.isEmpty()) return false;
+    PIPELINE_TRACE_SCOPE("kernelCalibration");
+
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+
+    const QVector<QImage> frames = syntheticFrames(resolution, qMax(2, frameCount));
+    QVector<QImage> grayFrames(frames.size());
+    for (int i = 0; i < frames.size(); ++i) {
+        grayFrames[i] = PipelineTrace::convertToFormat(frames[i], QImage::Format_Grayscale8);
+    }
+
+    FrameMemory::Tracker scratchMemory(FrameMemory::KernelScratch);
+    scratchMemory.set(qint64(frames.size()) * resolution.width() * resolution.height() * 5);
+
+    QStringList lines;
+
+    // 1. Парные ядра: все пары кадров одним вариантом, результат SIMD сверяется со скалярным
+    BlendKernels::KernelVariant variants[BlendKernels::PairKernelCount];
+    for (int kernel = 0; kernel < BlendKernels::PairKernelCount; ++kernel) {
+        const int method = pairKernelMethods[kernel];
+        const QVector<QImage> &input = (kernel == BlendKernels::KernelThresholdGray) ? grayFrames : frames;
+
+        auto runKernel = [&](BlendKernels::KernelVariant variant, QImage &result) {
+            return measure([&]() {
+                result = ImageBlender::createAccumulator(resolution);
+                const MutableFrameView resultView = MutableFrameView::fromImage(result);
+                for (int i = 1; i < input.size(); ++i) {
+                    BlendKernels::accumulate(method, resultView, FrameView::fromImage(input[i - 1]),
+                                             FrameView::fromImage(input[i]), calibrationThreshold, variant);
+                }
+            });
+        };
+
+        QImage scalarResult, simdResult;
+        const double scalarMs = runKernel(BlendKernels::KernelVariant::Scalar, scalarResult);
+        variants[kernel] = BlendKernels::KernelVariant::Scalar;
+
+        if (BlendKernels::simdAvailable()) {
+            const double simdMs = runKernel(BlendKernels::KernelVariant::Simd, simdResult);
+            const bool correct = sameResult(simdResult, scalarResult);
+            if (correct && simdMs < scalarMs) variants[kernel] = BlendKernels::KernelVariant::Simd;
+
+            lines << QString("%1: scalar %2 мс, simd %3 мс%4").arg(pairKernelNames[kernel])
+                         .arg(scalarMs, 0, 'f', 2).arg(simdMs, 0, 'f', 2)
+                         .arg(correct ? QString() : QString(" (не совпадает)"));
+        }
+
+        if (cancelled(control)) return false;
+    }
+
+    // Обходы замеряются уже с выбранными ядрами (покадровый обход - тоже через них)
+    BlendKernels::KernelVariant previous[BlendKernels::PairKernelCount];
+    for (int kernel = 0; kernel < BlendKernels::PairKernelCount; ++kernel) {
+        previous[kernel] = BlendKernels::selectedVariant(BlendKernels::PairKernel(kernel));
+        BlendKernels::selectVariant(BlendKernels::PairKernel(kernel), variants[kernel]);
+    }
+    auto restoreVariants = [&]() {
+        for (int kernel = 0; kernel < BlendKernels::PairKernelCount; ++kernel) {
+            BlendKernels::selectVariant(BlendKernels::PairKernel(kernel), previous[kernel]);
+        }
+    };
+
+    // 2. Обходы: покадровый - эталон, остальные принимаются только при совпадении с ним
+    ImageBlender blender;
+    Strategy strategies[methodCount];
+    for (int slot = 0; slot < methodCount; ++slot) {
+        const int method = registryMethods[slot];
+        QImage reference;
+        double bestMs = measure([&]() {
+            reference = run(&blender, StrategySequential, method, frames, calibrationThreshold, QRect(), nullptr);
+        });
+        strategies[slot] = StrategySequential;
+        QString line = QString("%1: %2 %3 мс").arg(methodNames[slot]).arg(strategyName(StrategySequential))
+                           .arg(bestMs, 0, 'f', 2);
+
+        for (int strategy = StrategySequential + 1; strategy < StrategyCount; ++strategy) {
+            if (cancelled(control)) {
+                restoreVariants();
+                return false;
+            }
+
+            QImage result;
+            const double ms = measure([&]() {
+                result = run(&blender, Strategy(strategy), method, frames, calibrationThreshold, QRect(), nullptr);
+            });
+            const bool correct = sameResult(result, reference);
+            if (correct && ms < bestMs) {
+                bestMs = ms;
+                strategies[slot] = Strategy(strategy);
+            }
+
+            line += QString(", %1 %2 мс%3").arg(strategyName(Strategy(strategy))).arg(ms, 0, 'f', 2)
+                        .arg(correct ? QString() : QString(" (не совпадает)"));
+        }
+        lines << line;
+
+        if (cancelled(control)) {
+            restoreVariants();
+            return false;
+        }
+    }
+
+    QStringList choice;
+    for (int slot = 0; slot < methodCount; ++slot) {
+        const int kernel = BlendKernels::pairKernel(registryMethods[slot]);
+        choice << QString("%1 %2/%3").arg(methodNames[slot]).arg(strategyName(strategies[slot]))
+                      .arg(variantNames[int(variants[kernel])]);
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        std::copy(std::begin(strategies), std::end(strategies), m_strategies);
+        std::copy(std::begin(variants), std::end(variants), m_variants);
+        m_resolution = resolution;
+        m_calibrated = true;
+        m_report = choice.join(", ");
+    }
+    save();
+
+    qDebug() << "Kernel registry: calibrated" << resolution << "in" << totalTimer.elapsed() << "ms";
+    for (const QString &line : lines) {
+        qDebug().noquote() << "  " << line;
+    }
+    qDebug().noquote() << "  " << report();
+    return true;
+}
+
+bool KernelRegistry::isCalibrated() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_calibrated;
+}
+
+QSize KernelRegistry::resolution() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_resolution;
+}
+
+KernelRegistry::Strategy KernelRegistry::strategy(int method, int frameCount) const
+{
+    const int slot = methodSlot(method);
+    if (slot < 0) return StrategySequential;
+
+    QMutexLocker locker(&m_mutex);
+    if (m_calibrated) return m_strategies[slot];
+
+    return (method != ImageBlender::MethodTrail && frameCount >= defaultTiledMin) ? StrategyTiled
+                                                                                  : StrategySequential;
+}
+
+QString KernelRegistry::report() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_calibrated ? m_report : QString("не откалиброван");
+}
+
+QImage KernelRegistry::blend(ImageBlender *blender, int method, const QVector<QImage> &images, int threshold,
+                             const QRect &roi, BlendJobControl *control) const
+{
+    return run(blender, strategy(method, int(images.size())), method, images, threshold, roi, control);
+}
+
+QImage KernelRegistry::run(ImageBlender *blender, Strategy strategy, int method, const QVector<QImage> &images,
+                           int threshold, const QRect &roi, BlendJobControl *control)
+{
+    switch (strategy) {
+        case StrategyBatch:     return blender->blendBatch(method, images, threshold, roi, 0, control);
+        case StrategyTiled:     return blender->blendTiled(method, images, threshold, roi, 256 * 1024, control);
+        default:                break;
+    }
+
+    switch (method) {
+        case ImageBlender::MethodTrail:     return blender->differenceBlendTrail(images, roi, control);
+        case ImageBlender::MethodV2:        return blender->differenceBlendTrailV2(images, roi, control);
+        case ImageBlender::MethodV3:        return blender->differenceBlendTrailV3(images, threshold, roi, control);
+        case ImageBlender::MethodV4:        return blender->differenceBlendTrailV4(images, threshold, roi, control);
+        case ImageBlender::MethodV4Fast:    return blender->differenceBlendTrailV4Fast(images, threshold, roi, control);
+        case ImageBlender::MethodGradient:  return blender->differenceBlendGradient(images, threshold, roi, control);
+        case ImageBlender::MethodPerceptual: return blender->differenceBlendPerceptual(images, threshold, roi, control);
+        default:                            return QImage();
+    }
+}
+
+QString KernelRegistry::strategyName(Strategy strategy)
+{
+    switch (strategy) {
+        case StrategySequential:    return "sequential";
+        case StrategyBatch:         return "batch";
+        case StrategyTiled:         return "tiled";
+        default:                    return QString();
+    }
+}
+
+QString KernelRegistry::settingsPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/kernel-registry.ini";
+}
+
+void KernelRegistry::save() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_calibrated) return;
+
+    QDir().mkpath(QFileInfo(settingsPath()).absolutePath());
+    QSettings settings(settingsPath(), QSettings::IniFormat);
+    settings.beginGroup(settingsGroup(m_resolution));
+
+    settings.setValue("version", formatVersion);
+    for (int slot = 0; slot < methodCount; ++slot) {
+        settings.setValue(QString("strategy/%1").arg(methodNames[slot]), strategyName(m_strategies[slot]));
+    }
+    for (int kernel = 0; kernel < BlendKernels::PairKernelCount; ++kernel) {
+        settings.setValue(QString("kernel/%1").arg(pairKernelNames[kernel]), variantNames[int(m_variants[kernel])]);
+    }
+    settings.setValue("report", m_report);
+    settings.endGroup();
+    settings.sync();
+
+    if (settings.status() != QSettings::NoError) {
+        qDebug() << "Kernel registry: failed to save" << settingsPath();
+    }
+}
+
+int KernelRegistry::methodSlot(int method)
+{
+    const auto it = std::find(std::begin(registryMethods), std::end(registryMethods), method);
+    return it == std::end(registryMethods) ? -1 : int(it - std::begin(registryMethods));
+}
+
+QString KernelRegistry::settingsGroup(const QSize &resolution) const
+{
+    // Выбор зависит от процессора, числа потоков и размера кадра (помещается ли он в кэш)
+    return QString("%1-%2t-%3x%4").arg(QSysInfo::currentCpuArchitecture()).arg(QThread::idealThreadCount())
+        .arg(resolution.width()).arg(resolution.height());
+}
+
+QVector<QImage> KernelRegistry::syntheticFrames(const QSize &resolution, int frameCount)
+{
+    QVector<QImage> frames(frameCount);
+    quint32 seed = 0x9E3779B9u;
+
+    for (int i = 0; i < frameCount; ++i) {
+        QImage frame(resolution, QImage::Format_ARGB32);
+
+        for (int y = 0; y < resolution.height(); ++y) {
+            QRgb *line = reinterpret_cast<QRgb*>(frame.scanLine(y));
+            for (int x = 0; x < resolution.width(); ++x) {
+                // Градиент с шумом +-4 (xorshift), как у сжатого видео
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                const int noise = int(seed & 7) - 4;
+                const int base = (x * 255 / qMax(1, resolution.width()) + y * 255 / qMax(1, resolution.height())) / 2;
+                const int value = qBound(0, base + noise, 255);
+                line[x] = qRgb(value, qBound(0, value + noise, 255), qBound(0, 255 - value, 255));
+            }
+        }
+
+        // Движущиеся прямоугольники: настоящие изменения выше любого разумного порога
+        const int size = qMax(1, qMin(resolution.width(), resolution.height()) / 8);
+        for (int object = 0; object < 4; ++object) {
+            const int x = (resolution.width() / 5 * object + i * size / 2) % qMax(1, resolution.width() - size);
+            const int y = (resolution.height() / 4 + object * size + i * size / 3) % qMax(1, resolution.height() - size);
+            const QRgb color = qRgb(64 * object, 255 - 48 * object, (96 + 40 * object) & 0xFF);
+
+            for (int row = y; row < qMin(y + size, resolution.height()); ++row) {
+                QRgb *line = reinterpret_cast<QRgb*>(frame.scanLine(row));
+                std::fill(line + x, line + qMin(x + size, resolution.width()), color);
+            }
+        }
+
+        frames[i] = frame;
+    }
+
+    return frames;
+}
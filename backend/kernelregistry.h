@@ -0,0 +1,87 @@
+#ifndef KERNELREGISTRY_H
+#define KERNELREGISTRY_H
+
+#include "backend/blendkernels.h"
+
+#include <QImage>
+#include <QMutex>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+class BlendJobControl;
+class ImageBlender;
+
+// Реестр реализаций смешивания по методу (ImageBlender::BlendMethod: MethodTrail..MethodV4Fast, MethodGradient, MethodPerceptual).
+// Выбор двухуровневый:
+//  - парное ядро шага (BlendKernels::PairKernel): скалярное или SIMD;
+//  - обход последовательности: покадровый, отрезками на ядрах (blendBatch) или плитками (blendTiled).
+// Калибровка прогоняет все варианты на синтетических кадрах заданного разрешения, сверяет результат
+// с покадровым обходом и берет самый быстрый из совпавших. Выбор сохраняется на диск для пары
+// "машина + разрешение", следующий запуск читает его без калибровки
+class KernelRegistry
+{
+public:
+    enum Strategy {
+        StrategySequential = 0,     // differenceBlendTrail* - эталон
+        StrategyBatch,              // ImageBlender::blendBatch
+        StrategyTiled,              // ImageBlender::blendTiled
+        StrategyCount
+    };
+
+    static constexpr int methodCount = 7;   // Без тепловой карты - она считается отдельно
+
+public:
+    static KernelRegistry* instance();
+
+    // Сохраненный выбор для этой машины и разрешения; false - калибровки еще не было
+    bool load(const QSize &resolution);
+
+    // Из потока задачи (BlendJobRunner): другие смешивания в это время не идут и не искажают замеры.
+    // Отмена проверяется между замерами; отмененная калибровка ничего не меняет и не сохраняется
+    bool calibrate(const QSize &resolution, const BlendJobControl *control = nullptr, int frameCount = 6);
+
+    bool isCalibrated() const;
+    QSize resolution() const;
+    Strategy strategy(int method, int frameCount) const;
+    QString report() const;     // Выбор по методам, для строки состояния и лога
+
+    // Смешивание выбранной для метода реализацией. Без калибровки - прежнее правило:
+    // плитками с defaultTiledMin кадров (кроме MethodTrail), иначе покадрово
+    QImage blend(ImageBlender *blender, int method, const QVector<QImage> &images, int threshold,
+                 const QRect &roi = QRect(), BlendJobControl *control = nullptr) const;
+
+    //---------STATIC---------//
+    static QImage run(ImageBlender *blender, Strategy strategy, int method, const QVector<QImage> &images,
+                      int threshold, const QRect &roi, BlendJobControl *control);
+    static QString strategyName(Strategy strategy);
+    static QString settingsPath();
+
+private:
+    KernelRegistry() = default;
+
+    void save() const;
+    QString settingsGroup(const QSize &resolution) const;
+
+    // Индекс метода в таблицах реестра; -1 - метод не выбирается реестром
+    static int methodSlot(int method);
+
+    // Кадры: зашумленный фон и несколько движущихся прямоугольников - для пороговых методов
+    // есть и шум ниже порога, и настоящие изменения
+    static QVector<QImage> syntheticFrames(const QSize &resolution, int frameCount);
+
+private:
+    static constexpr int formatVersion = 3;     // Смена набора вариантов - сброс сохраненного выбора
+    static constexpr int defaultTiledMin = 16;
+    static constexpr int calibrationThreshold = 15;
+
+    mutable QMutex m_mutex;
+    bool m_calibrated = false;
+    QSize m_resolution;
+    Strategy m_strategies[methodCount] = {};
+    BlendKernels::KernelVariant m_variants[BlendKernels::PairKernelCount] = {};
+    QString m_report;
+};
+
+#endif // KERNELREGISTRY_H
@@ -1,90 +1,680 @@
 #include <backend/mediator.h>
+#include "backend/parallelfor.h"
 
 Mediator::Mediator(QObject *parent) : QObject(parent)
 {
     imgBlender = new ImageBlender(this);
     windowSelecter = new WindowSelecter(this);
-    capture = new DXWindowCapture(this);
+    workerPool = new BlendWorkerPool(QThread::idealThreadCount(), this);
     processOutput = new ProcessOutput();
+    resultPublisher = new ResultPublisher();
+    blendJobs = new BlendJobRunner(this);
+
+    // Промежуточные результаты фонового смешивания приходят уже в потоке GUI
+    connect(blendJobs, &BlendJobRunner::partialReady, this, &Mediator::showJobResult);
+    connect(blendJobs, &BlendJobRunner::progressChanged, this, &Mediator::blendProgress);
+
+    // Сигнал может прийти из потока пула - обрабатываем в своем потоке
+    FrameMemory::instance()->setBudget(defaultMemoryBudget);
+    connect(FrameMemory::instance(), &FrameMemory::overBudget, this, [=](qint64 total, qint64 budget){
+        qDebug() << "Frame memory over budget:" << total / (1024 * 1024) << "/" << budget / (1024 * 1024) << "MB";
+        reclaimMemory(0);
+    }, Qt::QueuedConnection);
 
     windowSelecter->scanAvaliableWindows();
     QList<WindowSelecter::WinInfo> avaliableWindows = windowSelecter->getAvaliableList();
 
-    capture->initCapture(avaliableWindows[1].id);
-    capture->startCapture(16);
+    if (avaliableWindows.size() > 1) {
+        primarySession = addSession(avaliableWindows[1].id, captureArea, ImageBlender::MethodV4Fast, threshold, 16);
+    }
 
     connect(this, &Mediator::imageDataLoaded, this, [=](){
-        QImage result = imgBlender->differenceBlendTrailV4Fast(imageBuffer, threshold);
-        imgBlender->showResult(result);
+        processStoredImages(ImageBlender::MethodV4Fast);
     });
 
-    connect(capture, &DXWindowCapture::screenshotCaptured, processOutput, &ProcessOutput::updateImageData);
-    //connect(processOutput, &ProcessOutput::captureAreaChanged, capture, &DXWindowCapture::setCaptureArea);
+    // Накопление основной сессии переживает перезапуск: продолжается из файла состояния
+    if (primarySession) {
+        primarySession->setPersistence(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+                                       + "/primary-session.state");
+    }
+
+    // Кадр приходит целиком, область захвата применяется без копирования
+    if (primarySession) {
+        connect(primarySession, &BlendSession::frameCaptured, processOutput, [=](const QImage &screenshot){
+            processOutput->updateImageData(ImageBlender::regionView(
+                screenshot, DXWindowCapture::frameRegion(screenshot, primarySession->region())));
+        });
+
+        // Публикация в потоке пула сразу после накопления: только копирование в слот, читатели не ждут
+        connect(primarySession, &BlendSession::resultUpdated, this, [=](const QImage &result){
+            resultPublisher->publish(result);
+        }, Qt::DirectConnection);
+
+        // Сигнал из потока пула - в поток GUI очередью
+        connect(primarySession, &BlendSession::sceneCut, this, [=](quint64 frameIndex, double changedFraction){
+            qDebug() << "Scene cut at frame" << frameIndex << ", changed" << changedFraction;
+            emit sceneCutDetected(frameIndex);
+        });
+    }
+    connect(processOutput, &ProcessOutput::captureAreaChanged, this, &Mediator::changeCaptureArea);
+
+    // Выбор реализаций ядер сохранен для этой машины и разрешения - калибровка не нужна.
+    // Иначе калибруем после запуска сессий: на время замеров они приостанавливаются
+    if (!KernelRegistry::instance()->load(calibrationSize())) {
+        calibrateKernels();
+    }
 }
 
 Mediator::~Mediator()
 {
+    // Фоновое смешивание использует imgBlender - дожидаемся выхода задачи до удаления
+    delete blendJobs;
+
+    // Сессии удаляются до пула: каждая дожидается своей задачи
+    qDeleteAll(sessions);
+    sessions.clear();
+    const QList<ProcessOutput*> outputs = sourceOutputs.values();
+    sourceOutputs.clear();
+    qDeleteAll(outputs);
+
     delete imgBlender;
     delete windowSelecter;
-    delete capture;
+    delete workerPool;
     delete processOutput;
+    delete resultPublisher;
 }
 
-void Mediator::loadImagesToBuffer()
+BlendSession* Mediator::addSession(HWND window, const QRect &roi, int method, int threshold, int intervalMs)
 {
-    imageBuffer.clear();
+    BlendSession *session = new BlendSession(workerPool, this);
+    session->setRegion(roi);
+    session->setMethod(method);
+    session->setThreshold(threshold);
+    session->setMotionCompensation(motionCompensation);
+    session->setSceneCutFraction(sceneCutFraction);
+
+    if (!session->start(window, intervalMs)) {
+        qDebug() << "Failed to start session for window:" << window;
+        delete session;
+        return nullptr;
+    }
+
+    sessions.append(session);
+    if (sessionPauses > 0) {
+        session->stop();
+    }
+    return session;
+}
+
+void Mediator::removeSession(BlendSession *session)
+{
+    if (!sessions.removeOne(session)) {
+        return;
+    }
+
+    if (session == primarySession) {
+        primarySession = nullptr;
+    }
+
+    delete session;
+    delete sourceOutputs.take(session);
+}
+
+void Mediator::addSourceWindow()
+{
+    windowSelecter->scanAvaliableWindows();
+    const QList<WindowSelecter::WinInfo> avaliableWindows = windowSelecter->getAvaliableList();
+    if (avaliableWindows.isEmpty()) return;
+
+    QStringList titles;
+    for (const WindowSelecter::WinInfo &info : avaliableWindows) {
+        titles.append(info.title);
+    }
+
+    bool accepted = false;
+    const QString title = QInputDialog::getItem(nullptr, "Новый источник", "Окно:", titles, 0, false, &accepted);
+    if (!accepted) return;
+    const WindowSelecter::WinInfo &info = avaliableWindows[titles.indexOf(title)];
+
+    const int method = primarySession ? primarySession->method() : int(ImageBlender::MethodV4Fast);
+    BlendSession *session = addSession(info.id, QRect(), method, threshold, 16);
+    if (!session) return;
+
+    // Результат сессии - в своем окне; закрытие окна останавливает источник
+    ProcessOutput *output = new ProcessOutput();
+    output->setAttribute(Qt::WA_DeleteOnClose);
+    output->setWindowTitle(info.title);
+    sourceOutputs.insert(session, output);
+
+    // Сигнал из потока пула - в поток окна очередью
+    connect(session, &BlendSession::resultUpdated, output, &ProcessOutput::updateImageData);
+    connect(output, &QObject::destroyed, this, [=](){
+        sourceOutputs.remove(session);
+        removeSession(session);
+    });
+}
+
+QString Mediator::sessionReport() const
+{
+    QStringList parts;
+    for (int i = 0; i < sessions.size(); ++i) {
+        const BlendSession::Stats stats = sessions[i]->stats();
+        parts.append(QString("Источник %1: %2 к/с, %3 мс, пропущено %4, повторов %5")
+                         .arg(i + 1)
+                         .arg(stats.fps, 0, 'f', 1)
+                         .arg(stats.avgLatencyMs, 0, 'f', 1)
+                         .arg(stats.droppedFrames + stats.refusedFrames)
+                         .arg(stats.duplicateFrames));
+    }
+    return parts.join(" | ");
+}
 
+void Mediator::loadImagesToBuffer()
+{
     QStringList fileNames = QFileDialog::getOpenFileNames(
         nullptr, "Select one or more images", QDir::homePath(),
         "Images (*.png *.jpg *.jpeg *.bmp *.gif)");
 
-    foreach (const QString &fileName, fileNames) {
-        QImage image(fileName);
-        if (!image.isNull()) {
-            imageBuffer.append(image);
-        } else {
-            qDebug() << "Failed to load image:" << fileName;
-        }
+    loadFiles(fileNames);
+}
+
+void Mediator::loadImagesToBuffer(const QList<QUrl> &list)
+{
+    QStringList filePaths;
+    foreach (const QUrl &fileUrl, list) {
+        filePaths.append(fileUrl.toLocalFile()); // Преобразуем QUrl в путь
     }
 
-    emit imageDataLoaded();
+    loadFiles(filePaths);
 }
 
-void Mediator::loadImagesToBuffer(const QList<QUrl> &list)
+void Mediator::loadFiles(const QStringList &paths)
 {
+    blendJobs->cancel();
+    pendingCacheMethod = -1;
     imageBuffer.clear();
+    bufferRepeats.clear();
+    thresholdCache.clear();
+    lumaOnlyBuffer = false;
+    loadedPaths = paths;
+    updateBufferMemory();
+    loadDedup.reset();
+    loadDedup.resetCounters();
 
-    foreach (const QUrl &fileUrl, list) {
-        QString filePath = fileUrl.toLocalFile(); // Преобразуем QUrl в путь
-        QImage image;
-        if (image.load(filePath)) { // Используем load() для загрузки
+    QElapsedTimer timer;
+    timer.start();
+    QSize firstSourceSize;
+
+    // Файлы декодируются параллельно порциями (сразу с обрезкой и уменьшением),
+    // чтобы не держать в памяти все декодированные кадры до проверки бюджета
+    const int batchSize = qMax(1, QThread::idealThreadCount());
+    int refused = 0;
+
+    for (int batchStart = 0; batchStart < paths.size() && refused == 0; batchStart += batchSize) {
+        const int count = qMin(batchSize, int(paths.size()) - batchStart);
+        QVector<QImage> decoded(count);
+        QVector<QSize> sourceSizes(count);
+        parallelFor(count, [&](int index) {
+            decoded[index] = decodeImage(paths[batchStart + index], captureArea, decodeLimit, &sourceSizes[index]);
+        });
+
+        for (int i = 0; i < count; ++i) {
+            QImage image = decoded[i];
+            decoded[i] = QImage();
+            if (image.isNull()) {
+                qDebug() << "Failed to load image:" << paths[batchStart + i];
+                continue;
+            }
+
+            // Повторяющиеся подряд кадры не влияют на разность - не храним их, но выдержке нужен их вес
+            if (loadDedup.isDuplicate(image)) {
+                if (!bufferRepeats.isEmpty()) {
+                    ++bufferRepeats.last();
+                }
+                continue;
+            }
+
+            // Понижение до яркости без сохраненных кадров снимается, как только цветной кадр снова помещается
+            if (lumaOnlyBuffer && imageBuffer.isEmpty() && FrameMemory::instance()->fits(FrameMemory::imageBytes(image))) {
+                lumaOnlyBuffer = false;
+            }
+            if (lumaOnlyBuffer) {
+                image = PipelineTrace::convertToFormat(image, QImage::Format_Grayscale8);
+            }
+
+            const qint64 bytes = FrameMemory::imageBytes(image);
+            if (!FrameMemory::instance()->fits(bytes) && !reclaimMemory(bytes)) {
+                refused = int(paths.size()) - (batchStart + i);
+                break;
+            }
+            if (lumaOnlyBuffer && image.format() != QImage::Format_Grayscale8) {
+                image = PipelineTrace::convertToFormat(image, QImage::Format_Grayscale8);
+            }
+
+            // Масштаб - по первому принятому кадру: файлы до него могли не прочитаться или быть отброшены
+            if (imageBuffer.isEmpty()) {
+                firstSourceSize = sourceSizes[i];
+            }
             imageBuffer.append(image);
-        } else {
-            qDebug() << "Failed to load image:" << filePath;
+            bufferRepeats.append(0);
+            bufferMemory.set(bufferMemory.bytes() + FrameMemory::imageBytes(image));
         }
     }
 
+    if (refused > 0) {
+        qDebug() << "Frame memory budget exhausted, files not loaded:" << refused;
+    }
+
+    // Запоминаем, как кадры были уменьшены, чтобы пересчитывать область для ядер
+    loadedClip = captureArea;
+    loadedScale = QSizeF(1.0, 1.0);
+    if (!imageBuffer.isEmpty() && firstSourceSize.isValid() && !firstSourceSize.isEmpty()) {
+        loadedScale = QSizeF(double(imageBuffer.first().width()) / firstSourceSize.width(),
+                             double(imageBuffer.first().height()) / firstSourceSize.height());
+    }
+
+    qDebug() << "Loaded" << imageBuffer.size() << "frames in" << timer.elapsed() << "ms,"
+             << "duplicate frames dropped:" << loadDedup.counters().duplicatesDropped;
+
     emit imageDataLoaded();
 }
 
+QImage Mediator::decodeImage(const QString &path, const QRect &clip, const QSize &maxSize, QSize *sourceSize)
+{
+    QImageReader reader(path);
+
+    const QSize fullSize = reader.size();
+    QSize targetSize = fullSize;
+
+    // Декодер читает только нужную область (JPEG - без распаковки остальных блоков);
+    // если формат не умеет обрезку, QImageReader применит ее после чтения
+    if (!clip.isNull() && fullSize.isValid()) {
+        const QRect area = clip.intersected(QRect(QPoint(0, 0), fullSize));
+        if (!area.isEmpty()) {
+            reader.setClipRect(area);
+            targetSize = area.size();
+        }
+    }
+
+    // Уменьшение при декодировании (для JPEG - масштабирование DCT, в разы дешевле полного)
+    if (maxSize.isValid() && !maxSize.isEmpty() && targetSize.isValid()
+        && (targetSize.width() > maxSize.width() || targetSize.height() > maxSize.height())) {
+        reader.setScaledSize(targetSize.scaled(maxSize, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qDebug() << "Decode error:" << path << reader.errorString();
+    }
+    if (sourceSize) {
+        // Формат без размера в заголовке: уменьшения не было, размер - у самого кадра
+        *sourceSize = targetSize.isValid() ? targetSize : image.size();
+    }
+
+    return image;
+}
+
+QRect Mediator::bufferRegion() const
+{
+    // Кадры уже обрезаны по текущей области (или область не задана) - обрабатываем целиком
+    if (captureArea.isNull() || captureArea == loadedClip) {
+        return QRect();
+    }
+
+    // Область сменилась после загрузки: переводим в координаты обрезанных и уменьшенных кадров
+    const QRect source = loadedClip.isNull() ? captureArea : captureArea.translated(-loadedClip.topLeft());
+    return QRect(qFloor(source.x() * loadedScale.width()),
+                 qFloor(source.y() * loadedScale.height()),
+                 qCeil(source.width() * loadedScale.width()),
+                 qCeil(source.height() * loadedScale.height()));
+}
+
 void Mediator::processStoredImages(int mode)
 {
-    QImage result;
-    switch (mode) {
-        case 0: result = imgBlender->differenceBlendTrail(imageBuffer); break;
-        case 1: result = imgBlender->differenceBlendTrailV2(imageBuffer); break;
-        case 2: result = imgBlender->differenceBlendTrailV3(imageBuffer, threshold); break;
-        case 3: result = imgBlender->differenceBlendTrailV4(imageBuffer, threshold); break;
-        case 4: result = imgBlender->differenceBlendTrailV4Fast(imageBuffer, threshold); break;
-        default:    break;
+    shownMethod = mode;
+    jobResultShown = false;     // Первый результат нового запроса - в новом окне
+
+    // Готовый предрасчет порога: только отрисовка, без фоновой задачи
+    if (ThresholdCache::supports(mode) && !motionCompensation
+        && thresholdCache.isValid() && thresholdCache.method() == mode) {
+        blendJobs->cancel();
+        pendingCacheMethod = -1;
+        showJobResult(thresholdCache.render(threshold));
+        return;
+    }
+
+    submitBlend(mode);
+}
+
+void Mediator::submitBlend(int mode)
+{
+    // Задача получает копии параметров и кадров (QImage разделяются неявно, без копирования данных),
+    // поэтому поток GUI может менять их, пока она идет
+    const QVector<QImage> images = imageBuffer;
+    const QVector<quint32> repeats = bufferRepeats;
+    const int requestThreshold = threshold;
+    const QRect region = bufferRegion();
+    const bool compensate = motionCompensation;
+    const bool wide = !images.isEmpty() && ImageBlender::isWideFrame(images.first());
+    const bool useCache = ThresholdCache::supports(mode) && !compensate && !wide;
+    ImageBlender *blender = imgBlender;
+
+    pendingCacheMethod = useCache ? mode : -1;
+
+    // Кадры другого размера: берем сохраненный для него выбор, если он есть
+    KernelRegistry *registry = KernelRegistry::instance();
+    if (!images.isEmpty() && registry->resolution() != calibrationSize()) {
+        registry->load(calibrationSize());
+    }
+
+    blendJobs->submit([=](BlendJobControl &control) -> BlendJobRunner::Completion {
+        if (mode == ImageBlender::MethodHeatmap) {
+            const QImage result = blender->blendHeatmap(images, requestThreshold, region, &control);
+            return [=]() { finishBlend(result, requestThreshold); };
+        }
+        if (mode == ImageBlender::MethodExposure || mode == ImageBlender::MethodExposureClipped) {
+            const QImage result = blender->blendExposure(mode, images, region, &control, repeats);
+            return [=]() { finishBlend(result, requestThreshold); };
+        }
+
+        // Сдвиг оценивается для каждой пары; плиточный обход и предрасчет порога его не поддерживают
+        if (compensate) {
+            const QImage result = blender->blendCompensated(mode, images, requestThreshold, region, &control);
+            return [=]() { finishBlend(result, requestThreshold); };
+        }
+
+        // 16-битные PNG/TIFF: разность без потери точности, в 8 бит - только при показе
+        if (wide) {
+            const QImage result = blender->blendWide(mode, images, requestThreshold, region, &control);
+            return [=]() { finishBlend(result, requestThreshold); };
+        }
+
+        // Пороговые методы: кадры проходятся один раз, смена порога - только отрисовка.
+        // Предрасчет строится отдельно от текущего и подменяет его в потоке GUI
+        if (useCache) {
+            auto cache = std::make_shared<ThresholdCache>();
+            if (blender->buildThresholdCache(*cache, mode, images, region, &control)) {
+                // Предрасчет не поместился в бюджет - считаем напрямую, без кэша
+                if (!FrameMemory::instance()->isOverBudget()) {
+                    return [=]() { finishThresholdCache(*cache); };
+                }
+                qDebug() << "Frame memory: threshold cache does not fit the budget";
+                cache->clear();
+            }
+            if (control.isCancelled()) return {};
+        }
+
+        // Покадрово, отрезками или плитками - что быстрее на этой машине (результат тот же)
+        const QImage result = KernelRegistry::instance()->blend(blender, mode, images, requestThreshold,
+                                                                region, &control);
+        return [=]() { finishBlend(result, requestThreshold); };
+    });
+}
+
+void Mediator::calibrateKernels()
+{
+    // Калибровка идет задачей BlendJobRunner: замеры не пересекаются со смешиванием,
+    // а новый запрос смешивания ее отменяет (выбор остается прежним)
+    const QSize size = calibrationSize();
+    pendingCacheMethod = -1;
+
+    // Живые сессии делят с замерами ядра процессора и искажают время - останавливаем их захват.
+    // Захват возобновляется, когда задача калибровки уничтожена: выполнена, отменена или вытеснена в очереди
+    pauseSessions();
+    const std::shared_ptr<void> resumeGuard(nullptr, [this](void*) {
+        QMetaObject::invokeMethod(this, &Mediator::resumeSessions, Qt::QueuedConnection);
+    });
+
+    blendJobs->submit([=](BlendJobControl &control) -> BlendJobRunner::Completion {
+        Q_UNUSED(resumeGuard);
+        if (!KernelRegistry::instance()->calibrate(size, &control)) return {};
+
+        const QString report = KernelRegistry::instance()->report();
+        return [=]() { emit kernelsCalibrated(report); };
+    });
+}
+
+void Mediator::pauseSessions()
+{
+    if (sessionPauses++ > 0) {
+        return;
+    }
+    for (BlendSession *session : std::as_const(sessions)) {
+        session->stop();
+    }
+}
+
+void Mediator::resumeSessions()
+{
+    // Калибровку могли запустить повторно - сессии ждут последнюю
+    if (sessionPauses == 0 || --sessionPauses > 0) {
+        return;
+    }
+    for (BlendSession *session : std::as_const(sessions)) {
+        session->resume();
+    }
+}
+
+QSize Mediator::calibrationSize() const
+{
+    if (!imageBuffer.isEmpty()) {
+        const QRect region = bufferRegion();
+        return region.isNull() ? imageBuffer.first().size() : region.size();
     }
+    if (!captureArea.isNull()) {
+        return captureArea.size();
+    }
+
+    const QScreen *screen = QGuiApplication::primaryScreen();
+    return screen ? screen->size() * screen->devicePixelRatio() : QSize(1920, 1080);
+}
+
+void Mediator::finishBlend(const QImage &result, int requestThreshold)
+{
+    pendingCacheMethod = -1;
+    emit blendProgress(1, 1);
+
+    // Порог сменился, пока строился не поместившийся в бюджет предрасчет - пересчитываем
+    if (requestThreshold != threshold && ImageBlender::usesThreshold(shownMethod)) {
+        submitBlend(shownMethod);
+    }
+
+    showJobResult(result);
+}
+
+void Mediator::finishThresholdCache(ThresholdCache &cache)
+{
+    pendingCacheMethod = -1;
+    emit blendProgress(1, 1);
+    thresholdCache.swap(cache);
+
+    // Гистограмма собрана тем же проходом, что и кэш
+    const int suggested = suggestThreshold();
+    emit thresholdSuggested(suggested);
 
-    imgBlender->showResult(result);
+    if (autoThresholdMode != AutoThresholdOff && suggested != threshold) {
+        threshold = suggested;
+        emit thresholdApplied(suggested);
+    }
+
+    showJobResult(thresholdCache.render(threshold));
+}
+
+void Mediator::showJobResult(const QImage &result)
+{
+    if (result.isNull()) return;
+
+    // Промежуточные и итоговый результаты одного запроса обновляют одно окно
+    if (jobResultShown) {
+        imgBlender->showPreview(result);
+    } else {
+        imgBlender->showResult(result);
+        jobResultShown = true;
+    }
 }
 
 void Mediator::chagneThreadhold(int value)
 {
     threshold = value;
+
+    if (primarySession) {
+        primarySession->setThreshold(value);
+    }
+
+    // Результат загруженных кадров обновляется сразу, без повторного смешивания
+    if (thresholdCache.isValid() && thresholdCache.method() == shownMethod && !motionCompensation) {
+        imgBlender->showPreview(thresholdCache.render(value));
+        return;
+    }
+
+    // Без предрасчета - пересчет в фоне; новый порог вытесняет задачу со старым.
+    // Строящийся предрасчет от порога не зависит - его дожидаемся
+    if (ImageBlender::usesThreshold(shownMethod) && !imageBuffer.isEmpty() && pendingCacheMethod != shownMethod) {
+        submitBlend(shownMethod);
+    }
+}
+
+void Mediator::changeMotionCompensation(bool enabled)
+{
+    motionCompensation = enabled;
+
+    for (BlendSession *session : sessions) {
+        session->setMotionCompensation(enabled);
+    }
+}
+
+void Mediator::changeSceneCutPercent(int percent)
+{
+    sceneCutFraction = qBound(0, percent, 100) / 100.0;
+
+    for (BlendSession *session : sessions) {
+        session->setSceneCutFraction(sceneCutFraction);
+    }
+}
+
+void Mediator::changeResultPublishing(bool enabled)
+{
+    resultPublisher->setEnabled(enabled);
+}
+
+void Mediator::changeTracing(bool enabled)
+{
+    // Новая запись начинается с чистой трассы
+    if (enabled) {
+        PipelineTrace::instance()->clear();
+    }
+    PipelineTrace::setEnabled(enabled);
+}
+
+void Mediator::saveTrace()
+{
+    QString fileName = QFileDialog::getSaveFileName(
+        nullptr, "Save pipeline trace", QDir::homePath() + "/pipeline-trace.json",
+        "Trace (*.json)");
+    if (fileName.isEmpty()) return;
+
+    if (!PipelineTrace::instance()->exportJson(fileName)) {
+        qDebug() << "Failed to save trace:" << fileName;
+        return;
+    }
+    qDebug() << "Trace saved:" << fileName << "," << PipelineTrace::instance()->eventCount() << "events";
+}
+
+void Mediator::changeMemoryBudget(qint64 bytes)
+{
+    FrameMemory *memory = FrameMemory::instance();
+    memory->setBudget(bytes);
+
+    // Кадры хранились яркостью из-за бюджета: если цветные (в 4 раза больше) теперь помещаются -
+    // перечитываем файлы, иначе понижение остается до следующей загрузки
+    if (lumaOnlyBuffer && !imageBuffer.isEmpty() && !loadedPaths.isEmpty()
+        && memory->fits(bufferMemory.bytes() * 3)) {
+        qDebug() << "Frame memory: budget allows color frames again, reloading" << loadedPaths.size() << "files";
+        loadFiles(loadedPaths);
+        return;
+    }
+    if (lumaOnlyBuffer && imageBuffer.isEmpty() && memory->fits(0)) {
+        lumaOnlyBuffer = false;
+    }
+    reclaimMemory(0);
+}
+
+bool Mediator::reclaimMemory(qint64 neededBytes)
+{
+    FrameMemory *memory = FrameMemory::instance();
+
+    // 1. Предрасчет порога восстанавливается по кадрам
+    if (!memory->fits(neededBytes) && thresholdCache.isValid()) {
+        qDebug() << "Frame memory: evicting threshold cache," << thresholdCache.memoryBytes() / 1024 << "KB";
+        thresholdCache.clear();
+    }
+
+    // 2. Загруженные кадры храним только яркостью (в 4 раза меньше для 32-битных кадров)
+    if (!memory->fits(neededBytes) && !lumaOnlyBuffer && !imageBuffer.isEmpty()) {
+        qDebug() << "Frame memory: downgrading" << imageBuffer.size() << "buffered frames to luma";
+        lumaOnlyBuffer = true;
+        for (QImage &image : imageBuffer) {
+            image = PipelineTrace::convertToFormat(image, QImage::Format_Grayscale8);
+        }
+        updateBufferMemory();
+    } else if (!memory->fits(neededBytes)) {
+        lumaOnlyBuffer = true;  // Следующие кадры сразу в яркости
+    }
+
+    // 3. Дальше - отказ в новых кадрах (решает вызывающий)
+    return memory->fits(neededBytes);
+}
+
+void Mediator::updateBufferMemory()
+{
+    qint64 bytes = 0;
+    for (const QImage &image : imageBuffer) {
+        bytes += FrameMemory::imageBytes(image);
+    }
+    bufferMemory.set(bytes);
+}
+
+void Mediator::changeAutoThreshold(int mode)
+{
+    autoThresholdMode = mode;
+
+    if (autoThresholdMode != AutoThresholdOff && thresholdCache.isValid()) {
+        const int suggested = suggestThreshold();
+        emit thresholdSuggested(suggested);
+        emit thresholdApplied(suggested);
+        chagneThreadhold(suggested);
+    }
+}
+
+int Mediator::suggestThreshold() const
+{
+    const DiffHistogram &histogram = thresholdCache.histogram();
+    const int otsu = histogram.otsuThreshold();
+
+    // Уровень шума ищется только в нижнем классе Оцу: разности движения его не завышают
+    int suggested = otsu;
+    if (autoThresholdMode == AutoThresholdNoiseFloor) {
+        suggested = histogram.percentile(noiseFloorPercentile, otsu > 0 ? otsu : 255);
+    }
+    return qBound(minSuggestedThreshold, suggested, maxSuggestedThreshold);
+}
+
+void Mediator::changeDecodeLimit(const QSize &maxSize)
+{
+    decodeLimit = maxSize;
+}
+
+void Mediator::changeCaptureArea(const QRect &area)
+{
+    captureArea = area;
+    processOutput->setCaptureArea(area);
+    thresholdCache.clear();
+    blendJobs->cancel();
+    pendingCacheMethod = -1;
+
+    if (primarySession) {
+        primarySession->setRegion(area);
+    }
 }
 
 //------------------------------------------------------------------------------//
@@ -170,19 +760,18 @@ void ImageBlender::showResult(const QImage &result)
     QWidget *window = new QWidget();
     QVBoxLayout *layout = new QVBoxLayout(window);
 
-    QScrollArea *scrollArea = new QScrollArea();
-    QLabel *label = new QLabel();
-    QPixmap pixmap = QPixmap::fromImage(result);
-
-    label->setPixmap(pixmap);
-    label->setScaledContents(true); // Позволяет динамически изменять размер изображения
-    scrollArea->setWidget(label);
-    scrollArea->setWidgetResizable(true); // Позволяет изменять размер изображения внутри окна
+    // Плиточный просмотр: большие результаты не переводятся в QPixmap целиком
+    TiledImageViewer *viewer = new TiledImageViewer();
+    viewer->setImage(result);
 
-    layout->addWidget(scrollArea);
+    layout->addWidget(viewer);
     window->setLayout(layout);
+    window->setAttribute(Qt::WA_DeleteOnClose);
     window->resize(800, 600); // Размер по умолчанию
     window->show();
+    viewer->fitToWindow();
+
+    resultViewer = viewer;
 
     // Сохранение изображения
     QString savePath = "result.png"; // Можно задать динамически
@@ -190,286 +779,852 @@ void ImageBlender::showResult(const QImage &result)
 
 }
 
-QImage ImageBlender::differenceBlendTrail(const QVector<QImage> &images) {
-    if (images.isEmpty()) return QImage(); // Проверка на пустой список
+void ImageBlender::showPreview(const QImage &result)
+{
+    if (!resultViewer) {
+        showResult(result);
+        return;
+    }
 
-    QElapsedTimer timer;
-    timer.start();
+    // Масштаб и положение сохраняются, плитки перестраиваются только видимые
+    resultViewer->setImage(result);
+}
 
-    QImage result(images[0].size(), QImage::Format_ARGB32);
-    result.fill(Qt::black); // Заполняем черным
+QImage ImageBlender::regionView(const QImage &image, const QRect &roi)
+{
+    if (image.isNull() || roi.isNull() || roi == image.rect()) {
+        return image;
+    }
+
+    const QRect area = roi.intersected(image.rect());
+    if (area.isEmpty()) {
+        return QImage();
+    }
+
+    // Смещение начала области внутри строки должно оставаться выровненным по 4 байтам,
+    // иначе (моно-, 8/16/24-битные форматы) делаем обычную копию области
+    const int depth = image.depth();
+    const qsizetype xOffset = qsizetype(area.x()) * depth / 8;
+    if (depth < 8 || (xOffset % 4) != 0 || (image.bytesPerLine() % 4) != 0) {
+        return image.copy(area);
+    }
 
+    // Неглубокое представление: данные не копируются, шаг строки берется у исходного кадра.
+    // Представление валидно, пока жив исходный image.
+    const uchar *origin = image.constBits() + qsizetype(area.y()) * image.bytesPerLine() + xOffset;
+    QImage view(origin, area.width(), area.height(), image.bytesPerLine(), image.format());
+    if (image.format() == QImage::Format_Indexed8) {
+        view.setColorTable(image.colorTable());
+    }
+
+    return view;
+}
+
+QRect ImageBlender::blendRegion(const QVector<QImage> &images, const QRect &roi)
+{
+    if (images.isEmpty()) return QRect();
+
+    const QRect frameRect = images[0].rect();
+
+    // Проверяем, что все изображения имеют одинаковый размер
     for (int i = 1; i < images.size(); ++i) {
-        for (int y = 0; y < images[i].height(); ++y) {
-            for (int x = 0; x < images[i].width(); ++x) {
-                QColor prevPixel = images[i - 1].pixelColor(x, y);
-                QColor currPixel = images[i].pixelColor(x, y);
-                QColor resultPixel = result.pixelColor(x, y);
+        if (images[i].size() != frameRect.size()) {
+            qWarning() << "Image sizes don't match!";
+            return QRect();
+        }
+    }
+
+    return roi.isNull() ? frameRect : roi.intersected(frameRect);
+}
 
-                int r = qMax(resultPixel.red(), abs(currPixel.red()  - prevPixel.red()));
-                int g = qMax(resultPixel.green(), abs(currPixel.green() - prevPixel.green()));
-                int b = qMax(resultPixel.blue(),  abs(currPixel.blue() - prevPixel.blue()));
+bool ImageBlender::jobStep(BlendJobControl *control, const QImage &result, int done, int total)
+{
+    if (!control) return true;
+    if (control->isCancelled()) return false;
 
-                result.setPixelColor(x, y, QColor(r, g, b, 255)); // Сохраняем максимум изменения
-            }
+    control->setProgress(done, total);
+    control->offerPartial([&]() { return result.copy(); });
+    return true;
+}
+
+bool ImageBlender::parallelBands(int count, const std::function<void(int)> &body, BlendJobControl *control,
+                                 const std::function<QImage()> &snapshot)
+{
+    if (!control) {
+        parallelFor(count, body);
+        return true;
+    }
+
+    // Волна - по две полосы на поток: барьер между волнами почти не простаивает
+    const int wave = qMax(1, QThread::idealThreadCount()) * 2;
+    for (int first = 0; first < count; first += wave) {
+        if (control->isCancelled()) return false;
+
+        const int waveCount = qMin(wave, count - first);
+        parallelFor(waveCount, [&](int index) { body(first + index); });
+
+        control->setProgress(first + waveCount, count);
+        if (first + waveCount < count) {
+            control->offerPartial(snapshot);
         }
     }
+    return !control->isCancelled();
+}
+
+QImage ImageBlender::createAccumulator(const QSize &size, QImage::Format format)
+{
+    QImage result(size, format);
+    result.fill(Qt::black); // Заполняем черным
+    return result;
+}
+
+bool ImageBlender::usesThreshold(int method)
+{
+    switch (method) {
+    case MethodV3:
+    case MethodV4:
+    case MethodV4Fast:
+    case MethodHeatmap:
+    case MethodGradient:
+    case MethodPerceptual:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool ImageBlender::isWideFrame(const QImage &image)
+{
+    return FrameView::isWide(FrameView::fromImage(image).format);
+}
+
+QImage::Format ImageBlender::accumulatorFormat(const QImage &frame)
+{
+    return isWideFrame(frame) ? QImage::Format_RGBA32FPx4 : QImage::Format_ARGB32;
+}
+
+void ImageBlender::accumulatePair(int method, QImage &result, const QImage &prev, const QImage &curr,
+                                  int threshold, const QRect &area, const QPoint &shift)
+{
+    if (isWideFrame(curr)) {
+        accumulateWide(method, result, prev, curr, threshold, area, shift);
+        return;
+    }
+
+    if (!shift.isNull()) {
+        accumulateShifted(method, result, prev, curr, threshold, area, shift);
+        return;
+    }
+
+    switch (method) {
+        case MethodTrail:   accumulateTrail(result, prev, curr, area); break;
+        case MethodV2:      accumulateV2(result, prev, curr, area); break;
+        case MethodV3:      accumulateV3(result, prev, curr, threshold, area); break;
+        case MethodV4:      accumulateV4(result, prev, curr, threshold, area); break;
+        case MethodV4Fast:  accumulateV4Fast(result, prev, curr, threshold, area); break;
+        case MethodGradient: accumulateGradient(result, prev, curr, threshold, area); break;
+        case MethodPerceptual: accumulatePerceptual(result, prev, curr, threshold, area); break;
+        default:            break;
+    }
+}
+
+QImage ImageBlender::differenceBlendTrail(const QVector<QImage> &images, const QRect &roi,
+                                          BlendJobControl *control) {
+    if (images.isEmpty()) return QImage(); // Проверка на пустой список
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    QImage result = createAccumulator(area.size());
+
+    for (int i = 1; i < images.size(); ++i) {
+        accumulateTrail(result, images[i - 1], images[i], area);
+        if (!jobStep(control, result, i, int(images.size()) - 1)) return QImage();
+    }
 
     qDebug() << "Время выполнения differenceBlendTrail:" << timer.elapsed() << "мс";
 
     return result;
 }
 
-QImage ImageBlender::differenceBlendTrailV2(const QVector<QImage> &images) {
+QImage ImageBlender::differenceBlendTrailV2(const QVector<QImage> &images, const QRect &roi,
+                                            BlendJobControl *control) {
     if (images.isEmpty()) return QImage();
 
     QElapsedTimer timer;
     timer.start();
 
-    const QImage &firstImage = images[0];
-    QImage result(firstImage.size(), QImage::Format_ARGB32);
-    result.fill(Qt::black);
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    QImage result = createAccumulator(area.size());
 
-    // Проверяем, что все изображения имеют одинаковый размер и формат
     for (int i = 1; i < images.size(); ++i) {
-        if (images[i].size() != firstImage.size()) {
-            qWarning() << "Image sizes don't match!";
-            return result;
-        }
+        accumulateV2(result, images[i - 1], images[i], area);
+        if (!jobStep(control, result, i, int(images.size()) - 1)) return QImage();
     }
 
-    const int width = firstImage.width();
-    const int height = firstImage.height();
+    qDebug() << "Время выполнения differenceBlendTrailV2 (оптимизировано):" << timer.elapsed() << "мс";
+    return result;
+}
+
+QImage ImageBlender::differenceBlendTrailV3(const QVector<QImage> &images, int threshold, const QRect &roi,
+                                            BlendJobControl *control) {
+    if (images.isEmpty()) return QImage();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
 
-    // Получаем прямой доступ к данным пикселей
-    QRgb* resultData = reinterpret_cast<QRgb*>(result.bits());
+    QImage result = createAccumulator(area.size());
 
     for (int i = 1; i < images.size(); ++i) {
-        // Конвертируем в нужный формат для быстрого доступа
-        QImage prevImg = images[i - 1].convertToFormat(QImage::Format_ARGB32);
-        QImage currImg = images[i].convertToFormat(QImage::Format_ARGB32);
-
-        const QRgb* prevData = reinterpret_cast<const QRgb*>(prevImg.constBits());
-        const QRgb* currData = reinterpret_cast<const QRgb*>(currImg.constBits());
-
-        // Обрабатываем пиксели напрямую через указатели
-        for (int pixelIndex = 0; pixelIndex < width * height; ++pixelIndex) {
-            const QRgb prevPixel = prevData[pixelIndex];
-            const QRgb currPixel = currData[pixelIndex];
-            const QRgb resultPixel = resultData[pixelIndex];
-
-            // Извлекаем компоненты цвета через битовые операции (быстрее)
-            const int prevR = (prevPixel >> 16) & 0xFF;
-            const int prevG = (prevPixel >> 8) & 0xFF;
-            const int prevB = prevPixel & 0xFF;
-
-            const int currR = (currPixel >> 16) & 0xFF;
-            const int currG = (currPixel >> 8) & 0xFF;
-            const int currB = currPixel & 0xFF;
-
-            const int resultR = (resultPixel >> 16) & 0xFF;
-            const int resultG = (resultPixel >> 8) & 0xFF;
-            const int resultB = resultPixel & 0xFF;
-
-            // Вычисляем разность и максимум
-            const int diffR = abs(currR - prevR);
-            const int diffG = abs(currG - prevG);
-            const int diffB = abs(currB - prevB);
-
-            const int newR = qMax(resultR, diffR);
-            const int newG = qMax(resultG, diffG);
-            const int newB = qMax(resultB, diffB);
-
-            // Собираем новый пиксель через битовые операции
-            resultData[pixelIndex] = 0xFF000000 | (newR << 16) | (newG << 8) | newB;
-        }
+        accumulateV3(result, images[i - 1], images[i], threshold, area);
+        if (!jobStep(control, result, i, int(images.size()) - 1)) return QImage();
     }
 
-    qDebug() << "Время выполнения differenceBlendTrailV2 (оптимизировано):" << timer.elapsed() << "мс";
+    qDebug() << "Время выполнения differenceBlendTrailV3 (с проверкой различий):" << timer.elapsed() << "мс";
     return result;
 }
 
-QImage ImageBlender::differenceBlendTrailV3(const QVector<QImage> &images, int threshold) {
+QImage ImageBlender::differenceBlendTrailV4(const QVector<QImage> &images, int threshold, const QRect &roi,
+                                            BlendJobControl *control) {
     if (images.isEmpty()) return QImage();
 
     QElapsedTimer timer;
     timer.start();
 
-    const QImage &firstImage = images[0];
-    QImage result(firstImage.size(), QImage::Format_ARGB32);
-    result.fill(Qt::black);
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    QImage result = createAccumulator(area.size());
 
-    // Проверяем, что все изображения имеют одинаковый размер и формат
     for (int i = 1; i < images.size(); ++i) {
-        if (images[i].size() != firstImage.size()) {
-            qWarning() << "Image sizes don't match!";
-            return result;
-        }
+        accumulateV4(result, images[i - 1], images[i], threshold, area);
+        if (!jobStep(control, result, i, int(images.size()) - 1)) return QImage();
+    }
+
+    qDebug() << "Время выполнения differenceBlendTrailV4 (серый, оптимизированный):" << timer.elapsed() << "мс";
+    return result;
+}
+
+// Альтернативная версия с ручной конвертацией в серый (еще быстрее)
+QImage ImageBlender::differenceBlendTrailV4Fast(const QVector<QImage> &images, int threshold, const QRect &roi,
+                                                BlendJobControl *control) {
+    if (images.isEmpty()) return QImage();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    QImage result = createAccumulator(area.size());
+
+    for (int i = 1; i < images.size(); ++i) {
+        accumulateV4Fast(result, images[i - 1], images[i], threshold, area);
+        if (!jobStep(control, result, i, int(images.size()) - 1)) return QImage();
     }
 
-    const int width = firstImage.width();
-    const int height = firstImage.height();
-    const int totalPixels = width * height;
+    qDebug() << "Время выполнения differenceBlendTrailV4Fast (быстрая серая):" << timer.elapsed() << "мс";
+    return result;
+}
+
+QImage ImageBlender::differenceBlendGradient(const QVector<QImage> &images, int threshold, const QRect &roi,
+                                             BlendJobControl *control) {
+    if (images.isEmpty()) return QImage();
+
+    QElapsedTimer timer;
+    timer.start();
 
-    // Получаем прямой доступ к данным пикселей
-    QRgb* resultData = reinterpret_cast<QRgb*>(result.bits());
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    QImage result = createAccumulator(area.size());
 
     for (int i = 1; i < images.size(); ++i) {
-        // Конвертируем в нужный формат для быстрого доступа
-        QImage prevImg = images[i - 1].convertToFormat(QImage::Format_ARGB32);
-        QImage currImg = images[i].convertToFormat(QImage::Format_ARGB32);
+        accumulateGradient(result, images[i - 1], images[i], threshold, area);
+        if (!jobStep(control, result, i, int(images.size()) - 1)) return QImage();
+    }
 
-        const QRgb* prevData = reinterpret_cast<const QRgb*>(prevImg.constBits());
-        const QRgb* currData = reinterpret_cast<const QRgb*>(currImg.constBits());
+    qDebug() << "Время выполнения differenceBlendGradient (Собель):" << timer.elapsed() << "мс";
+    return result;
+}
 
-        // Обрабатываем пиксели напрямую через указатели
-        for (int pixelIndex = 0; pixelIndex < totalPixels; ++pixelIndex) {
-            const QRgb prevPixel = prevData[pixelIndex];
-            const QRgb currPixel = currData[pixelIndex];
+QImage ImageBlender::differenceBlendPerceptual(const QVector<QImage> &images, int threshold, const QRect &roi,
+                                               BlendJobControl *control) {
+    if (images.isEmpty()) return QImage();
 
-            // Быстрая проверка на различие - если пиксели одинаковые, пропускаем
-            if (prevPixel == currPixel) {
-                continue;
-            }
+    QElapsedTimer timer;
+    timer.start();
 
-            // Извлекаем компоненты цвета через битовые операции
-            const int prevR = (prevPixel >> 16) & 0xFF;
-            const int prevG = (prevPixel >> 8) & 0xFF;
-            const int prevB = prevPixel & 0xFF;
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
 
-            const int currR = (currPixel >> 16) & 0xFF;
-            const int currG = (currPixel >> 8) & 0xFF;
-            const int currB = currPixel & 0xFF;
+    QImage result = createAccumulator(area.size());
 
-            // Вычисляем разность
-            const int diffR = abs(currR - prevR);
-            const int diffG = abs(currG - prevG);
-            const int diffB = abs(currB - prevB);
+    for (int i = 1; i < images.size(); ++i) {
+        accumulatePerceptual(result, images[i - 1], images[i], threshold, area);
+        if (!jobStep(control, result, i, int(images.size()) - 1)) return QImage();
+    }
 
-            // Вычисляем общую разность (можно использовать разные метрики)
-            const int totalDiff = qMax(qMax(diffR, diffG), diffB); // Максимальная разность по каналам
-            // Альтернатива: const int totalDiff = (diffR + diffG + diffB) / 3; // Средняя разность
+    qDebug() << "Время выполнения differenceBlendPerceptual (Lab):" << timer.elapsed() << "мс";
+    return result;
+}
+
+QImage ImageBlender::blendBatch(int method, const QVector<QImage> &images, int threshold, const QRect &roi,
+                                int chunkCount, BlendJobControl *control)
+{
+    if (images.isEmpty()) return QImage();
+
+    QElapsedTimer timer;
+    timer.start();
 
-            // Если разность превышает порог, устанавливаем белый пиксель
-            if (totalDiff > threshold) {
-                resultData[pixelIndex] = 0xFFFFFFFF; // Белый цвет (ARGB: 255,255,255,255)
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    const int pairs = int(images.size()) - 1;
+    const int chunks = qBound(1, chunkCount > 0 ? chunkCount : QThread::idealThreadCount(), qMax(1, pairs));
+
+    // V4Fast и Lab: "последний записавший побеждает" - для слияния нужна маска записанных пикселей
+    const bool ordered = (method == MethodV4Fast || method == MethodPerceptual);
+    const qsizetype maskStride = area.width();
+
+    QVector<QImage> partials(chunks);
+    QVector<QByteArray> masks(ordered ? chunks : 0);
+
+    // Частичные результаты и маски живут до конца слияния
+    FrameMemory::Tracker scratchMemory(FrameMemory::KernelScratch);
+    scratchMemory.set(qint64(chunks) * area.width() * area.height() * (ordered ? 5 : 4));
+
+    parallelFor(chunks, [&](int chunk) {
+        // Отрезок кадров [first, last]; last - он же first следующего отрезка
+        const int first = int(qint64(pairs) * chunk / chunks);
+        const int last = int(qint64(pairs) * (chunk + 1) / chunks);
+
+        QImage partial = createAccumulator(area.size());
+
+        if (ordered) {
+            QByteArray mask(qsizetype(area.width()) * area.height(), '\0');
+            uchar *maskData = reinterpret_cast<uchar*>(mask.data());
+            const MutableFrameView partialView = MutableFrameView::fromImage(partial);
+
+            for (int i = first + 1; i <= last && !(control && control->isCancelled()); ++i) {
+                QImage prevStorage, currStorage;
+                const FrameView prevView = frameView(images[i - 1], area, prevStorage, QImage::Format_ARGB32);
+                const FrameView currView = frameView(images[i], area, currStorage, QImage::Format_ARGB32);
+                if (method == MethodPerceptual) {
+                    BlendKernels::accumulatePerceptualDiff(partialView, prevView, currView, threshold,
+                                                           maskData, maskStride);
+                } else {
+                    BlendKernels::accumulateThresholdColor(partialView, prevView, currView, threshold,
+                                                           maskData, maskStride);
+                }
+            }
+            masks[chunk] = mask;
+        } else {
+            // MethodTrail совпадает по результату с V2, считаем быстрым ядром
+            const int stepMethod = (method == MethodTrail) ? int(MethodV2) : method;
+            for (int i = first + 1; i <= last && !(control && control->isCancelled()); ++i) {
+                accumulatePair(stepMethod, partial, images[i - 1], images[i], threshold, area);
             }
         }
+
+        partials[chunk] = partial;
+    });
+    if (control && control->isCancelled()) return QImage();
+
+    // Слияние по полосам строк; внутри полосы отрезки сливаются строго по порядку.
+    // Представления берем заранее: bits() у QImage не потокобезопасен
+    QImage result = partials[0];
+    const MutableFrameView resultView = MutableFrameView::fromImage(result);
+    QVector<MutableFrameView> partialViews(chunks);
+    for (int chunk = 1; chunk < chunks; ++chunk) {
+        partialViews[chunk] = MutableFrameView::fromImage(partials[chunk]);
     }
 
-    qDebug() << "Время выполнения differenceBlendTrailV3 (с проверкой различий):" << timer.elapsed() << "мс";
+    const int bandHeight = 64;
+    const int bands = (area.height() + bandHeight - 1) / bandHeight;
+
+    parallelFor(bands, [&](int band) {
+        const QRect bandRect(0, band * bandHeight, area.width(), bandHeight);
+        const MutableFrameView dst = resultView.subView(bandRect);
+
+        for (int chunk = 1; chunk < chunks; ++chunk) {
+            const MutableFrameView src = partialViews[chunk].subView(bandRect);
+            if (ordered) {
+                const uchar *mask = reinterpret_cast<const uchar*>(masks[chunk].constData())
+                                    + qsizetype(bandRect.y()) * maskStride;
+                BlendKernels::mergeMasked(dst, src, mask, maskStride);
+            } else {
+                BlendKernels::mergeMax(dst, src);
+            }
+        }
+    });
+
+    qDebug() << "Время выполнения blendBatch (" << chunks << "отрезков):" << timer.elapsed() << "мс";
     return result;
 }
 
-QImage ImageBlender::differenceBlendTrailV4(const QVector<QImage> &images, int threshold) {
-    if (images.isEmpty()) return QImage();
+bool ImageBlender::buildThresholdCache(ThresholdCache &cache, int method, const QVector<QImage> &images,
+                                       const QRect &roi, BlendJobControl *control)
+{
+    cache.clear();
+    if (!ThresholdCache::supports(method) || images.isEmpty()) return false;
 
     QElapsedTimer timer;
     timer.start();
 
-    const QImage &firstImage = images[0];
-    QImage result(firstImage.size(), QImage::Format_ARGB32);
-    result.fill(Qt::black);
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return false;
 
-    // Проверяем, что все изображения имеют одинаковый размер
-    for (int i = 1; i < images.size(); ++i) {
-        if (images[i].size() != firstImage.size()) {
-            qWarning() << "Image sizes don't match!";
-            return result;
+    // Кадры ARGB32 передаются без копирования; V4 считает яркость конвертацией Qt, как accumulateV4
+    QVector<QImage> storage(images.size());
+    QVector<FrameView> views(images.size());
+
+    parallelFor(int(images.size()), [&](int i) {
+        if (control && control->isCancelled()) return;
+
+        if (method == MethodV4) {
+            storage[i] = PipelineTrace::convertToFormat(regionView(images[i], area), QImage::Format_Grayscale8);
+            views[i] = FrameView::fromImage(storage[i]);
+        } else {
+            views[i] = frameView(images[i], area, storage[i], QImage::Format_ARGB32);
         }
+    });
+
+    qint64 storageBytes = 0;
+    for (const QImage &image : storage) {
+        storageBytes += FrameMemory::imageBytes(image);
     }
+    FrameMemory::Tracker scratchMemory(FrameMemory::KernelScratch);
+    scratchMemory.set(storageBytes);
 
-    const int width = firstImage.width();
-    const int height = firstImage.height();
-    const int totalPixels = width * height;
+    if (control && control->isCancelled()) return false;
 
-    // Получаем прямой доступ к данным результата
-    QRgb* resultData = reinterpret_cast<QRgb*>(result.bits());
+    const bool built = cache.build(method, views, control);
 
-    for (int i = 1; i < images.size(); ++i) {
-        // Конвертируем изображения в серый формат для быстрого сравнения
-        QImage prevGray = images[i - 1].convertToFormat(QImage::Format_Grayscale8);
-        QImage currGray = images[i].convertToFormat(QImage::Format_Grayscale8);
+    qDebug() << "Время предрасчета порога (метод" << method << "):" << timer.elapsed() << "мс,"
+             << cache.memoryBytes() / 1024 << "КБ";
+    return built;
+}
 
-        const uchar* prevData = prevGray.constBits();
-        const uchar* currData = currGray.constBits();
+QImage ImageBlender::blendTiled(int method, const QVector<QImage> &images, int threshold, const QRect &roi,
+                                qsizetype tileCacheBytes, BlendJobControl *control)
+{
+    if (images.isEmpty()) return QImage();
 
-        // Обрабатываем пиксели как байты (намного быстрее)
-        for (int pixelIndex = 0; pixelIndex < totalPixels; ++pixelIndex) {
-            const uchar prevGrayValue = prevData[pixelIndex];
-            const uchar currGrayValue = currData[pixelIndex];
+    QElapsedTimer timer;
+    timer.start();
 
-            // Быстрая проверка на различие
-            if (prevGrayValue == currGrayValue) {
-                continue;
-            }
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    // V4 получает яркость конвертацией Qt (как accumulateV4), остальные читают ARGB32 напрямую.
+    // MethodTrail совпадает по результату с V2, считаем быстрым ядром
+    const bool gray = (method == MethodV4);
+    const bool gradient = (method == MethodGradient);
+    const int stepMethod = (method == MethodTrail) ? int(MethodV2) : method;
+    const int inputBytesPerPixel = gray ? 1 : 4;
 
-            // Вычисляем разность яркости
-            const int diff = abs(static_cast<int>(currGrayValue) - static_cast<int>(prevGrayValue));
+    // В кэше одновременно: полоса накопителя и полосы двух соседних кадров
+    const qsizetype rowBytes = qsizetype(area.width()) * (4 + 2 * inputBytesPerPixel);
+    const int tileRows = int(qBound<qsizetype>(1, tileCacheBytes / rowBytes, area.height()));
+    const int tiles = (area.height() + tileRows - 1) / tileRows;
 
-            // Если разность превышает порог, устанавливаем белый пиксель
-            if (diff > threshold) {
-                resultData[pixelIndex] = 0xFFFFFFFF; // Белый цвет
+    QImage result = createAccumulator(area.size());
+    const MutableFrameView resultView = MutableFrameView::fromImage(result);
+
+    auto tileView = [&](const QImage &image, const QRect &rect, QImage &storage) {
+        if (gray) {
+            storage = PipelineTrace::convertToFormat(regionView(image, rect), QImage::Format_Grayscale8);
+            return FrameView::fromImage(storage);
+        }
+        return frameView(image, rect, storage, QImage::Format_ARGB32);
+    };
+
+    const bool finished = parallelBands(tiles, [&](int tile) {
+        const QRect tileRect = QRect(area.x(), area.y() + tile * tileRows, area.width(), tileRows).intersected(area);
+        const MutableFrameView dst = resultView.subView(tileRect.translated(-area.x(), -area.y()));
+
+        // Градиенту нужны соседние строки: кадры читаются со строкой над и под полосой (в пределах области)
+        const int contextTop = (gradient && tileRect.top() > area.top()) ? 1 : 0;
+        const int contextBottom = (gradient && tileRect.bottom() < area.bottom()) ? 1 : 0;
+        const QRect readRect = tileRect.adjusted(0, -contextTop, 0, contextBottom);
+
+        // Полоса текущего кадра становится полосой предыдущего: каждый кадр читается один раз
+        QImage prevStorage;
+        FrameView prevView = tileView(images[0], readRect, prevStorage);
+
+        for (int i = 1; i < images.size() && !(control && control->isCancelled()); ++i) {
+            QImage currStorage;
+            const FrameView currView = tileView(images[i], readRect, currStorage);
+            if (gradient) {
+                BlendKernels::accumulateGradientDiff(dst, prevView, currView, threshold, contextTop);
+            } else {
+                BlendKernels::accumulate(stepMethod, dst, prevView, currView, threshold);
             }
+
+            prevStorage = currStorage;
+            prevView = currView;
         }
-    }
+    }, control, [&]() { return result.copy(); });
+    if (!finished) return QImage();
+
+    // Оценка трафика памяти: покадровый обход читает оба кадра пары и читает/пишет весь
+    // накопитель на каждую пару; плиточный - читает каждый кадр один раз и пишет накопитель один раз
+    const double mb = 1024.0 * 1024.0;
+    const double pixels = double(area.width()) * area.height();
+    const double pairs = double(images.size() - 1);
+    const double frameOuterBytes = pairs * pixels * (2.0 * inputBytesPerPixel + 2.0 * 4);
+    const double tiledBytes = double(images.size()) * pixels * inputBytesPerPixel + pixels * 4;
+
+    qDebug() << "Время выполнения blendTiled (" << tiles << "полос по" << tileRows << "строк):"
+             << timer.elapsed() << "мс";
+    qDebug() << "Оценка трафика памяти:" << qRound(tiledBytes / mb) << "МБ вместо"
+             << qRound(frameOuterBytes / mb) << "МБ покадрового обхода (в"
+             << QString::number(frameOuterBytes / qMax(1.0, tiledBytes), 'f', 1) << "раза меньше)";
 
-    qDebug() << "Время выполнения differenceBlendTrailV4 (серый, оптимизированный):" << timer.elapsed() << "мс";
     return result;
 }
 
-// Альтернативная версия с ручной конвертацией в серый (еще быстрее)
-QImage ImageBlender::differenceBlendTrailV4Fast(const QVector<QImage> &images, int threshold) {
+QImage ImageBlender::blendWide(int method, const QVector<QImage> &images, int threshold, const QRect &roi,
+                               BlendJobControl *control)
+{
     if (images.isEmpty()) return QImage();
 
     QElapsedTimer timer;
     timer.start();
 
-    const QImage &firstImage = images[0];
-    QImage result(firstImage.size(), QImage::Format_ARGB32);
-    result.fill(Qt::black);
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
 
-    const int width = firstImage.width();
-    const int height = firstImage.height();
-    const int totalPixels = width * height;
+    // Все кадры приводятся к формату первого (обычно он у всех одинаковый - копий нет)
+    const QImage::Format format = images.first().format();
+    QImage result = createAccumulator(area.size(), QImage::Format_RGBA32FPx4);
+    const MutableFloatFrameView resultView = MutableFloatFrameView::fromImage(result);
 
-    QRgb* resultData = reinterpret_cast<QRgb*>(result.bits());
+    auto bandView = [&](const QImage &image, const QRect &rect, QImage &storage) {
+        if (image.format() == format) {
+            return FrameView::fromImage(image, rect);
+        }
+        storage = PipelineTrace::convertToFormat(regionView(image, rect), format);
+        return FrameView::fromImage(storage);
+    };
 
-    for (int i = 1; i < images.size(); ++i) {
-        // Конвертируем в ARGB32 для прямого доступа
-        QImage prevImg = images[i - 1].convertToFormat(QImage::Format_ARGB32);
-        QImage currImg = images[i].convertToFormat(QImage::Format_ARGB32);
+    const float normalizedThreshold = threshold / 255.0f;
+    // Градиенту нужны соседние строки - одна полоса на всю область, шва полос нет (путь редкий, HDR)
+    const int bandRows = (method == MethodGradient) ? area.height() : 64;
+    const int bands = (area.height() + bandRows - 1) / bandRows;
 
-        const QRgb* prevData = reinterpret_cast<const QRgb*>(prevImg.constBits());
-        const QRgb* currData = reinterpret_cast<const QRgb*>(currImg.constBits());
+    const bool finished = parallelBands(bands, [&](int band) {
+        const QRect bandRect = QRect(area.x(), area.y() + band * bandRows, area.width(), bandRows).intersected(area);
+        const MutableFloatFrameView dst = resultView.subView(bandRect.translated(-area.topLeft()));
 
-        for (int pixelIndex = 0; pixelIndex < totalPixels; ++pixelIndex) {
-            const QRgb prevPixel = prevData[pixelIndex];
-            const QRgb currPixel = currData[pixelIndex];
+        QImage prevStorage;
+        FrameView prevView = bandView(images[0], bandRect, prevStorage);
 
-            // Быстрая проверка на полное совпадение
-            if (prevPixel == currPixel) {
-                continue;
-            }
+        for (int i = 1; i < images.size() && !(control && control->isCancelled()); ++i) {
+            QImage currStorage;
+            const FrameView currView = bandView(images[i], bandRect, currStorage);
+            BlendKernels::accumulateWide(method, dst, prevView, currView, normalizedThreshold);
+
+            prevStorage = currStorage;
+            prevView = currView;
+        }
+    }, control, [&]() { return result.copy(); });
+    if (!finished) return QImage();
+
+    qDebug() << "Время выполнения blendWide:" << timer.elapsed() << "мс";
+    return result;
+}
+
+QImage ImageBlender::blendHeatmap(const QVector<QImage> &images, int threshold, const QRect &roi,
+                                  BlendJobControl *control)
+{
+    if (images.isEmpty()) return QImage();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    MotionHeatmap heatmap(FrameMemory::KernelScratch);
+    heatmap.reset(area.size());
+
+    // Полосы счетчиков не пересекаются - пары внутри полосы идут по порядку, полосы параллельно
+    const int bandRows = 64;
+    const int bands = (area.height() + bandRows - 1) / bandRows;
+
+    const bool finished = parallelBands(bands, [&](int band) {
+        const QRect bandRect = QRect(area.x(), area.y() + band * bandRows, area.width(), bandRows).intersected(area);
+        quint16 *counts = heatmap.row(bandRect.y() - area.y());
+
+        QImage prevStorage;
+        FrameView prevView = frameView(images[0], bandRect, prevStorage, QImage::Format_ARGB32);
+
+        for (int i = 1; i < images.size() && !(control && control->isCancelled()); ++i) {
+            QImage currStorage;
+            const FrameView currView = frameView(images[i], bandRect, currStorage, QImage::Format_ARGB32);
+            BlendKernels::countThresholdCrossings(counts, heatmap.stride(), prevView, currView, threshold);
+
+            prevStorage = currStorage;
+            prevView = currView;
+        }
+    }, control, [&]() { return heatmap.render(); });
+    if (!finished) return QImage();
+    heatmap.addPairs(quint32(images.size() - 1));
+
+    const QImage result = heatmap.render();
+
+    qDebug() << "Время выполнения blendHeatmap:" << timer.elapsed() << "мс, максимум изменений пикселя:"
+             << heatmap.maxCount() << "из" << heatmap.pairs();
+    return result;
+}
 
-            // Быстрое вычисление яркости через битовые операции
-            // Используем приближенную формулу: Gray = (R + G + B) / 3
-            const int prevGray = (((prevPixel >> 16) & 0xFF) + ((prevPixel >> 8) & 0xFF) + (prevPixel & 0xFF)) / 3;
-            const int currGray = (((currPixel >> 16) & 0xFF) + ((currPixel >> 8) & 0xFF) + (currPixel & 0xFF)) / 3;
+QImage ImageBlender::blendExposure(int method, const QVector<QImage> &images, const QRect &roi,
+                                   BlendJobControl *control, const QVector<quint32> &repeats)
+{
+    if (images.isEmpty()) return QImage();
 
-            const int diff = abs(currGray - prevGray);
+    QElapsedTimer timer;
+    timer.start();
 
-            if (diff > threshold) {
-                //resultData[pixelIndex] = 0xFFFFFFFF;  // Заполнение белым
-                resultData[pixelIndex] = currPixel;     // Заполнение цветным
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    // Вес кадра - он сам и его отброшенные повторы. Суммы не делятся пополам, как в живой сессии,
+    // поэтому в стопку входит не больше maxFrames кадров с учетом повторов
+    QVector<quint32> weights;
+    weights.reserve(images.size());
+    quint32 totalWeight = 0;
+    for (qsizetype i = 0; i < images.size() && totalWeight < ExposureStack::maxFrames; ++i) {
+        const quint32 weight = qMin(1 + (i < repeats.size() ? repeats[i] : 0u),
+                                    ExposureStack::maxFrames - totalWeight);
+        weights.append(weight);
+        totalWeight += weight;
+    }
+    const int frameCount = int(weights.size());
+    const bool clipped = method == MethodExposureClipped;
+
+    ExposureStack stack(FrameMemory::KernelScratch);
+    stack.reset(area.size(), clipped ? ExposureStack::SigmaClip : ExposureStack::Mean);
+    const StackView stackView = stack.view();
+    // Делитель известен заранее: частичный результат показывает готовые полосы, остальные черные
+    stack.addFrames(totalWeight);
+
+    // Полосы сумм не пересекаются - кадры внутри полосы идут по порядку, полосы параллельно
+    const int bandRows = 64;
+    const int bands = (area.height() + bandRows - 1) / bandRows;
+
+    const bool finished = parallelBands(bands, [&](int band) {
+        const QRect bandRect = QRect(area.x(), area.y() + band * bandRows, area.width(), bandRows).intersected(area);
+        const StackView bandStack = stackView.subView(bandRect.translated(-area.topLeft()));
+
+        for (int i = 0; i < frameCount && !(control && control->isCancelled()); ++i) {
+            QImage storage;
+            const FrameView view = frameView(images[i], bandRect, storage, QImage::Format_ARGB32);
+            for (quint32 repeat = 0; repeat < weights[i]; ++repeat) {
+                if (clipped) {
+                    BlendKernels::addToStackClipped(bandStack, view, stack.clipSigma(), ExposureStack::minClipSigma);
+                } else {
+                    BlendKernels::addToStack(bandStack, view);
+                }
             }
         }
+    }, control, [&]() { return stack.render(); });
+    if (!finished) return QImage();
+
+    const QImage result = stack.render();
+
+    qDebug() << "Время выполнения blendExposure:" << timer.elapsed() << "мс, кадров:" << frameCount
+             << ", с повторами:" << totalWeight;
+    return result;
+}
+
+QImage ImageBlender::blendCompensated(int method, const QVector<QImage> &images, int threshold, const QRect &roi,
+                                      BlendJobControl *control)
+{
+    if (images.isEmpty()) return QImage();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QRect area = blendRegion(images, roi);
+    if (area.isEmpty()) return QImage();
+
+    // Оценки пар независимы - считаем параллельно
+    const int pairs = int(images.size()) - 1;
+    QVector<QPoint> shifts(qMax(0, pairs));
+
+    parallelFor(pairs, [&](int pair) {
+        if (control && control->isCancelled()) return;
+
+        QImage prevStorage, currStorage;
+        const FrameView prevView = frameView(images[pair], area, prevStorage, QImage::Format_ARGB32);
+        const FrameView currView = frameView(images[pair + 1], area, currStorage, QImage::Format_ARGB32);
+
+        const MotionEstimator::Motion motion = MotionEstimator().estimate(prevView, currView);
+        if (motion.valid) {
+            shifts[pair] = motion.shift;
+        }
+    });
+
+    if (control && control->isCancelled()) return QImage();
+
+    QImage result = createAccumulator(area.size(), accumulatorFormat(images.first()));
+    int compensated = 0;
+    for (int i = 1; i < images.size(); ++i) {
+        accumulatePair(method, result, images[i - 1], images[i], threshold, area, shifts[i - 1]);
+        compensated += shifts[i - 1].isNull() ? 0 : 1;
+        if (!jobStep(control, result, i, pairs)) return QImage();
     }
 
-    qDebug() << "Время выполнения differenceBlendTrailV4Fast (быстрая серая):" << timer.elapsed() << "мс";
+    qDebug() << "Время выполнения blendCompensated:" << timer.elapsed() << "мс, пар со сдвигом:"
+             << compensated << "из" << pairs;
     return result;
 }
 
+//---------Шаги накопления (одна пара кадров)---------//
+
+void ImageBlender::accumulateTrail(QImage &result, const QImage &prev, const QImage &curr, const QRect &area)
+{
+    for (int y = 0; y < area.height(); ++y) {
+        for (int x = 0; x < area.width(); ++x) {
+            QColor prevPixel = prev.pixelColor(area.x() + x, area.y() + y);
+            QColor currPixel = curr.pixelColor(area.x() + x, area.y() + y);
+            QColor resultPixel = result.pixelColor(x, y);
+
+            int r = qMax(resultPixel.red(), abs(currPixel.red()  - prevPixel.red()));
+            int g = qMax(resultPixel.green(), abs(currPixel.green() - prevPixel.green()));
+            int b = qMax(resultPixel.blue(),  abs(currPixel.blue() - prevPixel.blue()));
+
+            result.setPixelColor(x, y, QColor(r, g, b, 255)); // Сохраняем максимум изменения
+        }
+    }
+}
+
+void ImageBlender::accumulateV2(QImage &result, const QImage &prev, const QImage &curr, const QRect &area)
+{
+    // Поддерживаемые форматы читаются напрямую из исходного кадра, остальные конвертируются (только область)
+    QImage prevStorage, currStorage;
+    const FrameView prevView = frameView(prev, area, prevStorage, QImage::Format_ARGB32);
+    const FrameView currView = frameView(curr, area, currStorage, QImage::Format_ARGB32);
+
+    BlendKernels::accumulateMaxDiff(MutableFrameView::fromImage(result), prevView, currView);
+}
+
+void ImageBlender::accumulateV3(QImage &result, const QImage &prev, const QImage &curr, int threshold, const QRect &area)
+{
+    QImage prevStorage, currStorage;
+    const FrameView prevView = frameView(prev, area, prevStorage, QImage::Format_ARGB32);
+    const FrameView currView = frameView(curr, area, currStorage, QImage::Format_ARGB32);
+
+    BlendKernels::accumulateThresholdChannels(MutableFrameView::fromImage(result), prevView, currView, threshold);
+}
+
+void ImageBlender::accumulateV4(QImage &result, const QImage &prev, const QImage &curr, int threshold, const QRect &area)
+{
+    // Серый получаем конвертацией Qt (как и раньше), ядро работает с Gray8 напрямую
+    const QImage prevGray = PipelineTrace::convertToFormat(regionView(prev, area), QImage::Format_Grayscale8);
+    const QImage currGray = PipelineTrace::convertToFormat(regionView(curr, area), QImage::Format_Grayscale8);
+
+    BlendKernels::accumulateThresholdGray(MutableFrameView::fromImage(result),
+                                          FrameView::fromImage(prevGray), FrameView::fromImage(currGray), threshold);
+}
+
+void ImageBlender::accumulateV4Fast(QImage &result, const QImage &prev, const QImage &curr, int threshold, const QRect &area)
+{
+    QImage prevStorage, currStorage;
+    const FrameView prevView = frameView(prev, area, prevStorage, QImage::Format_ARGB32);
+    const FrameView currView = frameView(curr, area, currStorage, QImage::Format_ARGB32);
+
+    BlendKernels::accumulateThresholdColor(MutableFrameView::fromImage(result), prevView, currView, threshold);
+}
+
+void ImageBlender::accumulateGradient(QImage &result, const QImage &prev, const QImage &curr, int threshold,
+                                      const QRect &area)
+{
+    // Яркость считается в ядре вместе с градиентом - отдельного прохода перевода в серый нет
+    QImage prevStorage, currStorage;
+    const FrameView prevView = frameView(prev, area, prevStorage, QImage::Format_ARGB32);
+    const FrameView currView = frameView(curr, area, currStorage, QImage::Format_ARGB32);
+
+    BlendKernels::accumulateGradientDiff(MutableFrameView::fromImage(result), prevView, currView, threshold);
+}
+
+void ImageBlender::accumulatePerceptual(QImage &result, const QImage &prev, const QImage &curr, int threshold,
+                                        const QRect &area)
+{
+    QImage prevStorage, currStorage;
+    const FrameView prevView = frameView(prev, area, prevStorage, QImage::Format_ARGB32);
+    const FrameView currView = frameView(curr, area, currStorage, QImage::Format_ARGB32);
+
+    BlendKernels::accumulatePerceptualDiff(MutableFrameView::fromImage(result), prevView, currView, threshold);
+}
+
+void ImageBlender::accumulateShifted(int method, QImage &result, const QImage &prev, const QImage &curr,
+                                     int threshold, const QRect &area, const QPoint &shift)
+{
+    QRect prevRect, currRect;
+    MotionEstimator::overlap(area, shift, prevRect, currRect);
+    if (currRect.isEmpty()) return;
+
+    // Накопитель в координатах текущего кадра: пишем только в перекрывающуюся часть
+    const MutableFrameView resultView = MutableFrameView::fromImage(result).subView(currRect.translated(-area.topLeft()));
+
+    QImage prevStorage, currStorage;
+    FrameView prevView, currView;
+    if (method == MethodV4) {
+        prevStorage = PipelineTrace::convertToFormat(regionView(prev, prevRect), QImage::Format_Grayscale8);
+        currStorage = PipelineTrace::convertToFormat(regionView(curr, currRect), QImage::Format_Grayscale8);
+        prevView = FrameView::fromImage(prevStorage);
+        currView = FrameView::fromImage(currStorage);
+    } else {
+        prevView = frameView(prev, prevRect, prevStorage, QImage::Format_ARGB32);
+        currView = frameView(curr, currRect, currStorage, QImage::Format_ARGB32);
+    }
+
+    BlendKernels::accumulate(method, resultView, prevView, currView, threshold);
+}
+
+void ImageBlender::accumulateWide(int method, QImage &result, const QImage &prev, const QImage &curr,
+                                  int threshold, const QRect &area, const QPoint &shift)
+{
+    QRect prevRect, currRect;
+    MotionEstimator::overlap(area, shift, prevRect, currRect);
+    if (currRect.isEmpty()) return;
+
+    // Формат пары должен совпадать; конвертация - только при смене формата источника
+    QImage prevStorage;
+    const QImage &prevFrame = (prev.format() == curr.format())
+                                  ? prev : (prevStorage = PipelineTrace::convertToFormat(prev, curr.format()));
+
+    const MutableFloatFrameView resultView = MutableFloatFrameView::fromImage(result)
+                                                 .subView(currRect.translated(-area.topLeft()));
+    BlendKernels::accumulateWide(method, resultView, FrameView::fromImage(prevFrame, prevRect),
+                                 FrameView::fromImage(curr, currRect), threshold / 255.0f);
+}
+
+FrameView ImageBlender::frameView(const QImage &image, const QRect &area, QImage &storage, QImage::Format fallback)
+{
+    // ARGB32/RGB32 передаются в ядра без копирования, остальные приводятся к одному формату,
+    // чтобы у пары кадров он совпадал
+    FrameView view = FrameView::fromImage(image, area);
+    if (view.isValid() && view.format == FramePixelFormat::BGRA8) {
+        return view;
+    }
+
+    storage = PipelineTrace::convertToFormat(regionView(image, area), fallback);
+    return FrameView::fromImage(storage);
+}
+
 //------------------------------------------------------------------------------//
 //                                                                              //
 //------------------------------------------------------------------------------//
@@ -493,6 +1648,10 @@ ProcessOutput::ProcessOutput(QWidget *parent)
     scrollArea->setWidget(label);
     scrollArea->setWidgetResizable(true); // Позволяет изменять размер изображения внутри окна
 
+    // Область захвата выделяется рамкой прямо на предпросмотре
+    selectionBand = new QRubberBand(QRubberBand::Rectangle, label);
+    label->installEventFilter(this);
+
     layout->addWidget(scrollArea);
     setLayout(layout);
     resize(800, 600); // Размер по умолчанию
@@ -511,7 +1670,73 @@ void ProcessOutput::showResult(const QImage &result)
 
 void ProcessOutput::updateImageData(const QImage &imageNew)
 {
+    PIPELINE_TRACE_SCOPE("updateImageData");
+
     *pixmap = QPixmap::fromImage(imageNew);
     label->setPixmap(*pixmap);
+    pixmapMemory.set(FrameMemory::imageBytes(imageNew));
+}
+
+void ProcessOutput::setCaptureArea(const QRect &area)
+{
+    captureArea = area;
+}
+
+bool ProcessOutput::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched != label) {
+        return QWidget::eventFilter(watched, event);
+    }
+
+    switch (event->type()) {
+    case QEvent::MouseButtonPress: {
+        QMouseEvent *mouse = static_cast<QMouseEvent*>(event);
+        if (mouse->button() != Qt::LeftButton) {
+            break;
+        }
+        selectionOrigin = mouse->position().toPoint();
+        selectionBand->setGeometry(QRect(selectionOrigin, QSize()));
+        selectionBand->show();
+        return true;
+    }
+    case QEvent::MouseMove:
+        if (selectionBand->isVisible()) {
+            QMouseEvent *mouse = static_cast<QMouseEvent*>(event);
+            selectionBand->setGeometry(QRect(selectionOrigin, mouse->position().toPoint()).normalized());
+            return true;
+        }
+        break;
+    case QEvent::MouseButtonRelease:
+        if (selectionBand->isVisible()) {
+            selectionBand->hide();
+            const QRect selection = selectionBand->geometry() & label->rect();
+            if (selection.width() >= minSelectionSize && selection.height() >= minSelectionSize) {
+                emit captureAreaChanged(toFrameArea(selection));
+            }
+            return true;
+        }
+        break;
+    case QEvent::MouseButtonDblClick:
+        emit captureAreaChanged(QRect());
+        return true;
+    default:
+        break;
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+QRect ProcessOutput::toFrameArea(const QRect &selection) const
+{
+    // Метка растягивает изображение на всю свою площадь (setScaledContents): масштаб по осям свой
+    if (pixmap->isNull() || label->width() <= 0 || label->height() <= 0) {
+        return QRect();
+    }
+    const double scaleX = double(pixmap->width()) / label->width();
+    const double scaleY = double(pixmap->height()) / label->height();
+    const QRect area(qFloor(selection.x() * scaleX), qFloor(selection.y() * scaleY),
+                     qCeil(selection.width() * scaleX), qCeil(selection.height() * scaleY));
+
+    // Предпросмотр уже показывает текущую область - выделение внутри нее
+    return captureArea.isNull() ? area : area.translated(captureArea.topLeft());
 }
 
@@ -3,19 +3,44 @@
 #pragma comment(lib, "Msimg32.lib")
 
 #include "backend/dxwindowcapture.h"
+#include "backend/blendjob.h"
+#include "backend/blendsession.h"
+#include "backend/blendkernels.h"
+#include "backend/blendmethod.h"
+#include "backend/exposurestack.h"
+#include "backend/thresholdcache.h"
+#include "backend/framememory.h"
+#include "backend/kernelregistry.h"
+#include "backend/motionestimator.h"
+#include "backend/motionheatmap.h"
+#include "backend/pipelinetrace.h"
+#include "backend/resultpublisher.h"
+#include "features/tiledimageviewer.h"
 
 #include <QVBoxLayout>
 #include <QScrollArea>
 #include <QElapsedTimer>
 #include <QFileDialog>
+#include <QHash>
+#include <QInputDialog>
+#include <QGuiApplication>
+#include <QImageReader>
+#include <QtMath>
 #include <QObject>
 #include <QString>
 #include <QTimer>
 #include <QLabel>
 #include <QList>
+#include <QMouseEvent>
 #include <QRect>
 #include <QDebug>
+#include <QPointer>
+#include <QRubberBand>
+#include <QScreen>
+#include <QStandardPaths>
 
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include <windows.h>
@@ -30,33 +55,121 @@ class Mediator : public QObject
 {
     Q_OBJECT
 
+public:
+    // Индексы совпадают с пунктами comboBoxAutoThreshold
+    enum AutoThresholdMode {
+        AutoThresholdOff = 0,       // Только подсказка, порог задает пользователь
+        AutoThresholdOtsu,
+        AutoThresholdNoiseFloor     // Процентиль разностей (уровень шума)
+    };
+
 public:
 
     explicit Mediator(QObject *parent = nullptr);
     ~Mediator();
 
+    // Независимые сессии захвата/смешивания на общем пуле потоков
+    // method = 4 - ImageBlender::MethodV4Fast
+    BlendSession* addSession(HWND window, const QRect &roi = QRect(), int method = 4,
+                             int threshold = 30, int intervalMs = 16);
+    void removeSession(BlendSession *session);
+    QList<BlendSession*> activeSessions() const { return sessions; }
+    // Строка состояния: частота, задержка и потери кадров каждой сессии (BlendSession::Stats)
+    QString sessionReport() const;
+
+    // Статистика отброшенных повторяющихся кадров при последней загрузке
+    FrameDeduplicator::Counters loadDedupCounters() const { return loadDedup.counters(); }
+
+    // Декодирование с обрезкой по области и уменьшением на этапе чтения файла
+    // sourceSize (необязательно) - размер области файла до уменьшения (обрезка по clip уже учтена)
+    static QImage decodeImage(const QString &path, const QRect &clip, const QSize &maxSize,
+                              QSize *sourceSize = nullptr);
+
 public slots:
     void loadImagesToBuffer();
     void loadImagesToBuffer(const QList<QUrl> &list);
+    void addSourceWindow();                 // Еще одна сессия: окно выбирается из списка, результат - в своем окне
     void processStoredImages(int);
     void chagneThreadhold(int);
+    void changeCaptureArea(const QRect&);
+    void changeDecodeLimit(const QSize&);   // Пустой QSize - полное разрешение
+    void changeAutoThreshold(int);
+    void changeMemoryBudget(qint64 bytes);  // 0 - без ограничения
+    void changeMotionCompensation(bool);
+    void changeSceneCutPercent(int);        // Порог смены сцены живых сессий, 0 - не отслеживать
+    void changeResultPublishing(bool);      // Результат основной сессии в разделяемую память
+    void changeTracing(bool);               // Запись трассы конвейера (PipelineTrace)
+    void saveTrace();                       // Трасса в Chrome/Perfetto JSON
+    void calibrateKernels();                // Выбор реализаций ядер под размер кадров (KernelRegistry)
 
 signals:
     void imageDataLoaded();
+    void blendProgress(int done, int total);    // Фоновое смешивание загруженных кадров
+    void thresholdSuggested(int);   // Порог по гистограмме разностей загруженных кадров
+    void thresholdApplied(int);     // Порог изменен автоматически
+    void kernelsCalibrated(const QString &report);
+    void sceneCutDetected(quint64 frameIndex);  // Основная сессия сбросила накопитель по смене сцены
 
 private:
     ImageBlender *imgBlender;
     WindowSelecter *windowSelecter;
-    DXWindowCapture *capture;
+    BlendWorkerPool *workerPool;
+    BlendSession *primarySession = nullptr;     // Сессия, отображаемая в ProcessOutput
+    QList<BlendSession*> sessions;
+    int sessionPauses = 0;          // Незавершенные калибровки ядер: пока > 0, живые сессии не захватывают кадры
+    QHash<BlendSession*, ProcessOutput*> sourceOutputs;    // Окна результатов дополнительных сессий
     ProcessOutput *processOutput;
+    ResultPublisher *resultPublisher;   // Кольцо результатов для внешних процессов (ResultReader)
+    BlendJobRunner *blendJobs;          // Смешивание загруженных кадров вне потока GUI
 
     QTimer *captureTimer;
     const int bufferSize = 100;
     int threshold = 30;
     int diffusionShift = 1;
+    QRect captureArea;          // Область интереса, передается в ядра без копирования кадров
 
-    QVector<HBITMAP> frameBuffer;
     QVector<QImage> imageBuffer;
+    QVector<quint32> bufferRepeats; // Отброшенные повторы каждого кадра imageBuffer - вес кадра в выдержке
+    FrameDeduplicator loadDedup;
+
+    // Бюджет памяти кадров (FrameMemory). При превышении: вытесняем предрасчет порога,
+    // затем храним загруженные кадры только яркостью, затем не принимаем новые кадры
+    const qint64 defaultMemoryBudget = 4LL * 1024 * 1024 * 1024;   // Совпадает с начальным значением spinBoxMemoryBudget
+    FrameMemory::Tracker bufferMemory{FrameMemory::ImageBuffer};
+    bool lumaOnlyBuffer = false;    // Снимается, когда цветные кадры снова помещаются в бюджет
+    QStringList loadedPaths;        // Источник кадров буфера: после понижения до яркости цвет читается заново
+
+    bool reclaimMemory(qint64 neededBytes);
+    void updateBufferMemory();
+
+    ThresholdCache thresholdCache;  // V3/V4/V4Fast: смена порога без повторного смешивания
+    int shownMethod = -1;           // Метод последнего показанного результата
+    int autoThresholdMode = AutoThresholdOff;
+    bool motionCompensation = false;    // Компенсация прокрутки/панорамирования перед разностью
+    double sceneCutFraction = 0.6;      // Совпадает с начальным значением spinBoxSceneCut
+    const double noiseFloorPercentile = 0.99;   // Доля разностей шумового класса (до порога Оцу), считающихся шумом
+    static constexpr int minSuggestedThreshold = 2;     // Ниже - ошибки округления, отмечается любое изменение
+    static constexpr int maxSuggestedThreshold = 128;   // Выше - проходят только резкие смены цвета
+
+    int suggestThreshold() const;
+
+    // Фоновые задачи смешивания: новый запрос вытесняет текущий
+    bool jobResultShown = false;    // У текущего запроса уже есть окно результата
+    int pendingCacheMethod = -1;    // Метод предрасчета, который строит текущая задача
+    void submitBlend(int mode);
+    void finishBlend(const QImage &result, int requestThreshold);
+    void finishThresholdCache(ThresholdCache &cache);
+    void showJobResult(const QImage &result);
+    void pauseSessions();
+    void resumeSessions();
+    QSize calibrationSize() const;  // Размер загруженных кадров, иначе области захвата или экрана
+
+    QSize decodeLimit;          // Ограничение разрешения при загрузке (предпросмотр)
+    QRect loadedClip;           // Область, по которой кадры обрезаны при декодировании
+    QSizeF loadedScale = QSizeF(1.0, 1.0);
+
+    void loadFiles(const QStringList &paths);
+    QRect bufferRegion() const; // captureArea в координатах кадров imageBuffer
 
 
 };
@@ -106,23 +219,127 @@ class ImageBlender : public QObject
 {
     Q_OBJECT
 
+public:
+    // Индексы совпадают с пунктами comboBoxMethod; сами значения - в backend/blendmethod.h
+    using BlendMethod = BlendMethods::BlendMethod;
+    using enum BlendMethods::BlendMethod;
+
 public:
     explicit ImageBlender(QObject *parent = nullptr);
     ~ImageBlender();
 
     void showResult(const QImage& );
+    // Обновляет последнее окно результата (интерактивная смена порога); если окна нет - showResult
+    void showPreview(const QImage& );
+
+    // Неглубокое представление области кадра (без копирования, с исходным шагом строки)
+    static QImage regionView(const QImage &image, const QRect &roi);
+
+    // Инкрементальное накопление: один шаг добавляет разность пары кадров в result.
+    // Статические и не используют состояние объекта - безопасны для вызова из потоков пула
+    static QImage createAccumulator(const QSize &size, QImage::Format format = QImage::Format_ARGB32);
+    // Результат метода зависит от порога (смена порога требует пересчета); Trail, V2 и выдержка - нет
+    static bool usesThreshold(int method);
+    // 16-битные кадры (RGBA64, FP16) накапливаются в float без перевода в 8 бит
+    static bool isWideFrame(const QImage &image);
+    static QImage::Format accumulatorFormat(const QImage &frame);
+    // shift - глобальный сдвиг содержимого (MotionEstimator): curr сравнивается со сдвинутым prev,
+    // открывшиеся края не сравниваются
+    static void accumulatePair(int method, QImage &result, const QImage &prev, const QImage &curr,
+                               int threshold, const QRect &area, const QPoint &shift = QPoint());
 
 public slots:
-    QImage differenceBlendTrail(const QVector<QImage> &images);
-    QImage differenceBlendTrailV2(const QVector<QImage> &images);
-    QImage differenceBlendTrailV3(const QVector<QImage> &images, int threshold = 60);
-    QImage differenceBlendTrailV4(const QVector<QImage> &images, int threshold = 15);
-    QImage differenceBlendTrailV4Fast(const QVector<QImage> &images, int threshold = 15);
+    // roi - область обработки в координатах кадра, пустой QRect - весь кадр.
+    // control - фоновая задача (BlendJobRunner): отмена проверяется на каждом кадре или полосе,
+    // отмененный вызов возвращает пустой результат; nullptr - обычный синхронный вызов
+    QImage differenceBlendTrail(const QVector<QImage> &images, const QRect &roi = QRect(),
+                                BlendJobControl *control = nullptr);
+    QImage differenceBlendTrailV2(const QVector<QImage> &images, const QRect &roi = QRect(),
+                                  BlendJobControl *control = nullptr);
+    QImage differenceBlendTrailV3(const QVector<QImage> &images, int threshold = 60, const QRect &roi = QRect(),
+                                  BlendJobControl *control = nullptr);
+    QImage differenceBlendTrailV4(const QVector<QImage> &images, int threshold = 15, const QRect &roi = QRect(),
+                                  BlendJobControl *control = nullptr);
+    QImage differenceBlendTrailV4Fast(const QVector<QImage> &images, int threshold = 15, const QRect &roi = QRect(),
+                                      BlendJobControl *control = nullptr);
+    // Порог - по разности модуля градиента яркости (0..255), устойчив к смене освещения и темы
+    QImage differenceBlendGradient(const QVector<QImage> &images, int threshold = 15, const QRect &roi = QRect(),
+                                   BlendJobControl *control = nullptr);
+    // Порог - в единицах dE (около 2.3 - едва заметное отличие), записывается цвет текущего кадра
+    QImage differenceBlendPerceptual(const QVector<QImage> &images, int threshold = 15, const QRect &roi = QRect(),
+                                     BlendJobControl *control = nullptr);
+
+    // Пакетный режим: последовательность делится на отрезки с общим граничным кадром,
+    // каждый отрезок накапливается на своем ядре, частичные результаты сливаются (SSE2).
+    // Результат совпадает с последовательным для всех методов. chunkCount = 0 - по числу ядер
+    QImage blendBatch(int method, const QVector<QImage> &images, int threshold = 15,
+                      const QRect &roi = QRect(), int chunkCount = 0, BlendJobControl *control = nullptr);
+
+    // Обход плитками: для каждой полосы строк, помещающейся в кэш, проходятся все кадры,
+    // и только потом следующая полоса. Накопитель полосы остается в L1/L2, из памяти читаются
+    // только входные кадры (каждый один раз). Полосы независимы и считаются параллельно.
+    // Результат совпадает с последовательным для всех методов
+    QImage blendTiled(int method, const QVector<QImage> &images, int threshold = 15,
+                      const QRect &roi = QRect(), qsizetype tileCacheBytes = 256 * 1024,
+                      BlendJobControl *control = nullptr);
+
+    // С компенсацией глобального сдвига: сдвиг каждой пары оценивается параллельно,
+    // затем пары накапливаются по порядку со сдвинутым предыдущим кадром
+    QImage blendCompensated(int method, const QVector<QImage> &images, int threshold = 15,
+                            const QRect &roi = QRect(), BlendJobControl *control = nullptr);
+
+    // Кадры 16 бит на канал: полосы строк параллельно, результат - Format_RGBA32FPx4.
+    // Порог в 8-битных единицах переводится в доли шкалы (t / 255)
+    QImage blendWide(int method, const QVector<QImage> &images, int threshold = 15, const QRect &roi = QRect(),
+                     BlendJobControl *control = nullptr);
+
+    // Тепловая карта частоты изменений: полосы строк параллельно, внутри полосы - все пары
+    QImage blendHeatmap(const QVector<QImage> &images, int threshold = 15, const QRect &roi = QRect(),
+                        BlendJobControl *control = nullptr);
+
+    // Длинная выдержка (MethodExposure, MethodExposureClipped): суммы 32 бит по каналам, полосы строк
+    // параллельно, внутри полосы - все кадры по порядку; в 8 бит суммы переводятся один раз в конце.
+    // repeats[i] - сколько повторов кадра i отброшено при загрузке (FrameDeduplicator): кадр входит
+    // в среднее 1 + repeats[i] раз, как в исходной последовательности. Пусто - без повторов
+    QImage blendExposure(int method, const QVector<QImage> &images, const QRect &roi = QRect(),
+                         BlendJobControl *control = nullptr, const QVector<quint32> &repeats = {});
+
+    // Предрасчет для мгновенной смены порога (V3, V4, V4Fast): кадры проходятся один раз,
+    // дальше результат для любого порога дает cache.render(threshold)
+    bool buildThresholdCache(ThresholdCache &cache, int method, const QVector<QImage> &images,
+                             const QRect &roi = QRect(), BlendJobControl *control = nullptr);
     //threshold = 5 - более чувствительный к изменениям
     //threshold = 15-20 - менее чувствительный, игнорирует больше шума
     //threshold = 30+ - только значительные изменения
 
 private:
+    static QRect blendRegion(const QVector<QImage> &images, const QRect &roi);
+
+    // Шаг покадрового цикла фоновой задачи: прогресс и промежуточный результат (копия накопителя).
+    // false - задача отменена
+    static bool jobStep(BlendJobControl *control, const QImage &result, int done, int total);
+    // parallelFor по полосам; с задачей полосы идут волнами, между волнами накопитель никто не пишет -
+    // там проверяется отмена и отдается промежуточный результат snapshot(). false - задача отменена
+    static bool parallelBands(int count, const std::function<void(int)> &body, BlendJobControl *control,
+                              const std::function<QImage()> &snapshot);
+
+    static void accumulateTrail(QImage &result, const QImage &prev, const QImage &curr, const QRect &area);
+    static void accumulateV2(QImage &result, const QImage &prev, const QImage &curr, const QRect &area);
+    static void accumulateV3(QImage &result, const QImage &prev, const QImage &curr, int threshold, const QRect &area);
+    static void accumulateV4(QImage &result, const QImage &prev, const QImage &curr, int threshold, const QRect &area);
+    static void accumulateV4Fast(QImage &result, const QImage &prev, const QImage &curr, int threshold, const QRect &area);
+    static void accumulateGradient(QImage &result, const QImage &prev, const QImage &curr, int threshold, const QRect &area);
+    static void accumulatePerceptual(QImage &result, const QImage &prev, const QImage &curr, int threshold,
+                                     const QRect &area);
+    static void accumulateShifted(int method, QImage &result, const QImage &prev, const QImage &curr, int threshold,
+                                  const QRect &area, const QPoint &shift);
+    static void accumulateWide(int method, QImage &result, const QImage &prev, const QImage &curr, int threshold,
+                               const QRect &area, const QPoint &shift);
+
+    // Представление области кадра для BlendKernels; при неподдерживаемом формате - конвертация в storage
+    static FrameView frameView(const QImage &image, const QRect &area, QImage &storage, QImage::Format fallback);
+
+    QPointer<TiledImageViewer> resultViewer;    // Окно последнего результата, см. showPreview
 
 };
 
@@ -143,17 +360,28 @@ public:
     void showResult(const QImage& );
 
 signals:
+    // Выделение рамкой на предпросмотре, в координатах кадра. Двойной щелчок - пустой QRect (весь кадр)
     void captureAreaChanged(const QRect&);
 
 public slots:
     void updateImageData(const QImage&);
+    void setCaptureArea(const QRect&);      // Область, которую сейчас показывает предпросмотр
 
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
 
+private:
+    QRect toFrameArea(const QRect &selection) const;
 
 private:
     QVBoxLayout *layout = nullptr;
     QScrollArea *scrollArea = nullptr;
     QLabel *label = nullptr;
     QPixmap *pixmap = nullptr;
+    QRubberBand *selectionBand = nullptr;
+    QPoint selectionOrigin;
+    QRect captureArea;
+    static constexpr int minSelectionSize = 8;  // Меньшая рамка - случайный щелчок, область не меняется
+    FrameMemory::Tracker pixmapMemory{FrameMemory::Output};
 
 };
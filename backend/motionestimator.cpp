@@ -0,0 +1,364 @@
+#include "backend/motionestimator.h"
+
+#include <cstdlib>
+#include <limits>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MOTIONESTIMATOR_SSE2
+#endif
+
+namespace {
+
+constexpr int kBlockSize = 16;      // Блок грубого поиска: одна загрузка SSE2 на строку
+constexpr int kRefineBlocks = 4;
+
+// Приближенная яркость (R + 2G + B) / 4: для сопоставления блоков точность qGray не нужна.
+// Порядок R и B не важен, поэтому BGRA8 и RGBA8 читаются одинаково
+template <int BytesPerPixel>
+inline int lumaAt(const uchar *row, int x)
+{
+    if constexpr (BytesPerPixel == 4) {
+        const uchar *p = row + x * 4;
+        return (p[0] + 2 * p[1] + p[2]) >> 2;
+    } else {
+        return row[x];
+    }
+}
+
+inline int lumaAt(const FrameView &frame, int x, int y)
+{
+    return frame.format == FramePixelFormat::Gray8 ? lumaAt<1>(frame.row(y), x) : lumaAt<4>(frame.row(y), x);
+}
+
+// SAD двух строк длиной width (кратно 16 для SSE2-пути)
+inline quint32 rowSad(const uchar *a, const uchar *b, int width)
+{
+    quint32 sum = 0;
+    int x = 0;
+
+#ifdef MOTIONESTIMATOR_SSE2
+    __m128i acc = _mm_setzero_si128();
+    for (; x + 16 <= width; x += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    sum = quint32(_mm_cvtsi128_si32(acc)) + quint32(_mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#endif
+
+    for (; x < width; ++x) {
+        sum += quint32(std::abs(int(a[x]) - int(b[x])));
+    }
+    return sum;
+}
+
+} // namespace
+
+
+MotionEstimator::MotionEstimator(const Config &config)
+    : m_config(config)
+{
+
+}
+
+void MotionEstimator::reset()
+{
+    m_lastPlane = LumaPlane();
+    m_lastKey = 0;
+    m_lastSize = QSize();
+}
+
+MotionEstimator::Motion MotionEstimator::estimate(const FrameView &prev, const FrameView &curr) const
+{
+    // Яркость читается только из 8-битных форматов
+    if (!prev.isValid() || !curr.isValid() || prev.size() != curr.size()
+        || FrameView::isWide(prev.format) || FrameView::isWide(curr.format)) {
+        return Motion();
+    }
+
+    LumaPlane prevPlane, currPlane;
+    downsample(prev, prevPlane);
+    downsample(curr, currPlane);
+    return match(prevPlane, currPlane, prev, curr);
+}
+
+MotionEstimator::Motion MotionEstimator::update(const FrameView &prev, const FrameView &curr,
+                                                qint64 prevKey, qint64 currKey)
+{
+    // Яркость читается только из 8-битных форматов
+    if (!prev.isValid() || !curr.isValid() || prev.size() != curr.size()
+        || FrameView::isWide(prev.format) || FrameView::isWide(curr.format)) {
+        reset();
+        return Motion();
+    }
+
+    // Яркость prev берем с прошлого вызова, если это тот же кадр
+    LumaPlane prevPlane;
+    if (m_lastKey != 0 && m_lastKey == prevKey && m_lastSize == prev.size()) {
+        prevPlane = std::move(m_lastPlane);
+    } else {
+        downsample(prev, prevPlane);
+    }
+
+    LumaPlane currPlane;
+    downsample(curr, currPlane);
+
+    const Motion motion = match(prevPlane, currPlane, prev, curr);
+
+    m_lastPlane = std::move(currPlane);
+    m_lastKey = currKey;
+    m_lastSize = curr.size();
+
+    return motion;
+}
+
+void MotionEstimator::overlap(const QRect &area, const QPoint &shift, QRect &prevRect, QRect &currRect)
+{
+    // curr(x, y) сравнивается с prev(x - dx, y - dy); обе точки должны лежать в area
+    currRect = area.intersected(area.translated(shift));
+    if (currRect.isEmpty()) {
+        prevRect = currRect = QRect();
+        return;
+    }
+    prevRect = currRect.translated(-shift);
+}
+
+void MotionEstimator::downsample(const FrameView &frame, LumaPlane &plane) const
+{
+    const int scale = qMax(1, m_config.scale);
+    plane.width = frame.width / scale;
+    plane.height = frame.height / scale;
+    plane.data.assign(size_t(qMax(0, plane.width)) * size_t(qMax(0, plane.height)), 0);
+
+    // Среднее четырех отсчетов внутри клетки scale x scale: дешевле полного усреднения,
+    // но без наложения частот, как у прореживания одним пикселем
+    const int offsetLow = scale / 4;
+    const int offsetHigh = (scale * 3) / 4;
+
+    auto sampleRows = [&](auto bytesTag) {
+        constexpr int BytesPerPixel = decltype(bytesTag)::value;
+
+        for (int y = 0; y < plane.height; ++y) {
+            uchar *out = plane.data.data() + qsizetype(y) * plane.width;
+            const uchar *row0 = frame.row(y * scale + offsetLow);
+            const uchar *row1 = frame.row(y * scale + offsetHigh);
+
+            for (int x = 0; x < plane.width; ++x) {
+                const int x0 = x * scale + offsetLow;
+                const int x1 = x * scale + offsetHigh;
+                out[x] = uchar((lumaAt<BytesPerPixel>(row0, x0) + lumaAt<BytesPerPixel>(row0, x1)
+                                + lumaAt<BytesPerPixel>(row1, x0) + lumaAt<BytesPerPixel>(row1, x1) + 2) >> 2);
+            }
+        }
+    };
+
+    if (frame.format == FramePixelFormat::Gray8) {
+        sampleRows(std::integral_constant<int, 1>());
+    } else {
+        sampleRows(std::integral_constant<int, 4>());
+    }
+}
+
+MotionEstimator::Motion MotionEstimator::match(const LumaPlane &prevPlane, const LumaPlane &currPlane,
+                                               const FrameView &prev, const FrameView &curr) const
+{
+    Motion motion;
+
+    const int range = qMax(1, m_config.searchRange);
+    const int side = 2 * range + 1;
+    if (currPlane.width < 2 * range + kBlockSize || currPlane.height < 2 * range + kBlockSize) {
+        return motion;
+    }
+
+    // Текстурные блоки сетки (с запасом на радиус поиска)
+    std::vector<QPoint> blocks;
+    for (int by = range; by + kBlockSize + range <= currPlane.height; by += kBlockSize) {
+        for (int bx = range; bx + kBlockSize + range <= currPlane.width; bx += kBlockSize) {
+            int texture = 0;
+            for (int y = 0; y < kBlockSize; y += 2) {
+                const uchar *row = currPlane.row(by + y) + bx;
+                const uchar *below = currPlane.row(by + y + 1) + bx;
+                for (int x = 0; x + 1 < kBlockSize; ++x) {
+                    texture += std::abs(row[x + 1] - row[x]) + std::abs(below[x] - row[x]);
+                }
+            }
+            if (texture >= m_config.minTexture * kBlockSize * kBlockSize / 2) {
+                blocks.push_back(QPoint(bx, by));
+            }
+        }
+    }
+
+    if (blocks.empty()) {
+        return motion;
+    }
+
+    // Равномерная выборка, чтобы голосовал весь кадр, а не одна насыщенная область
+    if (int(blocks.size()) > m_config.maxBlocks && m_config.maxBlocks > 0) {
+        std::vector<QPoint> sampled;
+        for (int i = 0; i < m_config.maxBlocks; ++i) {
+            sampled.push_back(blocks[size_t(qint64(i) * qint64(blocks.size()) / m_config.maxBlocks)]);
+        }
+        blocks.swap(sampled);
+    }
+
+    std::vector<int> votes(size_t(side) * side, 0);
+    std::vector<QPoint> vectors(blocks.size());
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const QPoint block = blocks[i];
+
+        auto blockSad = [&](int dx, int dy, quint32 limit) {
+            quint32 sad = 0;
+            for (int y = 0; y < kBlockSize && sad < limit; ++y) {
+                sad += rowSad(currPlane.row(block.y() + y) + block.x(),
+                              prevPlane.row(block.y() + y - dy) + block.x() - dx, kBlockSize);
+            }
+            return sad;
+        };
+
+        // Начинаем с нулевого сдвига: неподвижный блок отсекается сразу
+        QPoint best(0, 0);
+        quint32 bestSad = blockSad(0, 0, std::numeric_limits<quint32>::max());
+
+        for (int dy = -range; dy <= range && bestSad > 0; ++dy) {
+            for (int dx = -range; dx <= range; ++dx) {
+                if (dx == 0 && dy == 0) continue;
+                const quint32 sad = blockSad(dx, dy, bestSad);
+                if (sad < bestSad) {
+                    bestSad = sad;
+                    best = QPoint(dx, dy);
+                }
+            }
+        }
+
+        vectors[i] = best;
+        ++votes[size_t(best.y() + range) * side + size_t(best.x() + range)];
+    }
+
+    // Побеждает сдвиг с наибольшим числом голосов в окрестности 3x3: при сдвиге, не кратном scale,
+    // голоса делятся между соседними векторами
+    int bestVotes = -1;
+    QPoint coarse(0, 0);
+    for (int dy = -range; dy <= range; ++dy) {
+        for (int dx = -range; dx <= range; ++dx) {
+            int sum = 0;
+            for (int ny = qMax(-range, dy - 1); ny <= qMin(range, dy + 1); ++ny) {
+                for (int nx = qMax(-range, dx - 1); nx <= qMin(range, dx + 1); ++nx) {
+                    sum += votes[size_t(ny + range) * side + size_t(nx + range)];
+                }
+            }
+            // При равенстве предпочитаем меньший сдвиг
+            const bool better = sum > bestVotes
+                                || (sum == bestVotes && qAbs(dx) + qAbs(dy) < qAbs(coarse.x()) + qAbs(coarse.y()));
+            if (better) {
+                bestVotes = sum;
+                coarse = QPoint(dx, dy);
+            }
+        }
+    }
+
+    motion.confidence = double(bestVotes) / double(blocks.size());
+    if (motion.confidence < m_config.minConfidence) {
+        return motion;
+    }
+
+    // Центр уточнения - самый частый вектор окрестности победителя
+    const QPoint winner = coarse;
+    int centerVotes = -1;
+    for (int ny = qMax(-range, winner.y() - 1); ny <= qMin(range, winner.y() + 1); ++ny) {
+        for (int nx = qMax(-range, winner.x() - 1); nx <= qMin(range, winner.x() + 1); ++nx) {
+            const int count = votes[size_t(ny + range) * side + size_t(nx + range)];
+            if (count > centerVotes) {
+                centerVotes = count;
+                coarse = QPoint(nx, ny);
+            }
+        }
+    }
+
+    // Блоки, согласные с победителем, уточняют сдвиг на полном разрешении
+    std::vector<QPoint> agreeing;
+    for (size_t i = 0; i < blocks.size() && int(agreeing.size()) < kRefineBlocks; ++i) {
+        if (qAbs(vectors[i].x() - coarse.x()) <= 1 && qAbs(vectors[i].y() - coarse.y()) <= 1) {
+            agreeing.push_back(blocks[i]);
+        }
+    }
+
+    motion.shift = refine(prev, curr, coarse, agreeing);
+    motion.valid = true;
+    return motion;
+}
+
+QPoint MotionEstimator::refine(const FrameView &prev, const FrameView &curr, const QPoint &coarse,
+                               const std::vector<QPoint> &blocks) const
+{
+    const int scale = qMax(1, m_config.scale);
+    const QPoint center = coarse * scale;
+    if (scale == 1 || blocks.empty()) {
+        return center;
+    }
+
+    // Поиск вокруг грубого сдвига с радиусом scale (на 1 больше, чем дает округление 3x3 голосования)
+    const int radius = scale;
+    const int side = 2 * radius + 1;
+    const int size = kBlockSize * scale;
+    const QRect frameRect(0, 0, curr.width, curr.height);
+
+    std::vector<quint64> costs(size_t(side) * side, 0);
+    std::vector<uchar> currLuma(size_t(size) * size);
+    const int prevSize = size + 2 * radius;
+    std::vector<uchar> prevLuma(size_t(prevSize) * prevSize);
+    int used = 0;
+
+    for (const QPoint &block : blocks) {
+        const QRect currRect(block.x() * scale, block.y() * scale, size, size);
+        const QRect prevRect(currRect.x() - center.x() - radius, currRect.y() - center.y() - radius,
+                             prevSize, prevSize);
+        if (!frameRect.contains(currRect) || !frameRect.contains(prevRect)) {
+            continue;
+        }
+
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                currLuma[size_t(y) * size + x] = uchar(lumaAt(curr, currRect.x() + x, currRect.y() + y));
+            }
+        }
+        for (int y = 0; y < prevSize; ++y) {
+            for (int x = 0; x < prevSize; ++x) {
+                prevLuma[size_t(y) * prevSize + x] = uchar(lumaAt(prev, prevRect.x() + x, prevRect.y() + y));
+            }
+        }
+
+        // Сдвиг center + (dx, dy): prev смещен на (radius - dx, radius - dy) внутри prevLuma
+        for (int dy = -radius; dy <= radius; ++dy) {
+            for (int dx = -radius; dx <= radius; ++dx) {
+                quint64 sad = 0;
+                for (int y = 0; y < size; ++y) {
+                    sad += rowSad(currLuma.data() + size_t(y) * size,
+                                  prevLuma.data() + size_t(y + radius - dy) * prevSize + (radius - dx), size);
+                }
+                costs[size_t(dy + radius) * side + size_t(dx + radius)] += sad;
+            }
+        }
+        ++used;
+    }
+
+    if (used == 0) {
+        return center;
+    }
+
+    QPoint best(0, 0);
+    quint64 bestCost = costs[size_t(radius) * side + size_t(radius)];
+    for (int dy = -radius; dy <= radius; ++dy) {
+        for (int dx = -radius; dx <= radius; ++dx) {
+            const quint64 cost = costs[size_t(dy + radius) * side + size_t(dx + radius)];
+            if (cost < bestCost) {
+                bestCost = cost;
+                best = QPoint(dx, dy);
+            }
+        }
+    }
+
+    return center + best;
+}
@@ -0,0 +1,77 @@
+#ifndef MOTIONESTIMATOR_H
+#define MOTIONESTIMATOR_H
+
+#include "backend/blendkernels.h"
+
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+
+#include <vector>
+
+// Оценка глобального сдвига между соседними кадрами (прокрутка, панорамирование).
+// Грубый поиск - SAD блоков (SSE2 _mm_sad_epu8) на уменьшенной яркости, сдвиг выбирается
+// голосованием блоков; затем уточнение до пикселя на полном разрешении по блокам-победителям.
+// Сдвиг (dx, dy) означает curr(x, y) ~ prev(x - dx, y - dy)
+class MotionEstimator
+{
+public:
+    struct Config {
+        int scale = 4;              // Уменьшение яркости для грубого поиска
+        int searchRange = 16;       // Радиус поиска в пикселях уменьшенной яркости (x scale в кадре)
+        int maxBlocks = 64;         // Сколько текстурных блоков участвует в голосовании
+        int minTexture = 4;         // Средний перепад яркости блока; плоские блоки неинформативны
+        double minConfidence = 0.3; // Доля голосов за сдвиг, ниже - считаем, что сдвига нет
+    };
+
+    struct Motion {
+        QPoint shift;
+        double confidence = 0.0;    // Доля блоков, проголосовавших за сдвиг
+        bool valid = false;         // false - мало текстуры или нет согласия, сдвиг (0, 0)
+    };
+
+public:
+    MotionEstimator() = default;
+    explicit MotionEstimator(const Config &config);
+
+    void setConfig(const Config &config) { m_config = config; reset(); }
+    Config config() const { return m_config; }
+
+    // Оценка по паре кадров (без состояния)
+    Motion estimate(const FrameView &prev, const FrameView &curr) const;
+
+    // Живой режим: уменьшенная яркость кадра сохраняется до следующего вызова, поэтому каждый кадр
+    // уменьшается один раз. prevKey/currKey - QImage::cacheKey() кадров: сохраненная яркость берется,
+    // только если prevKey - currKey предыдущего вызова (адрес буфера может достаться новому кадру)
+    Motion update(const FrameView &prev, const FrameView &curr, qint64 prevKey, qint64 currKey);
+    void reset();
+
+    //---------STATIC---------//
+    // Перекрывающиеся области пары при сдвиге shift внутри area: prevRect = currRect - shift.
+    // Пустые прямоугольники, если перекрытия нет
+    static void overlap(const QRect &area, const QPoint &shift, QRect &prevRect, QRect &currRect);
+
+private:
+    struct LumaPlane {
+        std::vector<uchar> data;
+        int width = 0;
+        int height = 0;
+
+        const uchar* row(int y) const { return data.data() + qsizetype(y) * width; }
+    };
+
+    void downsample(const FrameView &frame, LumaPlane &plane) const;
+    Motion match(const LumaPlane &prevPlane, const LumaPlane &currPlane,
+                 const FrameView &prev, const FrameView &curr) const;
+    QPoint refine(const FrameView &prev, const FrameView &curr, const QPoint &coarse,
+                  const std::vector<QPoint> &blocks) const;
+
+private:
+    Config m_config;
+
+    LumaPlane m_lastPlane;              // Уменьшенная яркость curr последнего update()
+    qint64 m_lastKey = 0;               // По какому кадру она посчитана (QImage::cacheKey)
+    QSize m_lastSize;
+};
+
+#endif // MOTIONESTIMATOR_H
@@ -0,0 +1,100 @@
+#include "backend/motionheatmap.h"
+
+#include <algorithm>
+#include <array>
+
+MotionHeatmap::MotionHeatmap(FrameMemory::Subsystem subsystem)
+    : m_memory(subsystem)
+{
+}
+
+void MotionHeatmap::reset(const QSize &size)
+{
+    m_size = size.isValid() ? size : QSize();
+    m_counts.assign(size_t(qMax(0, m_size.width())) * size_t(qMax(0, m_size.height())), 0);
+    m_pairs = 0;
+
+    m_memory.set(memoryBytes());
+}
+
+void MotionHeatmap::clear()
+{
+    std::vector<quint16>().swap(m_counts);
+    m_size = QSize();
+    m_pairs = 0;
+
+    m_memory.set(0);
+}
+
+bool MotionHeatmap::accumulate(const FrameView &prev, const FrameView &curr, int threshold, const QPoint &offset)
+{
+    if (!isValid() || !QRect(QPoint(0, 0), m_size).contains(QRect(offset, curr.size()))) return false;
+
+    if (!BlendKernels::countThresholdCrossings(row(offset.y()) + offset.x(), stride(), prev, curr, threshold)) {
+        return false;
+    }
+
+    ++m_pairs;
+    return true;
+}
+
+quint16 MotionHeatmap::maxCount() const
+{
+    return m_counts.empty() ? 0 : *std::max_element(m_counts.begin(), m_counts.end());
+}
+
+QImage MotionHeatmap::render(int scaleMax) const
+{
+    if (!isValid()) return QImage();
+
+    if (scaleMax <= 0) {
+        scaleMax = maxCount();
+    }
+    scaleMax = qBound(1, scaleMax, 0xFFFF);
+
+    // Индекс палитры = count * 255 / scaleMax в фиксированной точке 16.16, без деления в цикле
+    const quint32 scale = quint32((255u << 16) / quint32(scaleMax));
+    const quint32 limit = quint32(scaleMax);
+    const QRgb *palette = colormap();
+
+    QImage image(m_size, QImage::Format_ARGB32);
+
+    for (int y = 0; y < m_size.height(); ++y) {
+        const quint16 *countRow = row(y);
+        QRgb *imageRow = reinterpret_cast<QRgb*>(image.scanLine(y));
+
+        for (int x = 0; x < m_size.width(); ++x) {
+            const quint32 count = qMin<quint32>(countRow[x], limit);
+            imageRow[x] = palette[qMin<quint32>(255, (count * scale + 0xFFFF) >> 16)];
+        }
+    }
+
+    return image;
+}
+
+const QRgb* MotionHeatmap::colormap()
+{
+    static const std::array<QRgb, 256> palette = [] {
+        // Опорные цвета через равные интервалы, между ними - линейная интерполяция
+        static const int anchors[][3] = {
+            {0, 0, 0}, {60, 10, 100}, {180, 30, 90}, {240, 90, 30}, {250, 200, 40}, {255, 255, 255}
+        };
+        const int segments = int(std::size(anchors)) - 1;
+
+        std::array<QRgb, 256> colors{};
+        for (int i = 0; i < 256; ++i) {
+            const int pos = i * segments;
+            const int segment = qMin(pos / 255, segments - 1);
+            const int t = pos - segment * 255;      // 0..255 внутри отрезка
+
+            const int *from = anchors[segment];
+            const int *to = anchors[segment + 1];
+            colors[i] = qRgb(from[0] + (to[0] - from[0]) * t / 255,
+                             from[1] + (to[1] - from[1]) * t / 255,
+                             from[2] + (to[2] - from[2]) * t / 255);
+        }
+        return colors;
+    }();
+
+    return palette.data();
+}
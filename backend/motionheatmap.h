@@ -0,0 +1,57 @@
+#ifndef MOTIONHEATMAP_H
+#define MOTIONHEATMAP_H
+
+#include "backend/blendkernels.h"
+#include "backend/framememory.h"
+
+#include <QImage>
+#include <QPoint>
+#include <QSize>
+
+#include <vector>
+
+// Частота изменений: сколько раз каждый пиксель пересек порог за сессию.
+// Счетчики 16 бит с насыщением, объем памяти зависит только от размера области,
+// а не от длины сессии. Цвет получается через таблицу палитры только при отображении
+class MotionHeatmap
+{
+public:
+    explicit MotionHeatmap(FrameMemory::Subsystem subsystem = FrameMemory::Sessions);
+
+    // Обнуляет счетчики под новый размер
+    void reset(const QSize &size);
+    void clear();
+
+    bool isValid() const { return !m_counts.empty(); }
+    QSize size() const { return m_size; }
+    quint32 pairs() const { return m_pairs; }
+    qsizetype memoryBytes() const { return qsizetype(m_counts.size() * sizeof(quint16)); }
+
+    quint16* row(int y) { return m_counts.data() + qsizetype(y) * m_size.width(); }
+    const quint16* row(int y) const { return m_counts.data() + qsizetype(y) * m_size.width(); }
+    qsizetype stride() const { return m_size.width(); }     // В элементах
+
+    // Одна пара кадров; метрика и порог - как у V3. offset - положение curr внутри карты
+    // (часть кадра при компенсации сдвига), пара должна помещаться в size()
+    bool accumulate(const FrameView &prev, const FrameView &curr, int threshold, const QPoint &offset = QPoint());
+    // Пары, посчитанные снаружи напрямую через row() (например, параллельно по полосам)
+    void addPairs(quint32 count) { m_pairs += count; }
+
+    quint16 maxCount() const;
+
+    // Счетчик scaleMax и больше - верх палитры; 0 - масштаб по максимальному счетчику
+    QImage render(int scaleMax = 0) const;
+
+    //---------STATIC---------//
+    // Палитра 256 цветов: черный (не менялся) -> фиолетовый -> красный -> желтый -> белый
+    static const QRgb* colormap();
+
+private:
+    std::vector<quint16> m_counts;
+    QSize m_size;
+    quint32 m_pairs = 0;
+
+    FrameMemory::Tracker m_memory;
+};
+
+#endif // MOTIONHEATMAP_H
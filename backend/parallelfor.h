@@ -0,0 +1,47 @@
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <QThreadPool>
+#include <QThread>
+#include <QSemaphore>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Параллельный цикл по индексам [0, count) на глобальном пуле Qt.
+// Вызывающий поток тоже выполняет итерации, а помощники запускаются через tryStart,
+// поэтому вызов из потока пула не зависает, даже если все потоки заняты.
+inline void parallelFor(int count, const std::function<void(int)> &body,
+                        int maxWorkers = QThread::idealThreadCount())
+{
+    if (count <= 0) return;
+
+    struct State {
+        std::atomic<int> next{0};
+        QSemaphore done;
+    };
+    auto state = std::make_shared<State>();
+
+    auto work = [state, &body, count]() {
+        for (int index = state->next.fetch_add(1); index < count; index = state->next.fetch_add(1)) {
+            body(index);
+        }
+    };
+
+    int helpers = 0;
+    const int wanted = qMin(count, maxWorkers) - 1;
+    for (int i = 0; i < wanted; ++i) {
+        const bool started = QThreadPool::globalInstance()->tryStart([state, work]() {
+            work();
+            state->done.release();
+        });
+        if (!started) break;
+        ++helpers;
+    }
+
+    work();
+    state->done.acquire(helpers);
+}
+
+#endif // PARALLELFOR_H
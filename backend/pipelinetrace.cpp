@@ -0,0 +1,221 @@
+#include "backend/pipelinetrace.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+std::atomic<bool> PipelineTrace::s_enabled{false};
+
+namespace
+{
+    // Строка JSON в кавычках: имя потока задает приложение, в нем могут быть кавычки и управляющие символы
+    QByteArray jsonString(const QByteArray &utf8)
+    {
+        QByteArray quoted;
+        quoted.reserve(utf8.size() + 2);
+        quoted += '"';
+        for (const char c : utf8) {
+            switch (c) {
+            case '"':  quoted += "\\\""; break;
+            case '\\': quoted += "\\\\"; break;
+            case '\n': quoted += "\\n"; break;
+            case '\r': quoted += "\\r"; break;
+            case '\t': quoted += "\\t"; break;
+            default:
+                if (uchar(c) < 0x20) {
+                    quoted += "\\u00" + QByteArray::number(uchar(c), 16).rightJustified(2, '0');
+                } else {
+                    quoted += c;
+                }
+            }
+        }
+        quoted += '"';
+        return quoted;
+    }
+}
+
+PipelineTrace* PipelineTrace::instance()
+{
+    static PipelineTrace trace;
+    return &trace;
+}
+
+qint64 PipelineTrace::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PipelineTrace::record(const char *name, qint64 startNs, qint64 durationNs)
+{
+    ThreadBuffer *buffer = instance()->currentBuffer();
+
+    // Единственный писатель буфера: слот, затем номер с release - экспорт видит готовое событие
+    const quint64 index = buffer->written.load(std::memory_order_relaxed);
+    buffer->events[index & (bufferCapacity - 1)] = Event{name, startNs, durationNs};
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+QImage PipelineTrace::convertToFormat(const QImage &image, QImage::Format format)
+{
+    PIPELINE_TRACE_SCOPE("convertToFormat");
+    return image.convertToFormat(format);
+}
+
+PipelineTrace::ThreadBuffer* PipelineTrace::currentBuffer()
+{
+    // Буфер привязывается при первом событии потока; при выходе потока владелец отпускает его
+    struct Owner {
+        ThreadBuffer *buffer = nullptr;
+        ~Owner()
+        {
+            if (buffer) {
+                buffer->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+    thread_local Owner owner;
+    if (owner.buffer) return owner.buffer;
+
+    QMutexLocker locker(&m_mutex);
+
+    ThreadBuffer *buffer = reuseBuffer();
+    if (!buffer) {
+        m_buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = m_buffers.back().get();
+    }
+    buffer->threadId = ++m_threadCount;
+
+    const QThread *thread = QThread::currentThread();
+    const bool isMain = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread();
+    buffer->threadName = !thread->objectName().isEmpty() ? thread->objectName()
+                         : isMain ? QString("GUI")
+                                  : QString("Поток %1").arg(buffer->threadId);
+
+    owner.buffer = buffer;
+    return buffer;
+}
+
+PipelineTrace::ThreadBuffer* PipelineTrace::reuseBuffer()
+{
+    // Буфер завершившегося потока, все события которого экспортированы или забыты;
+    // при достигнутом пределе - любой завершившийся
+    ThreadBuffer *reused = nullptr;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : m_buffers) {
+        if (!buffer->retired.load(std::memory_order_acquire)) continue;
+
+        const quint64 written = buffer->written.load(std::memory_order_relaxed);
+        if (qMax(buffer->cleared.load(std::memory_order_relaxed), buffer->exported.load(std::memory_order_relaxed))
+            >= written) {
+            reused = buffer.get();
+            break;
+        }
+        if (!reused && m_buffers.size() >= maxBuffers) {
+            reused = buffer.get();
+        }
+    }
+    if (!reused) return nullptr;
+
+    reused->cleared.store(reused->written.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    reused->retired.store(false, std::memory_order_relaxed);
+    return reused;
+}
+
+void PipelineTrace::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    for (const std::unique_ptr<ThreadBuffer> &buffer : m_buffers) {
+        buffer->cleared.store(buffer->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+int PipelineTrace::eventCount() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    quint64 count = 0;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : m_buffers) {
+        const quint64 written = buffer->written.load(std::memory_order_acquire);
+        count += qMin(bufferCapacity, written - qMin(written, buffer->cleared.load(std::memory_order_relaxed)));
+    }
+    return int(count);
+}
+
+QByteArray PipelineTrace::toJson() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Время - от самого раннего события, в микросекундах
+    struct ThreadEvents {
+        const ThreadBuffer *buffer;
+        std::vector<Event> events;
+    };
+    std::vector<ThreadEvents> threads;
+    qint64 originNs = std::numeric_limits<qint64>::max();
+
+    for (const std::unique_ptr<ThreadBuffer> &buffer : m_buffers) {
+        // Копируем без остановки писателя; события, которые он мог затереть за время копирования, отбрасываем
+        const quint64 written = buffer->written.load(std::memory_order_acquire);
+        const quint64 first = qMax(buffer->cleared.load(std::memory_order_relaxed),
+                                   written > bufferCapacity ? written - bufferCapacity : 0);
+
+        ThreadEvents thread{buffer.get(), {}};
+        thread.events.reserve(size_t(written - qMin(first, written)));
+        for (quint64 i = first; i < written; ++i) {
+            thread.events.push_back(buffer->events[i & (bufferCapacity - 1)]);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const quint64 after = buffer->written.load(std::memory_order_relaxed);
+        const quint64 overwritten = after > bufferCapacity ? after - bufferCapacity : 0;
+        if (overwritten > first) {
+            thread.events.erase(thread.events.begin(),
+                                thread.events.begin() + qsizetype(qMin(overwritten - first, quint64(thread.events.size()))));
+        }
+
+        buffer->exported.store(written, std::memory_order_relaxed);
+
+        for (const Event &event : thread.events) {
+            originNs = qMin(originNs, event.startNs);
+        }
+        threads.push_back(std::move(thread));
+    }
+
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto append = [&](const QByteArray &entry) {
+        if (!first) json += ",\n";
+        json += entry;
+        first = false;
+    };
+
+    for (const ThreadEvents &thread : threads) {
+        const QByteArray tid = QByteArray::number(thread.buffer->threadId);
+        append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid
+               + ",\"args\":{\"name\":" + jsonString(thread.buffer->threadName.toUtf8()) + "}}");
+
+        for (const Event &event : thread.events) {
+            append("{\"name\":" + jsonString(QByteArray(event.name)) + ",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid
+                   + ",\"ts\":" + QByteArray::number((event.startNs - originNs) / 1000.0, 'f', 3)
+                   + ",\"dur\":" + QByteArray::number(event.durationNs / 1000.0, 'f', 3) + "}");
+        }
+    }
+
+    json += "]}\n";
+    return json;
+}
+
+bool PipelineTrace::exportJson(const QString &path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    return file.write(toJson()) >= 0;
+}
@@ -0,0 +1,104 @@
+#ifndef PIPELINETRACE_H
+#define PIPELINETRACE_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Трасса конвейера: интервалы захвата, конвертаций, ядер и отрисовки по потокам.
+// Каждый поток пишет в свой кольцевой буфер без блокировок (один писатель), при переполнении
+// затираются самые старые события. Буфер завершившегося потока (потоки QThreadPool выходят после
+// простоя и создаются заново) отдается новому потоку после экспорта, поэтому память не растет.
+// Экспорт - Chrome/Perfetto trace JSON (chrome://tracing, ui.perfetto.dev).
+// Выключенная трасса стоит одну атомарную загрузку на область
+class PipelineTrace
+{
+public:
+    struct Event {
+        const char *name;       // Строковый литерал: хранится только указатель
+        qint64 startNs;
+        qint64 durationNs;
+    };
+
+    // Интервал от конструктора до деструктора
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name)
+            : m_name(name)
+            , m_startNs(PipelineTrace::isEnabled() ? PipelineTrace::nowNs() : -1)
+        {
+        }
+        ~Scope()
+        {
+            if (m_startNs >= 0) {
+                PipelineTrace::record(m_name, m_startNs, PipelineTrace::nowNs() - m_startNs);
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char *m_name;
+        qint64 m_startNs;
+    };
+
+public:
+    static PipelineTrace* instance();
+
+    static void setEnabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    static qint64 nowNs();
+    static void record(const char *name, qint64 startNs, qint64 durationNs);
+
+    // QImage::convertToFormat с событием "convertToFormat"
+    static QImage convertToFormat(const QImage &image, QImage::Format format);
+
+    // Забывает записанные события (буферы потоков остаются, буферы завершившихся потоков освобождаются)
+    void clear();
+    int eventCount() const;
+
+    QByteArray toJson() const;
+    bool exportJson(const QString &path) const;
+
+private:
+    // Событий на поток; при 60 кадрах и ~20 событиях на кадр - около минуты истории
+    static constexpr quint64 bufferCapacity = 1 << 16;
+    // Буферов больше этого - завершившиеся потоки отдают свои новым и без экспорта (старые события теряются)
+    static constexpr size_t maxBuffers = 64;
+
+    struct ThreadBuffer {
+        std::unique_ptr<Event[]> events{new Event[bufferCapacity]};
+        std::atomic<quint64> written{0};    // Пишет только поток-владелец
+        std::atomic<quint64> cleared{0};    // События до этого номера забыты
+        std::atomic<quint64> exported{0};   // События до этого номера попали в экспорт
+        std::atomic<bool> retired{false};   // Поток завершился, буфер ждет нового владельца
+        int threadId = 0;
+        QString threadName;
+    };
+
+    PipelineTrace() = default;
+    ThreadBuffer* currentBuffer();
+    ThreadBuffer* reuseBuffer();    // Под m_mutex
+
+private:
+    static std::atomic<bool> s_enabled;
+
+    mutable QMutex m_mutex;     // Только регистрация потоков и экспорт, не запись событий
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+    int m_threadCount = 0;      // Номера потоков в трассе не повторяются и при повторном использовании буфера
+};
+
+#define PIPELINE_TRACE_CONCAT_(a, b) a##b
+#define PIPELINE_TRACE_CONCAT(a, b) PIPELINE_TRACE_CONCAT_(a, b)
+// Событие с именем name (строковый литерал) на время текущей области видимости
+#define PIPELINE_TRACE_SCOPE(name) PipelineTrace::Scope PIPELINE_TRACE_CONCAT(pipelineTraceScope, __LINE__)(name)
+
+#endif // PIPELINETRACE_H
@@ -0,0 +1,314 @@
+#include "backend/resultpublisher.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include <chrono>
+#include <cstring>
+
+using namespace SharedResult;
+
+namespace {
+
+// Поколений подряд, которые пробуем при занятом ключе (сегмент от прошлого запуска)
+constexpr quint32 maxGenerationAttempts = 16;
+
+SlotHeader* slotHeaders(Header *header)
+{
+    return reinterpret_cast<SlotHeader*>(reinterpret_cast<uchar*>(header) + alignUp(sizeof(Header)));
+}
+
+uchar* slotData(Header *header, quint32 slot)
+{
+    return reinterpret_cast<uchar*>(header) + header->dataOffset + qsizetype(slot) * qsizetype(header->slotBytes);
+}
+
+} // namespace
+
+
+ResultPublisher::ResultPublisher(const QString &key, int slotCount)
+    : m_baseKey(key)
+    , m_slotCount(qMax(2, slotCount))
+{
+}
+
+ResultPublisher::~ResultPublisher()
+{
+    QMutexLocker locker(&m_mutex);
+    closeSegment();
+    delete m_control;
+    m_control = nullptr;
+}
+
+void ResultPublisher::setEnabled(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+    m_enabled = enabled;
+
+    if (!enabled) {
+        closeSegment();
+    }
+}
+
+bool ResultPublisher::isEnabled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_enabled;
+}
+
+QString ResultPublisher::key() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_memory ? m_memory->nativeKey() : QString();
+}
+
+quint64 ResultPublisher::published() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_frameNumber;
+}
+
+bool ResultPublisher::publish(const QImage &image)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_enabled || image.isNull()) return false;
+
+    const qsizetype frameBytes = image.sizeInBytes();
+    if (!m_memory || qsizetype(header()->slotBytes) < frameBytes) {
+        if (!openSegment(frameBytes)) return false;
+    }
+
+    Header *head = header();
+    const quint64 frameNumber = m_frameNumber + 1;
+    const quint32 slot = quint32(frameNumber % head->slotCount);
+    SlotHeader &slotHeader = slotHeaders(head)[slot];
+
+    // Нечетная последовательность: читатели этого слота отбросят то, что успели прочитать
+    const quint64 sequence = slotHeader.sequence.load(std::memory_order_relaxed);
+    slotHeader.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slotHeader.frameNumber = frameNumber;
+    slotHeader.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch()).count();
+    slotHeader.width = image.width();
+    slotHeader.height = image.height();
+    slotHeader.stride = image.bytesPerLine();
+    slotHeader.format = quint32(image.format());
+    memcpy(slotData(head, slot), image.constBits(), size_t(frameBytes));
+
+    slotHeader.sequence.store(sequence + 2, std::memory_order_release);
+    head->latest.store(frameNumber, std::memory_order_release);
+
+    m_frameNumber = frameNumber;
+    return true;
+}
+
+bool ResultPublisher::openControl()
+{
+    if (m_control) return true;
+
+    QSharedMemory *memory = new QSharedMemory();
+    memory->setNativeKey(m_baseKey);
+
+    if (memory->create(sizeof(Control))) {
+        Control *head = static_cast<Control*>(memory->data());
+        memset(head, 0, sizeof(Control));
+        head->magic = ControlMagic;
+        head->version = Version;
+    } else {
+        // Ключ занят сегментом прошлого запуска (Unix: сегмент переживает упавший процесс) - берем его
+        if (memory->error() != QSharedMemory::AlreadyExists || !memory->attach()) {
+            qDebug() << "ResultPublisher: cannot open control segment" << m_baseKey << memory->errorString();
+            delete memory;
+            return false;
+        }
+        const Control *head = static_cast<const Control*>(memory->constData());
+        if (head->magic != ControlMagic || head->version != Version) {
+            qDebug() << "ResultPublisher: key is taken by a foreign segment" << m_baseKey;
+            delete memory;
+            return false;
+        }
+        // Поколения прошлого запуска могут еще держать ключи
+        m_nextGeneration = qMax(m_nextGeneration, head->generation.load(std::memory_order_relaxed) + 1);
+    }
+
+    m_control = memory;
+    return true;
+}
+
+bool ResultPublisher::openSegment(qsizetype frameBytes)
+{
+    if (!openControl()) return false;
+
+    // Запас на небольшой рост области, чтобы не пересоздавать сегмент на каждый пиксель
+    const qsizetype slotBytes = alignUp(frameBytes + frameBytes / 4);
+    const qsizetype dataOffset = alignUp(alignUp(sizeof(Header)) + qsizetype(m_slotCount) * qsizetype(sizeof(SlotHeader)));
+    const qsizetype segmentBytes = dataOffset + qsizetype(m_slotCount) * slotBytes;
+
+    // Текущий сегмент закрывается только после того, как управляющий указывает на новый
+    quint32 generation = m_nextGeneration;
+    for (quint32 attempt = 0; attempt < maxGenerationAttempts; ++attempt, ++generation) {
+        QSharedMemory *memory = new QSharedMemory();
+        memory->setNativeKey(segmentKey(m_baseKey, generation));
+
+        if (!memory->create(segmentBytes)) {
+            qDebug() << "ResultPublisher: cannot create segment" << memory->nativeKey() << memory->errorString();
+            delete memory;
+            continue;
+        }
+
+        Header *head = static_cast<Header*>(memory->data());
+        memset(head, 0, size_t(dataOffset));
+        head->magic = Magic;
+        head->version = Version;
+        head->slotCount = quint32(m_slotCount);
+        head->slotBytes = quint64(slotBytes);
+        head->dataOffset = quint64(dataOffset);
+
+        control()->generation.store(generation, std::memory_order_release);
+        delete m_memory;
+
+        m_memory = memory;
+        m_nextGeneration = generation + 1;
+        m_segmentMemory.set(segmentBytes);
+        return true;
+    }
+
+    return false;
+}
+
+void ResultPublisher::closeSegment()
+{
+    if (!m_memory) return;
+
+    // Читатели перестают искать данные до того, как сегмент исчезнет
+    control()->generation.store(0, std::memory_order_release);
+
+    delete m_memory;
+    m_memory = nullptr;
+    m_segmentMemory.set(0);
+}
+
+Header* ResultPublisher::header() const
+{
+    return static_cast<Header*>(m_memory->data());
+}
+
+Control* ResultPublisher::control() const
+{
+    return static_cast<Control*>(m_control->data());
+}
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+ResultReader::ResultReader(const QString &key)
+    : m_baseKey(key)
+{
+}
+
+ResultReader::~ResultReader()
+{
+    detach();
+}
+
+bool ResultReader::attach()
+{
+    if (!m_control) {
+        m_control = new QSharedMemory();
+        m_control->setNativeKey(m_baseKey);
+
+        const Control *head = m_control->attach(QSharedMemory::ReadOnly)
+                                  ? static_cast<const Control*>(m_control->constData()) : nullptr;
+        if (!head || head->magic != ControlMagic || head->version != Version) {
+            detach();
+            return false;
+        }
+    }
+
+    // Поколение читается каждый раз: публикатор мог пересоздать сегмент данных
+    const quint32 generation = static_cast<const Control*>(m_control->constData())
+                                   ->generation.load(std::memory_order_acquire);
+    if (generation == 0) {
+        detachData();
+        return false;
+    }
+    if (isAttached() && generation == m_generation) return true;
+
+    detachData();
+    m_memory = new QSharedMemory();
+    m_memory->setNativeKey(segmentKey(m_baseKey, generation));
+
+    // Сегмент мог закрыться между чтением поколения и подключением - повторим при следующем чтении
+    if (!m_memory->attach(QSharedMemory::ReadOnly)) {
+        detachData();
+        return false;
+    }
+
+    const Header *head = static_cast<const Header*>(m_memory->constData());
+    if (head->magic != Magic || head->version != Version) {
+        detachData();
+        return false;
+    }
+
+    m_generation = generation;
+    return true;
+}
+
+void ResultReader::detach()
+{
+    detachData();
+    delete m_control;
+    m_control = nullptr;
+}
+
+void ResultReader::detachData()
+{
+    delete m_memory;
+    m_memory = nullptr;
+    m_generation = 0;
+}
+
+bool ResultReader::beginRead(Slot &slot)
+{
+    if (!attach()) return false;
+
+    const Header *head = static_cast<const Header*>(m_memory->constData());
+    const quint64 latest = head->latest.load(std::memory_order_acquire);
+    if (latest == 0 || latest == m_lastFrame) return false;
+
+    const quint32 index = quint32(latest % head->slotCount);
+    slot.header = reinterpret_cast<const SlotHeader*>(reinterpret_cast<const uchar*>(head) + alignUp(sizeof(Header))) + index;
+
+    slot.sequence = slot.header->sequence.load(std::memory_order_acquire);
+    if (slot.sequence & 1) return false;
+
+    slot.frameNumber = slot.header->frameNumber;
+    slot.width = slot.header->width;
+    slot.height = slot.header->height;
+    slot.stride = slot.header->stride;
+    slot.format = slot.header->format;
+    slot.data = reinterpret_cast<const uchar*>(head) + head->dataOffset + qsizetype(index) * qsizetype(head->slotBytes);
+
+    // Поля могли быть прочитаны посреди записи - проверяем до того, как отдавать кадр
+    if (slot.width <= 0 || slot.height <= 0 || slot.stride <= 0
+        || slot.format == QImage::Format_Invalid || slot.format >= QImage::NImageFormats
+        || quint64(slot.stride) * quint64(slot.height) > head->slotBytes) {
+        return false;
+    }
+
+    return true;
+}
+
+bool ResultReader::endRead(const Slot &slot)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.header->sequence.load(std::memory_order_relaxed) != slot.sequence) return false;
+
+    m_lastFrame = slot.frameNumber;
+    return true;
+}
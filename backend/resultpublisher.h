@@ -0,0 +1,181 @@
+#ifndef RESULTPUBLISHER_H
+#define RESULTPUBLISHER_H
+
+#include "backend/framememory.h"
+
+#include <QImage>
+#include <QMutex>
+#include <QSharedMemory>
+#include <QString>
+
+#include <atomic>
+
+// Раскладка разделяемой памяти с результатами накопления (кольцо слотов).
+// Имена сегментов - нативные ключи ОС (на Windows - имена file mapping), поэтому читатель
+// может открыть их и без Qt. Все поля - в порядке байт машины, смещения выровнены на 64 байта.
+// Под базовым ключом - постоянный управляющий сегмент (Control) с номером текущего поколения,
+// данные - в сегменте поколения (segmentKey), который пересоздается при росте области:
+//   Header | SlotHeader[slotCount] | данные слота 0 | данные слота 1 | ...
+// Передача кадра - seqlock: писатель делает sequence слота нечетным, копирует кадр и делает его
+// четным. Читатель читает sequence, данные и снова sequence; совпали и четные - кадр цельный.
+// Писатель никогда не ждет читателей: медленный читатель просто получит порванный кадр и повторит
+namespace SharedResult
+{
+    constexpr quint32 Magic = 0x42445452;       // "RTDB"
+    constexpr quint32 ControlMagic = 0x43445452;    // "RTDC"
+    constexpr quint32 Version = 2;
+    constexpr qsizetype Alignment = 64;
+
+    struct SlotHeader {
+        std::atomic<quint64> sequence;  // Нечетное - идет запись
+        quint64 frameNumber;            // Номер кадра (с 1)
+        qint64 timestampNs;             // Время публикации (std::chrono::steady_clock, нс)
+        qint32 width;
+        qint32 height;
+        qint64 stride;                  // Байт на строку
+        quint32 format;                 // QImage::Format
+        quint32 reserved;
+    };
+
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        quint32 slotCount;
+        quint32 reserved;
+        quint64 slotBytes;              // Емкость данных одного слота
+        quint64 dataOffset;             // Смещение данных слота 0 от начала сегмента
+        std::atomic<quint64> latest;    // Номер последнего опубликованного кадра, слот = latest % slotCount
+    };
+
+    // Управляющий сегмент: живет, пока жив публикатор, ключ не меняется
+    struct Control {
+        quint32 magic;
+        quint32 version;
+        std::atomic<quint32> generation;    // Текущий сегмент данных; 0 - публикация выключена
+        quint32 reserved;
+    };
+
+    static_assert(std::atomic<quint64>::is_always_lock_free, "seqlock requires lock-free 64-bit atomics");
+    static_assert(std::atomic<quint32>::is_always_lock_free, "control segment requires lock-free 32-bit atomics");
+
+    inline qsizetype alignUp(qsizetype value) { return (value + Alignment - 1) / Alignment * Alignment; }
+
+    // Ключ сегмента данных поколения generation (с 1); базовый ключ - управляющий сегмент
+    inline QString segmentKey(const QString &baseKey, quint32 generation)
+    {
+        return baseKey + "." + QString::number(generation);
+    }
+}
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+// Писатель кольца. publish() вызывается из потока обработки (один писатель на сегмент),
+// копирует кадр в следующий слот и не блокируется читателями. Если кадр не помещается
+// в слот (изменился размер области) или публикация перезапущена, создается сегмент следующего
+// поколения, его номер записывается в управляющий сегмент, старый закрывается. Читатели,
+// подключенные когда угодно, находят текущий сегмент через управляющий
+class ResultPublisher
+{
+public:
+    explicit ResultPublisher(const QString &key = defaultKey(), int slotCount = 3);
+    ~ResultPublisher();
+
+    // Выключенный публикатор закрывает сегмент и пропускает кадры
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    QString key() const;            // Ключ текущего сегмента (пустой, если не открыт)
+    quint64 published() const;
+
+    // Формат кадра сохраняется как есть (накопители - ARGB32)
+    bool publish(const QImage &image);
+
+    //---------STATIC---------//
+    static QString defaultKey() { return "RT-DifferenceBlend.result"; }
+
+private:
+    bool openControl();
+    bool openSegment(qsizetype frameBytes);
+    void closeSegment();
+    SharedResult::Header* header() const;
+    SharedResult::Control* control() const;
+
+private:
+    mutable QMutex m_mutex;         // Только между писателем и setEnabled, читатели его не видят
+    const QString m_baseKey;
+    const int m_slotCount;
+    bool m_enabled = false;
+
+    QSharedMemory *m_control = nullptr;     // Создается при первой публикации, живет до удаления
+    QSharedMemory *m_memory = nullptr;
+    quint32 m_nextGeneration = 1;
+    quint64 m_frameNumber = 0;
+
+    FrameMemory::Tracker m_segmentMemory{FrameMemory::Output};
+};
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+// Читатель кольца для инструментов-потребителей: кадр читается прямо из разделяемой памяти.
+// Текущий сегмент данных берется из управляющего при каждом чтении - смена поколения
+// (рост области, перезапуск публикации) подхватывается сама
+class ResultReader
+{
+public:
+    explicit ResultReader(const QString &key = ResultPublisher::defaultKey());
+    ~ResultReader();
+
+    bool attach();
+    void detach();
+    bool isAttached() const { return m_memory && m_memory->isAttached(); }    // К сегменту данных
+
+    quint64 lastFrameNumber() const { return m_lastFrame; }
+
+    // Последний кадр, если он новее прочитанного. consume(const QImage &frame, quint64 frameNumber)
+    // получает QImage поверх разделяемой памяти (без копирования), действительный только внутри вызова.
+    // false - новых кадров нет или слот перезаписан во время чтения (результат consume отбросить)
+    template <typename Consumer>
+    bool readLatest(Consumer &&consume)
+    {
+        Slot slot;
+        if (!beginRead(slot)) return false;
+
+        const QImage frame(slot.data, slot.width, slot.height, qsizetype(slot.stride), QImage::Format(slot.format));
+        consume(frame, slot.frameNumber);
+
+        return endRead(slot);
+    }
+
+private:
+    struct Slot {
+        const SharedResult::SlotHeader *header = nullptr;
+        quint64 sequence = 0;
+        quint64 frameNumber = 0;
+        const uchar *data = nullptr;
+        int width = 0;
+        int height = 0;
+        qint64 stride = 0;
+        quint32 format = 0;
+    };
+
+    bool beginRead(Slot &slot);
+    bool endRead(const Slot &slot);
+    void detachData();
+
+private:
+    const QString m_baseKey;
+    QSharedMemory *m_control = nullptr;
+    QSharedMemory *m_memory = nullptr;
+    quint32 m_generation = 0;       // Поколение m_memory
+    quint64 m_lastFrame = 0;
+};
+
+#endif // RESULTPUBLISHER_H
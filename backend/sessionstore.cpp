@@ -0,0 +1,335 @@
+#include "backend/sessionstore.h"
+
+#include "backend/pipelinetrace.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+
+qsizetype rowBytes(const QImage &image, int width)
+{
+    return qsizetype(width) * image.depth() / 8;
+}
+
+qsizetype exposureSize(qsizetype pixels, quint32 parts)
+{
+    qsizetype bytes = pixels * 3 * qsizetype(sizeof(quint32));
+    if (parts & SessionState::ExposureSquares) bytes += pixels * 3 * qsizetype(sizeof(quint32));
+    if (parts & SessionState::ExposureCounts) bytes += pixels * qsizetype(sizeof(quint16));
+    return bytes;
+}
+
+} // namespace
+
+
+SessionStore::SessionStore(const QString &path)
+    : m_path(path)
+    , m_file(path)
+{
+    m_pool.setMaxThreadCount(1);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+}
+
+SessionStore::~SessionStore()
+{
+    waitForIdle();
+    unmapFile();
+}
+
+quint64 SessionStore::generation() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_generation;
+}
+
+bool SessionStore::restore(Snapshot &snapshot)
+{
+    PIPELINE_TRACE_SCOPE("sessionRestore");
+    QMutexLocker locker(&m_mutex);
+    if (m_writing) return false;
+
+    if (!m_file.exists() || m_file.size() < qint64(sizeof(SessionState::Header))) return false;
+    if (!mapFile(m_file.size())) return false;
+
+    const SessionState::Header *h = header();
+    if (h->magic != SessionState::Magic || h->version != SessionState::Version
+        || h->state == SessionState::StateEmpty || qint64(h->fileSize) != m_mappedSize) {
+        return false;
+    }
+    if (h->state == SessionState::StateUpdating) {
+        qDebug() << "Session state: last snapshot was interrupted, resuming from mixed rows";
+    }
+
+    const QRect area(h->areaX, h->areaY, h->areaWidth, h->areaHeight);
+    const QImage::Format resultFormat = QImage::Format(h->resultFormat);
+    if (area.isEmpty() || h->resultOffset + h->resultStride * quint64(area.height()) > h->fileSize) return false;
+
+    Snapshot restored;
+    restored.area = area;
+    restored.method = h->method;
+    restored.result = QImage(m_map + h->resultOffset, area.width(), area.height(), qsizetype(h->resultStride),
+                             resultFormat).copy();
+
+    // Предыдущий кадр: вне области он не читается, достаточно размера и формата кадра
+    if (h->prevFormat != 0 && h->prevOffset + h->prevStride * quint64(area.height()) <= h->fileSize) {
+        QImage prev(h->frameWidth, h->frameHeight, QImage::Format(h->prevFormat));
+        if (!prev.isNull() && QRect(QPoint(0, 0), prev.size()).contains(area)) {
+            prev.fill(0);
+            const qsizetype bytes = qMin<qsizetype>(qsizetype(h->prevStride), rowBytes(prev, area.width()));
+            const qsizetype xOffset = rowBytes(prev, area.x());
+            for (int y = 0; y < area.height(); ++y) {
+                memcpy(prev.scanLine(area.y() + y) + xOffset, m_map + h->prevOffset + qsizetype(y) * h->prevStride,
+                       size_t(bytes));
+            }
+            restored.prevFrame = prev;
+        }
+    }
+
+    const qsizetype pixels = qsizetype(area.width()) * area.height();
+    if (h->heatmapOffset != 0 && h->heatmapOffset + pixels * sizeof(quint16) <= h->fileSize) {
+        const quint16 *counts = reinterpret_cast<const quint16*>(m_map + h->heatmapOffset);
+        restored.heatmapCounts.assign(counts, counts + pixels);
+        restored.heatmapPairs = h->heatmapPairs;
+    }
+
+    const qsizetype exposureBytes = exposureSize(pixels, h->exposureParts);
+    if (h->exposureOffset != 0 && qsizetype(h->exposureOffset) + exposureBytes <= qsizetype(h->fileSize)) {
+        const quint32 *sums = reinterpret_cast<const quint32*>(m_map + h->exposureOffset);
+        restored.exposureSums.assign(sums, sums + pixels * 3);
+        if (h->exposureParts & SessionState::ExposureSquares) {
+            const quint32 *squares = sums + pixels * 3;
+            restored.exposureSquares.assign(squares, squares + pixels * 3);
+        }
+        if (h->exposureParts & SessionState::ExposureCounts) {
+            const quint16 *counts = reinterpret_cast<const quint16*>(
+                sums + pixels * ((h->exposureParts & SessionState::ExposureSquares) ? 6 : 3));
+            restored.exposureCounts.assign(counts, counts + pixels);
+        }
+        restored.exposureFrames = h->exposureFrames;
+    }
+
+    restored.processedFrames = h->processedFrames;
+    restored.droppedFrames = h->droppedFrames;
+    restored.refusedFrames = h->refusedFrames;
+    m_generation = h->generation;
+
+    if (restored.result.isNull()) return false;
+
+    snapshot = restored;
+    qDebug() << "Session state restored:" << m_path << ", snapshot" << m_generation;
+    return true;
+}
+
+void SessionStore::save(const Snapshot &snapshot)
+{
+    if (!snapshot.isValid()) return;
+
+    QMutexLocker locker(&m_mutex);
+    m_pending = snapshot;
+    m_hasPending = true;
+
+    if (!m_writing) {
+        m_writing = true;
+        m_pool.start([this]() { run(); });
+    }
+}
+
+void SessionStore::waitForIdle()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_writing) {
+        m_idle.wait(&m_mutex);
+    }
+}
+
+void SessionStore::run()
+{
+    for (;;) {
+        Snapshot snapshot;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_hasPending) {
+                m_writing = false;
+                m_idle.wakeAll();
+                return;
+            }
+            snapshot = m_pending;
+            m_pending = Snapshot();
+            m_hasPending = false;
+        }
+
+        if (!write(snapshot)) {
+            qDebug() << "Session state: failed to write" << m_path << m_file.errorString();
+        }
+    }
+}
+
+bool SessionStore::write(const Snapshot &snapshot)
+{
+    PIPELINE_TRACE_SCOPE("sessionSnapshot");
+
+    const QRect area = snapshot.area;
+    const QImage &result = snapshot.result;
+    const bool hasPrev = !snapshot.prevFrame.isNull()
+                         && QRect(QPoint(0, 0), snapshot.prevFrame.size()).contains(area);
+    const size_t pixels = size_t(area.width()) * size_t(area.height());
+    const bool hasHeatmap = snapshot.heatmapCounts.size() == pixels;
+    const bool hasExposure = snapshot.exposureSums.size() == pixels * 3;
+    quint32 exposureParts = 0;
+    if (hasExposure && snapshot.exposureSquares.size() == pixels * 3) exposureParts |= SessionState::ExposureSquares;
+    if (hasExposure && snapshot.exposureCounts.size() == pixels) exposureParts |= SessionState::ExposureCounts;
+
+    // Раскладка файла
+    const qsizetype resultStride = rowBytes(result, result.width());
+    const qsizetype prevStride = hasPrev ? rowBytes(snapshot.prevFrame, area.width()) : 0;
+    const qsizetype resultOffset = SessionState::alignUp(sizeof(SessionState::Header));
+    const qsizetype prevOffset = SessionState::alignUp(resultOffset + resultStride * result.height());
+    const qsizetype heatmapOffset = SessionState::alignUp(prevOffset + prevStride * area.height());
+    const qsizetype exposureOffset = SessionState::alignUp(
+        heatmapOffset + (hasHeatmap ? qsizetype(snapshot.heatmapCounts.size() * sizeof(quint16)) : 0));
+    const qsizetype fileSize = exposureOffset + (hasExposure ? exposureSize(qsizetype(pixels), exposureParts) : 0);
+
+    const bool sameLayout = m_map && m_mappedSize == fileSize && header()->magic == SessionState::Magic
+                            && header()->state != SessionState::StateEmpty
+                            && header()->resultOffset == quint64(resultOffset)
+                            && header()->resultStride == quint64(resultStride)
+                            && header()->prevOffset == quint64(prevOffset)
+                            && header()->prevStride == quint64(prevStride)
+                            && header()->method == snapshot.method && header()->areaX == area.x()
+                            && header()->areaY == area.y() && header()->areaWidth == area.width()
+                            && header()->areaHeight == area.height();
+
+    if (!sameLayout && !mapFile(fileSize)) return false;
+
+    // Заголовок новой раскладки пишется до данных: прерванная запись не выдаст чужие строки
+    SessionState::Header *h = header();
+    h->state = sameLayout ? SessionState::StateUpdating : SessionState::StateEmpty;
+    h->magic = SessionState::Magic;
+    h->version = SessionState::Version;
+    h->method = snapshot.method;
+    h->areaX = area.x();
+    h->areaY = area.y();
+    h->areaWidth = area.width();
+    h->areaHeight = area.height();
+    h->frameWidth = hasPrev ? snapshot.prevFrame.width() : area.right() + 1;
+    h->frameHeight = hasPrev ? snapshot.prevFrame.height() : area.bottom() + 1;
+    h->resultFormat = quint32(result.format());
+    h->prevFormat = hasPrev ? quint32(snapshot.prevFrame.format()) : 0;
+    h->resultOffset = quint64(resultOffset);
+    h->resultStride = quint64(resultStride);
+    h->prevOffset = quint64(prevOffset);
+    h->prevStride = quint64(prevStride);
+    h->heatmapOffset = hasHeatmap ? quint64(heatmapOffset) : 0;
+    h->exposureOffset = hasExposure ? quint64(exposureOffset) : 0;
+    h->exposureParts = exposureParts;
+    h->fileSize = quint64(fileSize);
+    flush(0, sizeof(SessionState::Header));
+
+    // Плоскости полосами: каждая полоса сразу уходит на сброс, ОС пишет ее, пока копируется следующая
+    for (int y0 = 0; y0 < result.height(); y0 += bandRows) {
+        const int rows = qMin(bandRows, result.height() - y0);
+        for (int y = y0; y < y0 + rows; ++y) {
+            memcpy(m_map + resultOffset + qsizetype(y) * resultStride, result.constScanLine(y), size_t(resultStride));
+        }
+        flush(resultOffset + qsizetype(y0) * resultStride, qsizetype(rows) * resultStride);
+    }
+
+    if (hasPrev) {
+        const qsizetype xOffset = rowBytes(snapshot.prevFrame, area.x());
+        for (int y0 = 0; y0 < area.height(); y0 += bandRows) {
+            const int rows = qMin(bandRows, area.height() - y0);
+            for (int y = y0; y < y0 + rows; ++y) {
+                memcpy(m_map + prevOffset + qsizetype(y) * prevStride,
+                       snapshot.prevFrame.constScanLine(area.y() + y) + xOffset, size_t(prevStride));
+            }
+            flush(prevOffset + qsizetype(y0) * prevStride, qsizetype(rows) * prevStride);
+        }
+    }
+
+    if (hasHeatmap) {
+        const qsizetype bytes = qsizetype(snapshot.heatmapCounts.size() * sizeof(quint16));
+        memcpy(m_map + heatmapOffset, snapshot.heatmapCounts.data(), size_t(bytes));
+        flush(heatmapOffset, bytes);
+    }
+
+    // Плоскости выдержки подряд, каждая сразу уходит на сброс
+    if (hasExposure) {
+        qsizetype offset = exposureOffset;
+        auto writePlane = [&](const void *data, qsizetype bytes) {
+            memcpy(m_map + offset, data, size_t(bytes));
+            flush(offset, bytes);
+            offset += bytes;
+        };
+        writePlane(snapshot.exposureSums.data(), qsizetype(snapshot.exposureSums.size() * sizeof(quint32)));
+        if (exposureParts & SessionState::ExposureSquares) {
+            writePlane(snapshot.exposureSquares.data(), qsizetype(snapshot.exposureSquares.size() * sizeof(quint32)));
+        }
+        if (exposureParts & SessionState::ExposureCounts) {
+            writePlane(snapshot.exposureCounts.data(), qsizetype(snapshot.exposureCounts.size() * sizeof(quint16)));
+        }
+    }
+
+    h->heatmapPairs = snapshot.heatmapPairs;
+    h->exposureFrames = snapshot.exposureFrames;
+    h->processedFrames = snapshot.processedFrames;
+    h->droppedFrames = snapshot.droppedFrames;
+    h->refusedFrames = snapshot.refusedFrames;
+    {
+        QMutexLocker locker(&m_mutex);
+        h->generation = ++m_generation;
+    }
+    h->state = SessionState::StateComplete;
+    flush(0, sizeof(SessionState::Header));
+
+    return true;
+}
+
+bool SessionStore::mapFile(qint64 size)
+{
+    if (m_map && m_mappedSize == size) return true;
+    unmapFile();
+
+    if (!m_file.isOpen() && !m_file.open(QIODevice::ReadWrite)) return false;
+    if (m_file.size() != size && !m_file.resize(size)) return false;
+
+    m_map = m_file.map(0, size);
+    if (!m_map) return false;
+
+    m_mappedSize = size;
+    return true;
+}
+
+void SessionStore::unmapFile()
+{
+    if (m_map) {
+        flush(0, qsizetype(m_mappedSize));
+        m_file.unmap(m_map);
+        m_map = nullptr;
+        m_mappedSize = 0;
+    }
+}
+
+void SessionStore::flush(qsizetype offset, qsizetype length)
+{
+    if (!m_map || length <= 0) return;
+
+#ifdef Q_OS_WIN
+    FlushViewOfFile(m_map + offset, SIZE_T(length));
+#else
+    // msync принимает только адрес начала страницы (отображение начинается с границы страницы)
+    const qsizetype begin = offset / SessionState::Alignment * SessionState::Alignment;
+    msync(m_map + begin, size_t(offset + length - begin), MS_ASYNC);
+#endif
+}
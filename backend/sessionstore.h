@@ -0,0 +1,144 @@
+#ifndef SESSIONSTORE_H
+#define SESSIONSTORE_H
+
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QRect>
+#include <QString>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <vector>
+
+// Раскладка файла состояния сессии. Файл отображается в память (QFile::map) целиком:
+//   Header | накопитель | область предыдущего кадра | счетчики тепловой карты | суммы выдержки
+// Плоскости начинаются с границы страницы, строки без выравнивания. Поля - в порядке байт машины.
+// Снимок пишется поверх предыдущего; state показывает, можно ли ему верить после падения
+namespace SessionState
+{
+    constexpr quint32 Magic = 0x53544452;       // "RDTS"
+    constexpr quint32 Version = 2;
+    constexpr qsizetype Alignment = 4096;
+
+    enum ExposurePart : quint32 {
+        ExposureSquares = 0x1,      // Суммы квадратов (сигма-отсечение)
+        ExposureCounts = 0x2        // Число кадров по пикселям
+    };
+
+    enum State : quint32 {
+        StateEmpty = 0,     // Снимка нет или запись с новой раскладкой не закончена
+        StateUpdating,      // Идет запись поверх снимка той же раскладки: строка - старая или новая
+        StateComplete
+    };
+
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        quint32 state;
+        qint32 method;                  // ImageBlender::BlendMethod
+        quint64 generation;             // Номер снимка (с 1)
+        qint32 areaX;
+        qint32 areaY;
+        qint32 areaWidth;
+        qint32 areaHeight;
+        qint32 frameWidth;              // Размер кадра источника (область - его часть)
+        qint32 frameHeight;
+        quint32 resultFormat;           // QImage::Format
+        quint32 prevFormat;             // QImage::Format; 0 - предыдущего кадра нет
+        quint64 resultOffset;
+        quint64 resultStride;
+        quint64 prevOffset;
+        quint64 prevStride;
+        quint64 heatmapOffset;          // 0 - нет тепловой карты; quint16 на пиксель области
+        quint32 heatmapPairs;
+        quint32 exposureFrames;
+        quint64 exposureOffset;         // 0 - нет выдержки; суммы R, G, B (quint32 на пиксель области),
+                                        // за ними квадраты и счетчики (quint16), если они есть
+        quint32 exposureParts;          // ExposurePart
+        quint32 reserved;
+        quint64 processedFrames;
+        quint64 droppedFrames;
+        quint64 refusedFrames;
+        quint64 fileSize;
+    };
+
+    inline qsizetype alignUp(qsizetype value) { return (value + Alignment - 1) / Alignment * Alignment; }
+}
+
+
+//------------------------------------------------------------------------------//
+//                                                                              //
+//------------------------------------------------------------------------------//
+
+
+// Долговременное состояние накопления сессии (BlendSession) в файле, отображенном в память.
+// Горячий путь файл не трогает: save() принимает неглубокие копии QImage и сразу возвращается,
+// собственный поток копирует их в отображение полосами и сбрасывает каждую полосу на диск,
+// пока обработка кадров продолжается. После перезапуска restore() читает состояние из отображения -
+// без повторного прогона записанных кадров
+class SessionStore
+{
+public:
+    // Состояние накопления; QImage разделяются неявно, снимок стоит копию счетчиков тепловой карты или сумм выдержки
+    struct Snapshot {
+        QImage result;
+        QImage prevFrame;               // Кадр целиком; сохраняется только area (другие части не сравниваются)
+        QRect area;
+        int method = -1;
+        std::vector<quint16> heatmapCounts;     // Пусто - не тепловая карта
+        quint32 heatmapPairs = 0;
+        std::vector<quint32> exposureSums;      // Пусто - не выдержка; плоскости как у ExposureStack
+        std::vector<quint32> exposureSquares;   // Только с сигма-отсечением
+        std::vector<quint16> exposureCounts;
+        quint32 exposureFrames = 0;
+        quint64 processedFrames = 0;
+        quint64 droppedFrames = 0;
+        quint64 refusedFrames = 0;
+
+        bool isValid() const { return !result.isNull() && !area.isEmpty(); }
+    };
+
+public:
+    explicit SessionStore(const QString &path);
+    ~SessionStore();    // Дописывает последний снимок
+
+    QString path() const { return m_path; }
+    quint64 generation() const;
+
+    // Снимок из файла (копия из отображения). Прерванная запись той же раскладки принимается:
+    // каждая строка в ней от одного из двух последних снимков. false - снимка нет или он другой версии
+    bool restore(Snapshot &snapshot);
+
+    // Из потока обработки, не блокируется: пока идет запись, новый снимок заменяет ждущий
+    void save(const Snapshot &snapshot);
+    void waitForIdle();
+
+private:
+    void run();
+    bool write(const Snapshot &snapshot);
+    bool mapFile(qint64 size);
+    void unmapFile();
+    SessionState::Header* header() const { return reinterpret_cast<SessionState::Header*>(m_map); }
+    // Сброс диапазона отображения на диск (асинхронно для ОС - поток записи не ждет диск)
+    void flush(qsizetype offset, qsizetype length);
+
+private:
+    const QString m_path;
+    static constexpr int bandRows = 64;     // Строк на полосу копирования и сброса
+
+    // Отображение - только в потоке записи (restore - до первого save)
+    QFile m_file;
+    uchar *m_map = nullptr;
+    qint64 m_mappedSize = 0;
+
+    QThreadPool m_pool;             // Один поток записи
+    mutable QMutex m_mutex;
+    QWaitCondition m_idle;
+    Snapshot m_pending;
+    bool m_hasPending = false;
+    bool m_writing = false;
+    quint64 m_generation = 0;
+};
+
+#endif // SESSIONSTORE_H
@@ -0,0 +1,255 @@
+#include "backend/thresholdcache.h"
+#include "backend/parallelfor.h"
+
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr int kBandHeight = 64;
+
+QRgb pixelAt(const FrameView &view, int x, int y)
+{
+    const uchar *row = view.row(y);
+    switch (view.format) {
+        case FramePixelFormat::BGRA8:   return reinterpret_cast<const QRgb*>(row)[x];
+        case FramePixelFormat::RGBA8:   return qRgba(row[x * 4], row[x * 4 + 1], row[x * 4 + 2], row[x * 4 + 3]);
+        case FramePixelFormat::Gray8:   return qRgb(row[x], row[x], row[x]);
+        default:                        return 0xFF000000;
+    }
+}
+
+} // namespace
+
+
+bool ThresholdCache::build(int method, const QVector<FrameView> &frames, const BlendJobControl *control)
+{
+    clear();
+
+    if (!supports(method) || frames.isEmpty() || !frames[0].isValid()) {
+        return false;
+    }
+
+    for (const FrameView &frame : frames) {
+        if (!frame.isValid() || frame.size() != frames[0].size() || frame.format != frames[0].format) {
+            return false;
+        }
+    }
+
+    m_size = frames[0].size();
+    m_diffMap = QByteArray(qsizetype(m_size.width()) * m_size.height(), '\0');
+
+    if (method == BlendMethods::MethodV4Fast) {
+        if (!buildLevels(frames, control)) {
+            clear();
+            return false;
+        }
+    } else {
+        buildDiffMap(method, frames, control);
+    }
+
+    // Полосы отмененной задачи пройдены не до конца
+    if (control && control->isCancelled()) {
+        clear();
+        return false;
+    }
+
+    m_method = method;
+    m_memory.set(memoryBytes());
+    return true;
+}
+
+void ThresholdCache::clear()
+{
+    m_method = -1;
+    m_size = QSize();
+    m_diffMap.clear();
+    m_offsets.clear();
+    m_levels.clear();
+    m_colors.clear();
+    m_histogram.clear();
+    m_memory.set(0);
+}
+
+void ThresholdCache::swap(ThresholdCache &other)
+{
+    std::swap(m_method, other.m_method);
+    std::swap(m_size, other.m_size);
+    m_diffMap.swap(other.m_diffMap);
+    m_offsets.swap(other.m_offsets);
+    m_levels.swap(other.m_levels);
+    m_colors.swap(other.m_colors);
+    std::swap(m_histogram, other.m_histogram);
+
+    m_memory.set(memoryBytes());
+    other.m_memory.set(other.memoryBytes());
+}
+
+qsizetype ThresholdCache::memoryBytes() const
+{
+    return m_diffMap.size()
+           + m_offsets.size() * qsizetype(sizeof(quint32))
+           + m_levels.size()
+           + m_colors.size() * qsizetype(sizeof(QRgb));
+}
+
+void ThresholdCache::buildDiffMap(int method, const QVector<FrameView> &frames, const BlendJobControl *control)
+{
+    const int width = m_size.width();
+    const int bands = (m_size.height() + kBandHeight - 1) / kBandHeight;
+    uchar *diffMap = reinterpret_cast<uchar*>(m_diffMap.data());
+    std::vector<DiffHistogram> bandHistograms(static_cast<size_t>(bands));
+
+    // Полосы строк независимы: каждая проходит все пары кадров по своим строкам
+    parallelFor(bands, [&](int band) {
+        const QRect bandRect(0, band * kBandHeight, width, kBandHeight);
+        uchar *bandMap = diffMap + qsizetype(bandRect.y()) * width;
+
+        for (int i = 1; i < frames.size() && !(control && control->isCancelled()); ++i) {
+            const FrameView prev = frames[i - 1].subView(bandRect);
+            const FrameView curr = frames[i].subView(bandRect);
+
+            if (method == BlendMethods::MethodV3) {
+                BlendKernels::accumulateChannelDiffMap(bandMap, width, prev, curr, &bandHistograms[size_t(band)]);
+            } else {
+                BlendKernels::accumulateGrayDiffMap(bandMap, width, prev, curr, &bandHistograms[size_t(band)]);
+            }
+        }
+    });
+
+    for (const DiffHistogram &histogram : bandHistograms) {
+        m_histogram.merge(histogram);
+    }
+}
+
+bool ThresholdCache::buildLevels(const QVector<FrameView> &frames, const BlendJobControl *control)
+{
+    const int width = m_size.width();
+    const qsizetype pixels = qsizetype(width) * m_size.height();
+    const int bands = (m_size.height() + kBandHeight - 1) / kBandHeight;
+    uchar *diffMap = reinterpret_cast<uchar*>(m_diffMap.data());
+
+    m_offsets = QVector<quint32>(pixels + 1, 0);
+    quint32 *offsets = m_offsets.data();
+    uchar *levelsData = nullptr;
+    QRgb *colorsData = nullptr;
+    std::vector<DiffHistogram> bandHistograms(static_cast<size_t>(bands));
+
+    // Пары обходятся от последней к первой; ступень - пара с разностью больше всех более поздних.
+    // Первый проход считает ступени (и дает карту максимума), второй - записывает их
+    auto walkBand = [&](int band, bool store) {
+        const QRect bandRect(0, band * kBandHeight, width, kBandHeight);
+        const qsizetype first = qsizetype(bandRect.y()) * width;
+        const qsizetype count = qsizetype(qMin(kBandHeight, m_size.height() - bandRect.y())) * width;
+
+        std::vector<uchar> running(size_t(count), 0);
+        std::vector<uchar> levels(static_cast<size_t>(count));
+        std::vector<quint32> cursor;
+        if (store) {
+            cursor.assign(offsets + first, offsets + first + count);
+        }
+
+        for (int i = int(frames.size()) - 1; i >= 1 && !(control && control->isCancelled()); --i) {
+            const FrameView curr = frames[i].subView(bandRect);
+            BlendKernels::averageDiffLevels(levels.data(), width, frames[i - 1].subView(bandRect), curr,
+                                            store ? nullptr : &bandHistograms[size_t(band)]);
+
+            for (qsizetype p = 0; p < count; ++p) {
+                const uchar level = levels[size_t(p)];
+                if (level <= running[size_t(p)]) {
+                    continue;
+                }
+                running[size_t(p)] = level;
+
+                if (store) {
+                    const quint32 slot = cursor[size_t(p)]++;
+                    levelsData[slot] = level;
+                    colorsData[slot] = pixelAt(curr, int(p % width), int(p / width));
+                } else {
+                    ++offsets[first + p + 1];
+                }
+            }
+        }
+
+        if (!store) {
+            memcpy(diffMap + first, running.data(), size_t(count));
+        }
+    };
+
+    parallelFor(bands, [&](int band) { walkBand(band, false); });
+    if (control && control->isCancelled()) return false;
+
+    for (const DiffHistogram &histogram : bandHistograms) {
+        m_histogram.merge(histogram);
+    }
+
+    // Число ступеней -> смещения
+    quint64 total = 0;
+    for (qsizetype p = 1; p <= pixels; ++p) {
+        total += offsets[p];
+        if (total > std::numeric_limits<quint32>::max()) {
+            return false;
+        }
+        offsets[p] = quint32(total);
+    }
+
+    m_levels = QByteArray(qsizetype(total), '\0');
+    m_colors = QVector<QRgb>(qsizetype(total));
+    levelsData = reinterpret_cast<uchar*>(m_levels.data());
+    colorsData = m_colors.data();
+
+    parallelFor(bands, [&](int band) { walkBand(band, true); });
+    return true;
+}
+
+QImage ThresholdCache::render(int threshold) const
+{
+    if (!isValid()) return QImage();
+
+    QImage result(m_size, QImage::Format_ARGB32);
+    const MutableFrameView resultView = MutableFrameView::fromImage(result);
+    const uchar *diffMap = reinterpret_cast<const uchar*>(m_diffMap.constData());
+    const int width = m_size.width();
+    const int bands = (m_size.height() + kBandHeight - 1) / kBandHeight;
+
+    if (m_method != BlendMethods::MethodV4Fast) {
+        parallelFor(bands, [&](int band) {
+            const QRect bandRect(0, band * kBandHeight, width, kBandHeight);
+            BlendKernels::applyThreshold(resultView.subView(bandRect),
+                                         diffMap + qsizetype(bandRect.y()) * width, width, threshold);
+        });
+        return result;
+    }
+
+    const int limit = qBound(0, threshold, 255);
+    const quint32 *offsets = m_offsets.constData();
+    const uchar *levels = reinterpret_cast<const uchar*>(m_levels.constData());
+    const QRgb *colors = m_colors.constData();
+
+    parallelFor(bands, [&](int band) {
+        const int yEnd = qMin(m_size.height(), (band + 1) * kBandHeight);
+        for (int y = band * kBandHeight; y < yEnd; ++y) {
+            QRgb *resultRow = resultView.row(y);
+            const qsizetype rowStart = qsizetype(y) * width;
+
+            for (int x = 0; x < width; ++x) {
+                const qsizetype p = rowStart + x;
+                if (diffMap[p] <= limit) {
+                    resultRow[x] = 0xFF000000;
+                    continue;
+                }
+
+                // Максимум больше порога - подходящая ступень существует
+                quint32 slot = offsets[p];
+                while (levels[slot] <= limit) {
+                    ++slot;
+                }
+                resultRow[x] = colors[slot];
+            }
+        }
+    });
+
+    return result;
+}
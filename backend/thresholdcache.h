@@ -0,0 +1,65 @@
+#ifndef THRESHOLDCACHE_H
+#define THRESHOLDCACHE_H
+
+#include "backend/blendjob.h"
+#include "backend/blendkernels.h"
+#include "backend/blendmethod.h"
+#include "backend/framememory.h"
+
+#include <QByteArray>
+#include <QImage>
+#include <QVector>
+#include <QSize>
+
+// Предрасчет последовательности кадров, не зависящий от порога.
+// После build() результат для любого порога строится одним проходом без обращения к кадрам:
+//  - V3/V4: карта максимальной разности (байт на пиксель), порог - SIMD-сравнение;
+//  - V4Fast: для каждого пикселя "лестница" пар, начиная с последней: в нее попадает пара,
+//    разность которой больше, чем у всех более поздних. Для порога t результат - цвет первой
+//    ступени с разностью больше t (последний записавший в исходном алгоритме). Ступеней не больше 255,
+//    на практике - единицы.
+class ThresholdCache
+{
+public:
+    static bool supports(int method)
+    {
+        return method == BlendMethods::MethodV3 || method == BlendMethods::MethodV4
+               || method == BlendMethods::MethodV4Fast;
+    }
+
+    // frames - кадры одного формата и размера (для V4 - яркость в Gray8).
+    // control - фоновая задача: отмена проверяется на каждой паре кадров полосы, отмененный build() - false
+    bool build(int method, const QVector<FrameView> &frames, const BlendJobControl *control = nullptr);
+    void clear();
+    // Обмен с предрасчетом, построенным вне потока GUI; учет памяти следует за данными
+    void swap(ThresholdCache &other);
+
+    bool isValid() const { return m_method >= 0; }
+    int method() const { return m_method; }
+    QSize size() const { return m_size; }
+    qsizetype memoryBytes() const;
+
+    // Результат метода для порога threshold, совпадает с последовательным смешиванием
+    QImage render(int threshold) const;
+
+    // Разности всех пикселей всех пар, собранные при построении (в метрике метода)
+    const DiffHistogram& histogram() const { return m_histogram; }
+
+private:
+    void buildDiffMap(int method, const QVector<FrameView> &frames, const BlendJobControl *control);
+    bool buildLevels(const QVector<FrameView> &frames, const BlendJobControl *control);
+
+private:
+    int m_method = -1;
+    QSize m_size;
+
+    QByteArray m_diffMap;           // Максимальная разность пикселя по всем парам
+    QVector<quint32> m_offsets;     // V4Fast: начало ступеней пикселя, размер - пиксели + 1
+    QByteArray m_levels;            // V4Fast: разность ступени (возрастает внутри пикселя)
+    QVector<QRgb> m_colors;         // V4Fast: цвет текущего кадра ступени
+
+    DiffHistogram m_histogram;
+    FrameMemory::Tracker m_memory{FrameMemory::Precompute};
+};
+
+#endif // THRESHOLDCACHE_H
@@ -0,0 +1,155 @@
+#include "backend/yuvframe.h"
+
+#include "backend/pipelinetrace.h"
+
+#include <cstring>
+
+YuvFrame::YuvFrame(int width, int height, YuvFrameView::Layout layout, YuvFrameView::Matrix matrix)
+    : m_width(qMax(0, width))
+    , m_height(qMax(0, height))
+    , m_layout(layout)
+    , m_matrix(matrix)
+{
+    if (m_width == 0 || m_height == 0) return;
+
+    m_data = QByteArray(sizeInBytes(m_width, m_height), char(128));
+    memset(m_data.data(), 16, size_t(qsizetype(m_width) * m_height));
+}
+
+qsizetype YuvFrame::sizeInBytes(int width, int height)
+{
+    const qsizetype chromaWidth = (width + 1) / 2;
+    const qsizetype chromaHeight = (height + 1) / 2;
+    return qsizetype(width) * height + 2 * chromaWidth * chromaHeight;
+}
+
+qsizetype YuvFrame::chromaStride() const
+{
+    const qsizetype chromaWidth = (m_width + 1) / 2;
+    return m_layout == YuvFrameView::NV12 ? 2 * chromaWidth : chromaWidth;
+}
+
+qsizetype YuvFrame::chromaOffset(int index) const
+{
+    // NV12: одна плоскость UV; I420: U, за ней V
+    const qsizetype lumaBytes = qsizetype(m_width) * m_height;
+    if (index == 0 || m_layout == YuvFrameView::NV12) return lumaBytes;
+    return lumaBytes + chromaStride() * ((m_height + 1) / 2);
+}
+
+YuvFrameView YuvFrame::view(const QRect &rect) const
+{
+    if (isNull()) return YuvFrameView();
+
+    const uchar *base = reinterpret_cast<const uchar*>(m_data.constData());
+
+    YuvFrameView view;
+    view.luma = FrameView{base, m_width, m_height, m_width, FramePixelFormat::Gray8};
+    view.chroma0 = base + chromaOffset(0);
+    view.chroma1 = m_layout == YuvFrameView::I420 ? base + chromaOffset(1) : nullptr;
+    view.chromaStride = chromaStride();
+    view.layout = m_layout;
+    view.matrix = m_matrix;
+
+    return rect.isNull() ? view : view.subView(rect);
+}
+
+QImage YuvFrame::toImage(const QRect &rect) const
+{
+    return toImage(view(rect));
+}
+
+QImage YuvFrame::toImage(const YuvFrameView &view)
+{
+    PIPELINE_TRACE_SCOPE("yuvToImage");
+    if (!view.isValid()) return QImage();
+
+    QImage image(view.size(), QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            line[x] = view.rgbAt(x, y);
+        }
+    }
+    return image;
+}
+
+YuvFrame YuvFrame::fromData(const QByteArray &data, int width, int height,
+                            YuvFrameView::Layout layout, YuvFrameView::Matrix matrix)
+{
+    if (width <= 0 || height <= 0 || data.size() < sizeInBytes(width, height)) {
+        return YuvFrame();
+    }
+
+    YuvFrame frame;
+    frame.m_data = data;
+    frame.m_width = width;
+    frame.m_height = height;
+    frame.m_layout = layout;
+    frame.m_matrix = matrix;
+    return frame;
+}
+
+YuvFrame YuvFrame::fromImage(const QImage &image, YuvFrameView::Layout layout, YuvFrameView::Matrix matrix)
+{
+    PIPELINE_TRACE_SCOPE("yuvFromImage");
+    if (image.isNull()) return YuvFrame();
+
+    const QImage rgb = image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32
+                           ? image : PipelineTrace::convertToFormat(image, QImage::Format_RGB32);
+
+    YuvFrame frame(rgb.width(), rgb.height(), layout, matrix);
+
+    // Коэффициенты ограниченного диапазона в 8.8 (обратные к YuvFrameView::rgbAt)
+    const bool bt709 = matrix == YuvFrameView::Bt709;
+    const int yr = bt709 ? 47 : 66,   yg = bt709 ? 157 : 129, yb = bt709 ? 16 : 25;
+    const int ur = bt709 ? -26 : -38, ug = bt709 ? -87 : -74, ub = 112;
+    const int vr = 112,               vg = bt709 ? -102 : -94, vb = bt709 ? -10 : -18;
+
+    uchar *luma = frame.lumaPlane();
+    for (int y = 0; y < rgb.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+        uchar *lumaRow = luma + qsizetype(y) * frame.m_width;
+        for (int x = 0; x < rgb.width(); ++x) {
+            const QRgb p = line[x];
+            lumaRow[x] = uchar(((yr * qRed(p) + yg * qGreen(p) + yb * qBlue(p) + 128) >> 8) + 16);
+        }
+    }
+
+    const int chromaWidth = (frame.m_width + 1) / 2;
+    const int chromaHeight = (frame.m_height + 1) / 2;
+    const qsizetype stride = frame.chromaStride();
+    uchar *plane0 = frame.chromaPlane(0);
+    uchar *plane1 = frame.chromaPlane(1);
+
+    for (int cy = 0; cy < chromaHeight; ++cy) {
+        for (int cx = 0; cx < chromaWidth; ++cx) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (int y = 2 * cy; y < qMin(2 * cy + 2, frame.m_height); ++y) {
+                const QRgb *line = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+                for (int x = 2 * cx; x < qMin(2 * cx + 2, frame.m_width); ++x) {
+                    r += qRed(line[x]);
+                    g += qGreen(line[x]);
+                    b += qBlue(line[x]);
+                    ++n;
+                }
+            }
+            r = (r + n / 2) / n;
+            g = (g + n / 2) / n;
+            b = (b + n / 2) / n;
+
+            const uchar u = uchar(((ur * r + ug * g + ub * b + 128) >> 8) + 128);
+            const uchar v = uchar(((vr * r + vg * g + vb * b + 128) >> 8) + 128);
+
+            if (layout == YuvFrameView::NV12) {
+                plane0[cy * stride + 2 * cx] = u;
+                plane0[cy * stride + 2 * cx + 1] = v;
+            } else {
+                plane0[cy * stride + cx] = u;
+                plane1[cy * stride + cx] = v;
+            }
+        }
+    }
+
+    return frame;
+}
@@ -0,0 +1,65 @@
+#ifndef YUVFRAME_H
+#define YUVFRAME_H
+
+#include "backend/blendkernels.h"
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+
+// Кадр YUV 4:2:0 (NV12/I420) в плотной раскладке: Y - width байт на строку, цветность - по
+// (width + 1) / 2 отсчетов на строку и (height + 1) / 2 строк. Так отдают кадры аппаратные
+// декодеры и захват видео. Данные - в QByteArray с неявным разделением: копия кадра дешевая,
+// fromData не копирует буфер
+class YuvFrame
+{
+public:
+    YuvFrame() = default;
+    // Нулевой кадр: Y = 16, U = V = 128 (черный)
+    YuvFrame(int width, int height, YuvFrameView::Layout layout = YuvFrameView::NV12,
+             YuvFrameView::Matrix matrix = YuvFrameView::Bt601);
+
+    bool isNull() const { return m_data.isEmpty(); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    QSize size() const { return QSize(m_width, m_height); }
+    YuvFrameView::Layout layout() const { return m_layout; }
+    YuvFrameView::Matrix matrix() const { return m_matrix; }
+    const QByteArray& data() const { return m_data; }
+
+    uchar* lumaPlane() { return reinterpret_cast<uchar*>(m_data.data()); }
+    uchar* chromaPlane(int index) { return lumaPlane() + chromaOffset(index); }
+
+    // Представление области (пустой QRect - весь кадр) для BlendKernels
+    YuvFrameView view(const QRect &rect = QRect()) const;
+
+    // Цвет области в Format_RGB32 (полное преобразование, для методов, которым нужен RGB)
+    QImage toImage(const QRect &rect = QRect()) const;
+
+    //---------STATIC---------//
+    static qsizetype sizeInBytes(int width, int height);
+
+    // Обертка над готовым буфером без копирования; размер data должен быть не меньше sizeInBytes
+    static YuvFrame fromData(const QByteArray &data, int width, int height,
+                             YuvFrameView::Layout layout = YuvFrameView::NV12,
+                             YuvFrameView::Matrix matrix = YuvFrameView::Bt601);
+    // Перевод RGB-кадра (цветность - среднее по блоку 2x2)
+    static YuvFrame fromImage(const QImage &image, YuvFrameView::Layout layout = YuvFrameView::NV12,
+                              YuvFrameView::Matrix matrix = YuvFrameView::Bt601);
+
+    static QImage toImage(const YuvFrameView &view);
+
+private:
+    qsizetype chromaOffset(int index) const;
+    qsizetype chromaStride() const;
+
+private:
+    QByteArray m_data;
+    int m_width = 0;
+    int m_height = 0;
+    YuvFrameView::Layout m_layout = YuvFrameView::NV12;
+    YuvFrameView::Matrix m_matrix = YuvFrameView::Bt601;
+};
+
+#endif // YUVFRAME_H
@@ -0,0 +1,372 @@
+#include "tiledimageviewer.h"
+
+#include <QKeyEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QThread>
+#include <QWheelEvent>
+#include <QtMath>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+constexpr int cacheBudgetKb = 128 * 1024;   // Около 500 плиток 256x256
+constexpr double zoomStep = 1.25;
+constexpr double maxScale = 32.0;
+
+} // namespace
+
+
+TiledImageViewer::TiledImageViewer(QWidget *parent)
+    : QAbstractScrollArea(parent)
+{
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setAttribute(Qt::WA_OpaquePaintEvent);
+
+    m_tiles.setMaxCost(cacheBudgetKb);
+    // Один поток остается GUI
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+TiledImageViewer::~TiledImageViewer()
+{
+    // Отложенные вызовы tileReady удаляются вместе с объектом, начатые плитки дожидаемся
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void TiledImageViewer::setImage(const QImage &image)
+{
+    const bool sameSize = !m_image.isNull() && image.size() == m_image.size();
+
+    m_image = image;
+    ++m_generation;
+
+    // Тот же размер (новый порог, промежуточный результат): старые плитки остаются заглушками,
+    // пока не готовы новые - без мигания
+    if (!sameSize) {
+        m_tiles.clear();
+        m_fitted = true;
+    }
+
+    m_maxLevel = 0;
+    while ((image.width() >> m_maxLevel) > tileSize || (image.height() >> m_maxLevel) > tileSize) {
+        ++m_maxLevel;
+    }
+
+    if (m_fitted) {
+        m_scale = fitScale();
+    }
+    updateScrollBars();
+    viewChanged();
+}
+
+void TiledImageViewer::setScale(double scale)
+{
+    zoomAt(scale, QRectF(viewport()->rect()).center());
+}
+
+double TiledImageViewer::fitScale() const
+{
+    if (m_image.isNull()) return 1.0;
+
+    return qMin(1.0, qMin(double(viewport()->width()) / m_image.width(),
+                          double(viewport()->height()) / m_image.height()));
+}
+
+QImage TiledImageViewer::renderTile(const QImage &source, int level, int tileX, int tileY)
+{
+    const int factor = 1 << level;
+    const int span = tileSize * factor;
+    const QRect sourceRect = QRect(tileX * span, tileY * span, span, span).intersected(source.rect());
+    if (sourceRect.isEmpty()) return QImage();
+
+    if (level == 0) {
+        return source.copy(sourceRect).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    const QSize size((sourceRect.width() + factor - 1) / factor, (sourceRect.height() + factor - 1) / factor);
+    QImage tile(size, QImage::Format_ARGB32_Premultiplied);
+
+    // 32-битные форматы читаются напрямую, остальные (RGBA32FPx4 и т.п.) переводятся по строкам блока
+    const QImage::Format format = source.format();
+    const bool direct = format == QImage::Format_RGB32 || format == QImage::Format_ARGB32
+                        || format == QImage::Format_ARGB32_Premultiplied;
+    const bool premultiply = format == QImage::Format_ARGB32;
+
+    // Сумма блока не больше factor^2 * 255: 32 бит хватает до factor = 4096
+    std::vector<quint32> sums(size_t(size.width()) * 4);
+
+    for (int y = 0; y < size.height(); ++y) {
+        const int top = sourceRect.y() + y * factor;
+        const int rows = qMin(factor, sourceRect.bottom() + 1 - top);
+
+        QImage band;
+        if (!direct) {
+            band = source.copy(sourceRect.x(), top, sourceRect.width(), rows)
+                       .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+
+        std::fill(sums.begin(), sums.end(), 0u);
+        for (int row = 0; row < rows; ++row) {
+            const QRgb *line = direct
+                                   ? reinterpret_cast<const QRgb*>(source.constScanLine(top + row)) + sourceRect.x()
+                                   : reinterpret_cast<const QRgb*>(band.constScanLine(row));
+
+            for (int x = 0; x < sourceRect.width(); ++x) {
+                const QRgb pixel = premultiply ? qPremultiply(line[x]) : line[x];
+                quint32 *sum = sums.data() + size_t(x >> level) * 4;
+                sum[0] += qRed(pixel);
+                sum[1] += qGreen(pixel);
+                sum[2] += qBlue(pixel);
+                sum[3] += qAlpha(pixel);
+            }
+        }
+
+        QRgb *out = reinterpret_cast<QRgb*>(tile.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            // Крайние блоки могут быть неполными
+            const quint32 count = quint32(qMin(factor, sourceRect.width() - x * factor) * rows);
+            const quint32 *sum = sums.data() + size_t(x) * 4;
+            out[x] = qRgba(int((sum[0] + count / 2) / count), int((sum[1] + count / 2) / count),
+                           int((sum[2] + count / 2) / count), int((sum[3] + count / 2) / count));
+        }
+    }
+
+    return tile;
+}
+
+void TiledImageViewer::zoomIn()
+{
+    setScale(m_scale * zoomStep);
+}
+
+void TiledImageViewer::zoomOut()
+{
+    setScale(m_scale / zoomStep);
+}
+
+void TiledImageViewer::fitToWindow()
+{
+    m_fitted = true;
+    m_scale = fitScale();
+    updateScrollBars();
+    viewChanged();
+}
+
+void TiledImageViewer::showActualSize()
+{
+    setScale(1.0);
+}
+
+void TiledImageViewer::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().color(QPalette::Dark));
+    if (m_image.isNull()) return;
+
+    const int level = levelFor(m_scale);
+    const int span = tileSize << level;
+    const QPointF origin = contentOffset();
+
+    // Видимая часть в координатах изображения
+    const QRectF visible = QRectF(event->rect()).translated(-origin);
+    const QRect sourceVisible = QRectF(visible.topLeft() / m_scale, visible.size() / m_scale).toAlignedRect()
+                                    .intersected(m_image.rect());
+    if (sourceVisible.isEmpty()) return;
+
+    // Уменьшение - со сглаживанием, увеличение - по пикселям (разности видны без размытия)
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, m_scale < 1.0);
+
+    // Края плиток округляются одинаково для соседей - без щелей между ними
+    auto targetRect = [&](const QRect &source) {
+        const int left = qFloor(origin.x() + source.left() * m_scale);
+        const int top = qFloor(origin.y() + source.top() * m_scale);
+        const int right = qFloor(origin.x() + (source.right() + 1) * m_scale);
+        const int bottom = qFloor(origin.y() + (source.bottom() + 1) * m_scale);
+        return QRect(left, top, qMax(1, right - left), qMax(1, bottom - top));
+    };
+
+    for (int tileY = sourceVisible.top() / span; tileY <= sourceVisible.bottom() / span; ++tileY) {
+        for (int tileX = sourceVisible.left() / span; tileX <= sourceVisible.right() / span; ++tileX) {
+            const QRect tileSource = QRect(tileX * span, tileY * span, span, span).intersected(m_image.rect());
+            const QRect target = targetRect(tileSource);
+            const quint64 key = tileKey(level, tileX, tileY);
+
+            const Tile *tile = m_tiles.object(key);
+            if (tile && tile->generation == m_generation) {
+                painter.drawPixmap(target, tile->pixmap);
+                continue;
+            }
+            requestTile(key);
+
+            // Пока плитки нет - прежняя версия или кусок более грубого уровня
+            if (tile) {
+                painter.drawPixmap(target, tile->pixmap);
+                continue;
+            }
+            for (int coarse = level + 1; coarse <= m_maxLevel; ++coarse) {
+                const int coarseSpan = tileSize << coarse;
+                const int parentX = tileSource.x() / coarseSpan;
+                const int parentY = tileSource.y() / coarseSpan;
+                const Tile *parent = m_tiles.object(tileKey(coarse, parentX, parentY));
+                if (!parent) continue;
+
+                const double factor = 1 << coarse;
+                const QRectF part((tileSource.x() - parentX * coarseSpan) / factor,
+                                  (tileSource.y() - parentY * coarseSpan) / factor,
+                                  tileSource.width() / factor, tileSource.height() / factor);
+                painter.drawPixmap(QRectF(target), parent->pixmap, part);
+                break;
+            }
+        }
+    }
+}
+
+void TiledImageViewer::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+
+    if (m_fitted) {
+        m_scale = fitScale();
+    }
+    updateScrollBars();
+    viewChanged();
+}
+
+void TiledImageViewer::scrollContentsBy(int dx, int dy)
+{
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    viewChanged();
+}
+
+void TiledImageViewer::wheelEvent(QWheelEvent *event)
+{
+    if (!(event->modifiers() & Qt::ControlModifier)) {
+        QAbstractScrollArea::wheelEvent(event);
+        return;
+    }
+
+    zoomAt(m_scale * qPow(zoomStep, event->angleDelta().y() / 120.0), event->position());
+    event->accept();
+}
+
+void TiledImageViewer::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key()) {
+        case Qt::Key_Plus:
+        case Qt::Key_Equal: zoomIn(); break;
+        case Qt::Key_Minus: zoomOut(); break;
+        case Qt::Key_0:     fitToWindow(); break;
+        case Qt::Key_1:     showActualSize(); break;
+        default:            QAbstractScrollArea::keyPressEvent(event); return;
+    }
+    event->accept();
+}
+
+void TiledImageViewer::zoomAt(double scale, const QPointF &anchor)
+{
+    if (m_image.isNull()) return;
+
+    // Уменьшать дальше половины "по окну" смысла нет
+    scale = qBound(qMin(1.0, fitScale()) / 2, scale, maxScale);
+
+    const QPointF imagePoint = (anchor - contentOffset()) / m_scale;
+    m_scale = scale;
+    m_fitted = false;
+    updateScrollBars();
+
+    // Точка изображения под anchor остается на месте
+    horizontalScrollBar()->setValue(qRound(imagePoint.x() * m_scale - anchor.x()));
+    verticalScrollBar()->setValue(qRound(imagePoint.y() * m_scale - anchor.y()));
+    viewChanged();
+}
+
+void TiledImageViewer::updateScrollBars()
+{
+    const QSize content = (QSizeF(m_image.size()) * m_scale).toSize();
+    const QSize view = viewport()->size();
+
+    horizontalScrollBar()->setRange(0, qMax(0, content.width() - view.width()));
+    horizontalScrollBar()->setPageStep(view.width());
+    horizontalScrollBar()->setSingleStep(qMax(1, view.width() / 20));
+    verticalScrollBar()->setRange(0, qMax(0, content.height() - view.height()));
+    verticalScrollBar()->setPageStep(view.height());
+    verticalScrollBar()->setSingleStep(qMax(1, view.height() / 20));
+}
+
+void TiledImageViewer::viewChanged()
+{
+    ++m_viewEpoch;
+    viewport()->update();
+}
+
+int TiledImageViewer::levelFor(double scale) const
+{
+    // Самый грубый уровень, у которого пикселей не меньше, чем точек экрана
+    int level = 0;
+    while (level < m_maxLevel && scale * (1 << (level + 1)) <= 1.0) {
+        ++level;
+    }
+    return level;
+}
+
+QPointF TiledImageViewer::contentOffset() const
+{
+    // Изображение меньше окна - по центру
+    const QSizeF content = QSizeF(m_image.size()) * m_scale;
+    const QSize view = viewport()->size();
+
+    const double x = content.width() < view.width() ? (view.width() - content.width()) / 2
+                                                    : -horizontalScrollBar()->value();
+    const double y = content.height() < view.height() ? (view.height() - content.height()) / 2
+                                                      : -verticalScrollBar()->value();
+    return QPointF(x, y);
+}
+
+void TiledImageViewer::requestTile(quint64 key)
+{
+    if (m_pending.contains(key)) return;
+    m_pending.insert(key);
+
+    const QImage image = m_image;
+    const quint64 generation = m_generation;
+    const quint64 epoch = m_viewEpoch.load();
+
+    m_pool.start([this, image, key, generation, epoch]() {
+        // Вид успел смениться - плитка, возможно, уже не видна: перезапросит следующая отрисовка
+        QImage tile;
+        if (m_viewEpoch.load() == epoch) {
+            tile = renderTile(image, int(key >> 48), int(key & 0xFFFFFF), int((key >> 24) & 0xFFFFFF));
+        }
+
+        QMetaObject::invokeMethod(this, [this, key, generation, tile]() {
+            tileReady(key, generation, tile);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void TiledImageViewer::tileReady(quint64 key, quint64 generation, const QImage &tile)
+{
+    m_pending.remove(key);
+
+    // Пропущенная или устаревшая плитка: видимые запросятся заново
+    if (tile.isNull() || generation != m_generation) {
+        viewport()->update();
+        return;
+    }
+
+    const int costKb = qMax(1, int(tile.sizeInBytes() / 1024));
+    m_tiles.insert(key, new Tile{QPixmap::fromImage(tile), generation}, costKb);
+    viewport()->update();
+}
+
+quint64 TiledImageViewer::tileKey(int level, int tileX, int tileY)
+{
+    return (quint64(level) << 48) | (quint64(tileY) << 24) | quint64(tileX);
+}
@@ -0,0 +1,88 @@
+#ifndef TILEDIMAGEVIEWER_H
+#define TILEDIMAGEVIEWER_H
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QImage>
+#include <QPixmap>
+#include <QSet>
+#include <QThreadPool>
+
+#include <atomic>
+
+// Просмотр больших результатов (склейка экранов, 8K и больше) без QPixmap на все изображение.
+// Изображение делится на плитки tileSize x tileSize; уровень пирамиды L - уменьшение в 2^L раз.
+// Плитки строятся лениво в фоне и только для видимой области текущего масштаба, готовые
+// хранятся в кэше (QCache, последние использованные). Пока плитки нет, рисуется увеличенный кусок
+// более грубого уровня из кэша. Колесо с Ctrl - масштаб вокруг курсора; клавиши +, -, 0 (по окну), 1 (100%)
+class TiledImageViewer : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    static constexpr int tileSize = 256;
+
+public:
+    explicit TiledImageViewer(QWidget *parent = nullptr);
+    ~TiledImageViewer();
+
+    // Изображение разделяется неявно, не копируется. Тот же размер - масштаб и положение сохраняются
+    void setImage(const QImage &image);
+    QImage image() const { return m_image; }
+
+    double scale() const { return m_scale; }
+    void setScale(double scale);
+    // Масштаб, при котором изображение целиком помещается в окно (не больше 1)
+    double fitScale() const;
+
+    //---------STATIC---------//
+    // Плитка уровня level (Format_ARGB32_Premultiplied): усреднение блоков 2^level x 2^level исходника
+    static QImage renderTile(const QImage &source, int level, int tileX, int tileY);
+
+public slots:
+    void zoomIn();
+    void zoomOut();
+    void fitToWindow();
+    void showActualSize();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+
+private:
+    struct Tile {
+        QPixmap pixmap;
+        quint64 generation;     // Плитка прежнего изображения того же размера - заглушка до новой
+    };
+
+    // Масштаб с неподвижной точкой anchor (координаты окна)
+    void zoomAt(double scale, const QPointF &anchor);
+    void updateScrollBars();
+    void viewChanged();
+
+    int levelFor(double scale) const;
+    QPointF contentOffset() const;      // Положение изображения в окне
+    void requestTile(quint64 key);
+    void tileReady(quint64 key, quint64 generation, const QImage &tile);
+
+    static quint64 tileKey(int level, int tileX, int tileY);
+
+private:
+    QImage m_image;
+    int m_maxLevel = 0;
+    double m_scale = 1.0;
+    bool m_fitted = true;           // Масштаб следует за размером окна, пока его не меняли
+
+    QCache<quint64, Tile> m_tiles;      // Стоимость - КБ
+    QSet<quint64> m_pending;            // Плитки в очереди пула
+    quint64 m_generation = 0;           // Смена изображения отбрасывает плитки старого
+
+    // Вид сменился (прокрутка, масштаб) - не начатые плитки прежнего вида пропускаются
+    std::atomic<quint64> m_viewEpoch{0};
+    QThreadPool m_pool;
+};
+
+#endif // TILEDIMAGEVIEWER_H
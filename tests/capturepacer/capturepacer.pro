@@ -0,0 +1,15 @@
+QT       += core gui testlib
+
+CONFIG += c++20 testcase console
+CONFIG -= app_bundle
+
+TARGET = tst_capturepacer
+
+# CapturePacer не зависит от WinAPI: тест собирается и на других платформах
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../backend/capturepacer.cpp \
+    tst_capturepacer.cpp
+HEADERS += \
+    ../../backend/capturepacer.h
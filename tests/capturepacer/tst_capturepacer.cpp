@@ -0,0 +1,141 @@
+#include "backend/capturepacer.h"
+
+#include <QSignalSpy>
+#include <QTest>
+
+// Последовательности наблюдений, как их присылает BlendSession: reportFrame на обработанный кадр,
+// reportChange(0.0) на отброшенный повтор
+class TestCapturePacer : public QObject
+{
+    Q_OBJECT
+
+private:
+    static CapturePacer::Config config()
+    {
+        CapturePacer::Config config;
+        config.minIntervalMs = 16;
+        config.maxIntervalMs = 250;
+        return config;
+    }
+
+private slots:
+    void idleBacksOffToMaximum()
+    {
+        CapturePacer pacer;
+        pacer.setConfig(config());
+        QCOMPARE(pacer.intervalMs(), 16);
+
+        // Неподвижное окно: все кадры - повторы, интервал только растет
+        int previous = pacer.intervalMs();
+        for (int i = 0; i < 100; ++i) {
+            pacer.reportChange(0.0);
+            QVERIFY(pacer.intervalMs() >= previous);
+            previous = pacer.intervalMs();
+        }
+        QCOMPARE(pacer.intervalMs(), 250);
+    }
+
+    void motionSnapsBackToMinimum()
+    {
+        CapturePacer pacer;
+        pacer.setConfig(config());
+        for (int i = 0; i < 100; ++i) {
+            pacer.reportChange(0.0);
+        }
+        QCOMPARE(pacer.intervalMs(), 250);
+
+        QSignalSpy spy(&pacer, &CapturePacer::intervalChanged);
+        pacer.reportFrame(0.05, 0, 2.0);
+        QCOMPARE(pacer.intervalMs(), 16);
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(spy.takeFirst().at(0).toInt(), 16);
+    }
+
+    void noiseDoesNotKeepMaximumRate()
+    {
+        CapturePacer pacer;
+        pacer.setConfig(config());
+
+        // Мигающий курсор: доля изменений ниже порога простоя
+        for (int i = 0; i < 100; ++i) {
+            pacer.reportFrame(0.0005, 0, 2.0);
+        }
+        QCOMPARE(pacer.intervalMs(), 250);
+    }
+
+    void overloadBacksOff()
+    {
+        CapturePacer pacer;
+        pacer.setConfig(config());
+
+        // Движение есть, но обработка не успевает: интервал не меньше задержки стадии
+        pacer.reportFrame(1.0, 3, 40.0);
+        QVERIFY(pacer.intervalMs() >= 40);
+        QVERIFY(pacer.isOverloaded());
+
+        pacer.reportFrame(1.0, 0, 5.0);
+        QCOMPARE(pacer.intervalMs(), 16);
+        QVERIFY(!pacer.isOverloaded());
+    }
+
+    void disabledKeepsMinimum()
+    {
+        CapturePacer pacer;
+        pacer.setConfig(config());
+        pacer.setEnabled(false);
+
+        for (int i = 0; i < 100; ++i) {
+            pacer.reportChange(0.0);
+        }
+        QCOMPARE(pacer.intervalMs(), 16);
+    }
+
+    void changedFraction()
+    {
+        QImage prev(64, 64, QImage::Format_ARGB32);
+        prev.fill(Qt::black);
+        QImage curr = prev.copy();
+        QCOMPARE(CapturePacer::changedFraction(prev, curr), 0.0);
+
+        curr.fill(Qt::white);
+        QCOMPARE(CapturePacer::changedFraction(prev, curr), 1.0);
+
+        // Изменение вне области не учитывается
+        QImage half = prev.copy();
+        for (int y = 0; y < half.height(); ++y) {
+            for (int x = 32; x < half.width(); ++x) {
+                half.setPixel(x, y, qRgb(255, 255, 255));
+            }
+        }
+        QCOMPARE(CapturePacer::changedFraction(prev, half, QRect(0, 0, 32, 64)), 0.0);
+        QVERIFY(CapturePacer::changedFraction(prev, half) > 0.4);
+    }
+
+    void changeFractionsSeparateNoise()
+    {
+        QImage prev(64, 64, QImage::Format_ARGB32);
+        prev.fill(Qt::black);
+
+        // Шум сжатия: изменился каждый пиксель, но меньше порога
+        QImage noisy(64, 64, QImage::Format_ARGB32);
+        noisy.fill(qRgb(10, 10, 10));
+        CapturePacer::ChangeFractions fractions = CapturePacer::changeFractions(prev, noisy, QRect(), 8, 24);
+        QCOMPARE(fractions.any, 1.0);
+        QCOMPARE(fractions.aboveNoise, 0.0);
+
+        // Настоящее изменение в левой половине
+        for (int y = 0; y < noisy.height(); ++y) {
+            for (int x = 0; x < 32; ++x) {
+                noisy.setPixel(x, y, qRgb(255, 255, 255));
+            }
+        }
+        fractions = CapturePacer::changeFractions(prev, noisy, QRect(), 8, 24);
+        QCOMPARE(fractions.any, 1.0);
+        QVERIFY(fractions.aboveNoise > 0.4 && fractions.aboveNoise < 0.6);
+        QCOMPARE(CapturePacer::changedFraction(prev, noisy, QRect(), 8, 24), fractions.aboveNoise);
+    }
+};
+
+QTEST_APPLESS_MAIN(TestCapturePacer)
+
+#include "tst_capturepacer.moc"
@@ -0,0 +1,134 @@
+#include "backend/blendkernels.h"
+#include "backend/yuvframe.h"
+
+#include <QTest>
+
+// BlendKernels::accumulateThresholdColorYuv: разность по плоскости Y, цвет - только у изменившихся пикселей.
+// Ширина кадра не кратна 16, изменения попадают и в SIMD-часть строки, и в скалярный хвост
+class TestYuvKernels : public QObject
+{
+    Q_OBJECT
+
+private:
+    static constexpr int frameWidth = 70;
+    static constexpr int frameHeight = 40;
+    static constexpr QRgb untouched = 0xFF123456;
+
+    static QImage background()
+    {
+        QImage image(frameWidth, frameHeight, QImage::Format_RGB32);
+        image.fill(qRgb(64, 64, 64));
+        return image;
+    }
+
+    // Блок с четными границами: цветность 2x2 не смешивается с фоном
+    static QImage withBlock(const QRect &block, QRgb color)
+    {
+        QImage image = background();
+        for (int y = block.top(); y <= block.bottom(); ++y) {
+            for (int x = block.left(); x <= block.right(); ++x) {
+                image.setPixel(x, y, color);
+            }
+        }
+        return image;
+    }
+
+    static QImage accumulator(const QSize &size)
+    {
+        QImage result(size, QImage::Format_ARGB32);
+        result.fill(untouched);
+        return result;
+    }
+
+    static void checkBlock(YuvFrameView::Layout layout)
+    {
+        const QRect block(56, 10, 12, 8);
+        const YuvFrame prev = YuvFrame::fromImage(background(), layout);
+        const YuvFrame curr = YuvFrame::fromImage(withBlock(block, qRgb(220, 30, 30)), layout);
+
+        QImage result = accumulator(curr.size());
+        QVERIFY(BlendKernels::accumulateThresholdColorYuv(MutableFrameView::fromImage(result), prev.view(),
+                                                          curr.view(), YuvFrameView::lumaThreshold(15)));
+
+        const YuvFrameView currView = curr.view();
+        for (int y = 0; y < result.height(); ++y) {
+            for (int x = 0; x < result.width(); ++x) {
+                const QRgb pixel = result.pixel(x, y);
+                if (block.contains(x, y)) {
+                    QCOMPARE(pixel, currView.rgbAt(x, y));
+                    QVERIFY(qRed(pixel) > 180 && qGreen(pixel) < 80);
+                } else {
+                    QCOMPARE(pixel, untouched);
+                }
+            }
+        }
+    }
+
+private slots:
+    void unchangedFramesLeaveResult()
+    {
+        const YuvFrame frame = YuvFrame::fromImage(background());
+        QImage result = accumulator(frame.size());
+
+        QVERIFY(BlendKernels::accumulateThresholdColorYuv(MutableFrameView::fromImage(result), frame.view(),
+                                                          frame.view(), 0));
+        for (int y = 0; y < result.height(); ++y) {
+            for (int x = 0; x < result.width(); ++x) {
+                QCOMPARE(result.pixel(x, y), untouched);
+            }
+        }
+    }
+
+    void changedBlockTakesCurrentColorNv12()
+    {
+        checkBlock(YuvFrameView::NV12);
+    }
+
+    void changedBlockTakesCurrentColorI420()
+    {
+        checkBlock(YuvFrameView::I420);
+    }
+
+    void thresholdAboveDifferenceIgnoresChange()
+    {
+        const YuvFrame prev = YuvFrame::fromImage(background());
+        const YuvFrame curr = YuvFrame::fromImage(withBlock(QRect(0, 0, 16, 16), qRgb(72, 72, 72)));
+        QImage result = accumulator(curr.size());
+
+        // Разность Y около 7: порог 20 ее не пропускает
+        QVERIFY(BlendKernels::accumulateThresholdColorYuv(MutableFrameView::fromImage(result), prev.view(),
+                                                          curr.view(), 20));
+        QCOMPARE(result.pixel(4, 4), untouched);
+    }
+
+    void subViewUsesFrameCoordinates()
+    {
+        const QRect block(20, 12, 8, 6);
+        const QRect area(15, 9, 30, 20);
+        const YuvFrame prev = YuvFrame::fromImage(background());
+        const YuvFrame curr = YuvFrame::fromImage(withBlock(block, qRgb(30, 200, 40)));
+
+        QImage result = accumulator(area.size());
+        QVERIFY(BlendKernels::accumulateThresholdColorYuv(MutableFrameView::fromImage(result), prev.view(area),
+                                                          curr.view(area), YuvFrameView::lumaThreshold(15)));
+
+        // Цвет области совпадает с цветом того же пикселя всего кадра
+        const QPoint inside = block.topLeft() + QPoint(2, 2);
+        QCOMPARE(result.pixel(inside - area.topLeft()), curr.view().rgbAt(inside.x(), inside.y()));
+        QCOMPARE(result.pixel(0, 0), untouched);
+    }
+
+    void rejectsMismatchedSizes()
+    {
+        const YuvFrame prev = YuvFrame::fromImage(background());
+        const YuvFrame curr(frameWidth / 2, frameHeight);
+        QImage result = accumulator(prev.size());
+
+        QVERIFY(!BlendKernels::accumulateThresholdColorYuv(MutableFrameView::fromImage(result), prev.view(),
+                                                           curr.view(), 0));
+    }
+};
+
+QTEST_APPLESS_MAIN(TestYuvKernels)
+
+#include "tst_yuvkernels.moc"
@@ -0,0 +1,19 @@
+QT       += core gui testlib
+
+CONFIG += c++20 testcase console
+CONFIG -= app_bundle
+
+TARGET = tst_yuvkernels
+
+# Ядра и YuvFrame не зависят от WinAPI: тест собирается и на других платформах
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../backend/blendkernels.cpp \
+    ../../backend/pipelinetrace.cpp \
+    ../../backend/yuvframe.cpp \
+    tst_yuvkernels.cpp
+HEADERS += \
+    ../../backend/blendkernels.h \
+    ../../backend/pipelinetrace.h \
+    ../../backend/yuvframe.h
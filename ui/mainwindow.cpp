@@ -18,6 +18,55 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->labelDropArea, &DropArea::dropAreaFileReviced, md, QOverload<const QList<QUrl>&>::of(&Mediator::loadImagesToBuffer));
     connect(ui->spinBoxThreadhold, &QSpinBox::valueChanged, md, &Mediator::chagneThreadhold);
     connect(ui->comboBoxMethod, &QComboBox::activated, md, &Mediator::processStoredImages);
+    connect(ui->comboBoxAutoThreshold, &QComboBox::activated, md, &Mediator::changeAutoThreshold);
+    connect(ui->checkBoxMotionCompensation, &QCheckBox::toggled, md, &Mediator::changeMotionCompensation);
+    connect(ui->spinBoxSceneCut, &QSpinBox::valueChanged, md, &Mediator::changeSceneCutPercent);
+    connect(ui->checkBoxPublishResult, &QCheckBox::toggled, md, &Mediator::changeResultPublishing);
+    connect(ui->spinBoxMemoryBudget, &QSpinBox::valueChanged, md, [=](int megabytes){
+        md->changeMemoryBudget(qint64(megabytes) * 1024 * 1024);
+    });
+    connect(ui->checkBoxPreviewDecode, &QCheckBox::toggled, md, [=](bool enabled){
+        const QScreen *screen = QGuiApplication::primaryScreen();
+        md->changeDecodeLimit(enabled && screen ? screen->size() * screen->devicePixelRatio() : QSize());
+    });
+    connect(ui->actionTrace, &QAction::toggled, md, &Mediator::changeTracing);
+    connect(ui->actionSaveTrace, &QAction::triggered, md, &Mediator::saveTrace);
+    connect(ui->actionCalibrate, &QAction::triggered, md, &Mediator::calibrateKernels);
+    connect(ui->actionAddSource, &QAction::triggered, md, &Mediator::addSourceWindow);
+
+    // Учет памяти кадров по подсистемам и состояние сессий, обновляются раз в секунду
+    QLabel *sessionsLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(sessionsLabel);
+    QLabel *memoryLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(memoryLabel);
+    QTimer *memoryTimer = new QTimer(this);
+    connect(memoryTimer, &QTimer::timeout, this, [=](){
+        sessionsLabel->setText(md->sessionReport());
+        memoryLabel->setText(FrameMemory::instance()->report());
+    });
+    memoryTimer->start(1000);
+
+    connect(md, &Mediator::blendProgress, this, [=](int done, int total){
+        if (done < total) {
+            ui->statusbar->showMessage(QString("Смешивание: %1%").arg(qint64(done) * 100 / qMax(1, total)));
+        } else {
+            ui->statusbar->clearMessage();
+        }
+    });
+    connect(md, &Mediator::kernelsCalibrated, this, [=](const QString &report){
+        ui->statusbar->showMessage(QString("Ядра: %1").arg(report), 10000);
+    });
+    connect(md, &Mediator::sceneCutDetected, this, [=](quint64 frameIndex){
+        ui->statusbar->showMessage(QString("Смена сцены: кадр %1, накопление начато заново").arg(frameIndex), 5000);
+    });
+    connect(md, &Mediator::thresholdSuggested, this, [=](int value){
+        ui->statusbar->showMessage(QString("Рекомендуемый порог: %1").arg(value));
+    });
+    // Порог уже применен в Mediator - только синхронизируем поле без повторного сигнала
+    connect(md, &Mediator::thresholdApplied, this, [=](int value){
+        QSignalBlocker blocker(ui->spinBoxThreadhold);
+        ui->spinBoxThreadhold->setValue(value);
+    });
 }
 
 MainWindow::~MainWindow()